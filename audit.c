@@ -0,0 +1,249 @@
+/*
+ * Exhaustive audit that no k-1 shares reveal anything about the secret
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+
+#include "field.h"
+#include "pool.h"
+
+/*
+ * The secret derived from a set S of shares_required - 1 shares plus a share
+ * q at some other X coordinate final_x is
+ *   secret = (terms only depending on S) + weight * q
+ *   weight = product over j in S of x[j] / (x[j] - final_x)
+ * The first term differs for every byte of the secret but only shifts the set
+ * of secrets the P possible values of q derive, so checking that weight * q
+ * takes every value once per (S, final_x) covers every byte of the secret.
+ *
+ * Subsets are enumerated depth-first, carrying the partial product of weight
+ * for every final_x along, so subsets sharing a prefix share its products.
+ * The first (up to) two members of each subset pick the task, and tasks are
+ * handed out to the pool's threads one at a time as they become free.
+ */
+
+#define PREFIX_DEPTH 2
+
+struct audit_job {
+	const uint8_t* x;
+	uint8_t total_shares, subset_size, prefix_depth;
+	// factors[j][final_x] == x[j] / (x[j] - final_x)
+	uint8_t (*factors)[P];
+	int failed;
+	uint64_t subsets;
+};
+
+// Tries every q at every final_x not in the subset, given the products of the whole subset
+static bool audit_subset(const uint8_t weights[P], const bool in_subset[P]) {
+	static const uint8_t all_q[P] = {
+#define ROW(i) i, i+1, i+2, i+3, i+4, i+5, i+6, i+7, i+8, i+9, i+10, i+11, i+12, i+13, i+14, i+15
+		ROW(0), ROW(16), ROW(32), ROW(48), ROW(64), ROW(80), ROW(96), ROW(112),
+		ROW(128), ROW(144), ROW(160), ROW(176), ROW(192), ROW(208), ROW(224), ROW(240)
+#undef ROW
+	};
+	uint8_t derived[P];
+	uint16_t final_x, i;
+	for (final_x = 1; final_x < P; final_x++) {
+		if (in_subset[final_x])
+			continue;
+		uint64_t possible_secrets[P / 64] = { 0 };
+		field_mul_buf(derived, all_q, weights[final_x], P);
+		for (i = 0; i < P; i++)
+			possible_secrets[derived[i] / 64] |= (uint64_t)1 << (derived[i] % 64);
+		for (i = 0; i < P / 64; i++)
+			if (possible_secrets[i] != ~(uint64_t)0)
+				return false;
+	}
+	return true;
+}
+
+// levels[depth] holds the partial products for the members chosen so far
+static void audit_descend(struct audit_job* job, uint8_t (*levels)[P], bool in_subset[P], uint8_t depth, uint16_t next, uint64_t* subsets) {
+	if (depth == job->subset_size) {
+		if (!audit_subset(levels[depth], in_subset))
+			__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		(*subsets)++;
+		return;
+	}
+	for (uint16_t member = next; member + (job->subset_size - depth) <= job->total_shares; member++) {
+		for (uint16_t final_x = 1; final_x < P; final_x++)
+			levels[depth + 1][final_x] = field_mul(levels[depth][final_x], job->factors[member][final_x]);
+		in_subset[job->x[member]] = 1;
+		audit_descend(job, levels, in_subset, depth + 1, member + 1, subsets);
+		in_subset[job->x[member]] = 0;
+	}
+}
+
+static void audit_task(void* arg, size_t task) {
+	struct audit_job* job = arg;
+	uint8_t levels[job->subset_size + 1][P];
+	bool in_subset[P];
+	uint64_t subsets = 0;
+	uint8_t depth = 0;
+	uint16_t next = 0;
+
+	memset(levels[0], 1, P);
+	memset(in_subset, 0, sizeof(in_subset));
+
+	// Decode the task into the first prefix_depth members (in increasing order), as digits base total_shares
+	uint16_t prefix[PREFIX_DEPTH];
+	for (int i = job->prefix_depth - 1; i >= 0; i--) {
+		prefix[i] = task % job->total_shares;
+		task /= job->total_shares;
+	}
+	for (; depth < job->prefix_depth; depth++) {
+		uint16_t member = prefix[depth];
+		if (member < next || member + (job->subset_size - depth) > job->total_shares)
+			return; // Not an increasing prefix of any subset
+		for (uint16_t final_x = 1; final_x < P; final_x++)
+			levels[depth + 1][final_x] = field_mul(levels[depth][final_x], job->factors[member][final_x]);
+		in_subset[job->x[member]] = 1;
+		next = member + 1;
+	}
+
+	audit_descend(job, levels, in_subset, depth, next, &subsets);
+	__atomic_add_fetch(&job->subsets, subsets, __ATOMIC_RELAXED);
+}
+
+/**
+ * Exhaustively checks what checkNoInformationLeak proves: for every set of shares_required - 1 of the
+ * shares and every X coordinate not in it, each of the P values a share there could take derives a
+ * different secret
+ * Returns 1 if so (0 if not or out of memory), and the number of subsets enumerated in subsets_checked
+ */
+int auditNoInformationLeak(struct pool* pool, const uint8_t x[], uint8_t total_shares, uint8_t shares_required, uint64_t* subsets_checked) {
+	struct audit_job job = { x, total_shares, shares_required - 1, 0, (void*)0, 0, 0 };
+	size_t tasks = 1;
+	uint8_t i, j;
+
+	*subsets_checked = 0;
+	CHECKSTATE(shares_required >= 1 && shares_required <= total_shares);
+	for (i = 0; i < total_shares; i++) {
+		if (x[i] == 0)
+			return 0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return 0;
+	}
+
+	job.factors = ALLOC(sizeof(uint8_t[total_shares][P]));
+	if (!job.factors)
+		return 0;
+	for (i = 0; i < total_shares; i++) {
+		job.factors[i][0] = 0;
+		for (uint16_t final_x = 1; final_x < P; final_x++)
+			job.factors[i][final_x] = final_x == x[i] ? 0 : field_mul(x[i], field_invert(field_sub(x[i], final_x)));
+	}
+
+	job.prefix_depth = job.subset_size < PREFIX_DEPTH ? job.subset_size : PREFIX_DEPTH;
+	for (i = 0; i < job.prefix_depth; i++)
+		tasks *= total_shares;
+	pool_run(pool, audit_task, &job, tasks);
+
+	FREE(job.factors);
+	*subsets_checked = job.subsets;
+	return !job.failed;
+}
+
+/*
+ * The brute-force audit, which shares nothing with the one above or with checkNoInformationLeak
+ * beyond calculateSecret: for each byte of the actual shares, every subset of shares_required - 1
+ * of them and every X coordinate not in it, each value of a share there is run through
+ * calculateSecret and the secrets derived are tallied. One task per byte.
+ */
+
+struct brute_job {
+	const uint8_t* const* shares;
+	const uint8_t* x;
+	uint8_t total_shares, shares_required;
+	int failed;
+	uint64_t subsets;
+};
+
+// subset_x and subset_q hold the members chosen so far, with room for the share at final_x after them
+static void brute_descend(struct brute_job* job, size_t byte, uint8_t subset_x[], uint8_t subset_q[], uint8_t depth, uint8_t next, uint64_t* subsets) {
+	if (depth == job->shares_required - 1) {
+		(*subsets)++;
+		for (uint16_t final_x = 1; final_x < P; final_x++) {
+			bool x_already_used = false, possible_secrets[P];
+			for (uint8_t j = 0; j < depth; j++)
+				x_already_used |= subset_x[j] == final_x;
+			if (x_already_used)
+				continue;
+
+			subset_x[depth] = final_x;
+			memset(possible_secrets, 0, sizeof(possible_secrets));
+			for (uint16_t q = 0; q < P; q++) {
+				subset_q[depth] = q;
+				possible_secrets[calculateSecret(subset_x, subset_q, job->shares_required)] = 1;
+			}
+			for (uint16_t i = 0; i < P; i++) {
+				if (!possible_secrets[i]) {
+					__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+					return;
+				}
+			}
+		}
+		return;
+	}
+	for (uint16_t member = next; member + (job->shares_required - 1 - depth) <= job->total_shares; member++) {
+		subset_x[depth] = job->x[member];
+		subset_q[depth] = job->shares[member][byte];
+		brute_descend(job, byte, subset_x, subset_q, depth + 1, member + 1, subsets);
+	}
+}
+
+static void brute_task(void* arg, size_t byte) {
+	struct brute_job* job = arg;
+	uint8_t subset_x[job->shares_required], subset_q[job->shares_required];
+	uint64_t subsets = 0;
+	brute_descend(job, byte, subset_x, subset_q, 0, 0, &subsets);
+	memset(subset_q, 0, sizeof(subset_q));
+	__atomic_add_fetch(&job->subsets, subsets, __ATOMIC_RELAXED);
+}
+
+/**
+ * Checks the same property as auditNoInformationLeak independently of it, by brute force over
+ * the bytes of the shares themselves: for each byte, every set of shares_required - 1 of the shares
+ * and every X coordinate not in it, the P values a share there could take derive P different
+ * secrets through calculateSecret. Takes about C(n, k - 1) * 255 * 256 calls of calculateSecret
+ * per byte, with the bytes spread across pool.
+ * Returns 1 if so (0 if not), and the number of subsets enumerated over all bytes in subsets_checked
+ */
+int auditSharesNoInformationLeak(struct pool* pool, const uint8_t* const shares[], const uint8_t x[], uint8_t total_shares, uint8_t shares_required,
+		size_t length, uint64_t* subsets_checked) {
+	struct brute_job job = { shares, x, total_shares, shares_required, 0, 0 };
+	uint8_t i, j;
+
+	*subsets_checked = 0;
+	CHECKSTATE(shares_required >= 1 && shares_required <= total_shares);
+	for (i = 0; i < total_shares; i++) {
+		if (x[i] == 0)
+			return 0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return 0;
+	}
+
+	pool_run(pool, brute_task, &job, length);
+	*subsets_checked = job.subsets;
+	return !job.failed;
+}
@@ -0,0 +1,406 @@
+/*
+ * Shamir's secret sharing benchmarks, reported as JSON on stdout
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fft.h"
+
+#define BUFFER_SIZE (64 * 1024)
+#define MIN_SECONDS 0.2
+
+// The (n, k) and secret sizes which split and combine are measured over
+static const struct { uint8_t n, k; } share_counts[] = { {2, 2}, {3, 2}, {5, 3}, {10, 5}, {32, 16}, {64, 32} };
+static const size_t secret_sizes[] = { 4096, 64 * 1024, 1024 * 1024 };
+
+// The k which the matrix and FFT encoders and decoders are compared over, all with n = P - 1,
+// to find where FFT_AUTO should switch over
+static const uint8_t fft_k[] = { 8, 16, 32, 48, 64, 96, 128, 192, 254 };
+#define FFT_SIZE (64 * 1024)
+
+// The secrets per polynomial which packed encoding is measured over, with n = PACKED_N and k = PACKED_K
+static const uint8_t packed_l[] = { 1, 2, 4, 8, 16 };
+#define PACKED_N 32
+#define PACKED_K 8
+
+// The (n, k) which the audit is measured over
+static const struct { uint8_t n, k; } audit_counts[] = { {10, 5}, {16, 8}, {20, 4} };
+
+// The share counts which VSS verification is measured over, all with k = VSS_K
+static const uint8_t vss_counts[] = { 16, 64, 254 };
+#define VSS_K 16
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static volatile uint8_t sink;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs fn on arg in growing batches until MIN_SECONDS have passed, returns seconds per call
+static double time_calls(void (*fn)(void*), void* arg) {
+	uint64_t calls = 0, batch = 1;
+	double start = now(), elapsed;
+	do {
+		for (uint64_t i = 0; i < batch; i++)
+			fn(arg);
+		calls += batch;
+		batch *= 2;
+		elapsed = now() - start;
+	} while (elapsed < MIN_SECONDS);
+	return elapsed / calls;
+}
+
+// One call multiplies every pair of field elements, so 65536 multiplies
+static void mul_table_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 0; a < P; a++)
+		for (uint16_t b = 0; b < P; b++)
+			acc ^= field_mul_table(a ^ acc, b);
+	sink = acc;
+}
+static void mul_ct_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 0; a < P; a++)
+		for (uint16_t b = 0; b < P; b++)
+			acc ^= field_mul_ct(a ^ acc, b);
+	sink = acc;
+}
+static void invert_table_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 1; a < P; a++)
+		acc ^= field_invert_table(a | acc | 1);
+	sink = acc;
+}
+static void invert_ct_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 1; a < P; a++)
+		acc ^= field_invert_ct(a | acc | 1);
+	sink = acc;
+}
+static void pow_table_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 1; a < P; a++)
+		acc ^= field_pow_table(a | acc | 1, a);
+	sink = acc;
+}
+static void pow_ct_all(void* arg) {
+	uint8_t acc = 0;
+	for (uint16_t a = 1; a < P; a++)
+		acc ^= field_pow_ct(a | acc | 1, a);
+	sink = acc;
+}
+
+static uint8_t src[BUFFER_SIZE], dst[BUFFER_SIZE];
+static void mul_add_buffer(void* arg) {
+	field_mul_add_buf(dst, src, 0x57, BUFFER_SIZE);
+	sink = dst[0];
+}
+
+struct split_args {
+	struct pool* pool;
+	uint8_t n, k;
+	size_t length;
+	uint8_t* x;
+	uint8_t* secret;
+	uint8_t* random;
+	uint8_t** shares;
+	struct combiner* combiner;
+	struct encoder* encoder;
+	struct decoder* decoder;
+};
+static void split_buffer(void* arg) {
+	struct split_args* args = arg;
+	splitBufferParallel(args->pool, args->shares, args->x, args->n, args->secret, args->random, args->k, args->length);
+}
+static void encode_buffer(void* arg) {
+	struct split_args* args = arg;
+	encoderBufferParallel(args->pool, args->encoder, args->shares, args->secret, args->random, args->length);
+}
+static void decode_buffer(void* arg) {
+	struct split_args* args = arg;
+	decoderBufferParallel(args->pool, args->decoder, args->random, (const uint8_t* const*)args->shares, args->length);
+}
+static void combine_buffer(void* arg) {
+	struct split_args* args = arg;
+	combinerBufferParallel(args->pool, args->combiner, args->secret, (const uint8_t* const*)args->shares, args->length);
+}
+
+struct audit_args {
+	struct pool* pool;
+	uint8_t n, k;
+	uint8_t* x;
+	uint64_t subsets;
+};
+static void audit(void* arg) {
+	struct audit_args* args = arg;
+	CHECKSTATE(auditNoInformationLeak(args->pool, args->x, args->n, args->k, &args->subsets));
+}
+
+struct vss_args {
+	uint8_t count;
+	uint8_t (*commitments)[VSS_POINT_SIZE];
+	uint8_t* x;
+	uint8_t (*shares)[VSS_SCALAR_SIZE];
+};
+static void vss_verify_each(void* arg) {
+	struct vss_args* args = arg;
+	for (uint8_t i = 0; i < args->count; i++)
+		CHECKSTATE(vssVerify((const uint8_t (*)[VSS_POINT_SIZE])args->commitments, VSS_K, args->x[i], args->shares[i]));
+}
+static void vss_verify_batch(void* arg) {
+	struct vss_args* args = arg;
+	CHECKSTATE(vssVerifyBatch((const uint8_t (*)[VSS_POINT_SIZE])args->commitments, VSS_K, args->x,
+			(const uint8_t (*)[VSS_SCALAR_SIZE])args->shares, args->count, &randomSystem));
+}
+
+static void print_field_op(const char* op, const char* impl, double seconds_per_op, int last) {
+	printf("    {\"op\": \"%s\", \"impl\": \"%s\", \"ns_per_op\": %.3f}%s\n", op, impl, seconds_per_op * 1e9, last ? "" : ",");
+}
+
+enum sweep_mode { SWEEP_SPLIT, SWEEP_ENCODE, SWEEP_COMBINE };
+static const char* const sweep_names[] = { "split", "encode", "combine" };
+
+// Runs the (n, k, size) sweep for one mode and prints one JSON array of results
+static void sweep(struct pool* pool, unsigned threads, enum sweep_mode mode) {
+	printf("  \"%s\": [\n", sweep_names[mode]);
+	for (size_t c = 0; c < ARRAY_SIZE(share_counts); c++) {
+		for (size_t s = 0; s < ARRAY_SIZE(secret_sizes); s++) {
+			struct split_args args = { pool, share_counts[c].n, share_counts[c].k, secret_sizes[s] };
+			uint8_t x[args.n];
+			uint8_t* shares[args.n];
+			for (uint8_t i = 0; i < args.n; i++) {
+				x[i] = i + 1;
+				shares[i] = malloc(args.length);
+				CHECKSTATE(shares[i]);
+			}
+			args.x = x;
+			args.shares = shares;
+			args.secret = malloc(args.length);
+			args.random = malloc((args.k - 1) * args.length + 1);
+			CHECKSTATE(args.secret && args.random);
+			for (size_t i = 0; i < args.length; i++)
+				args.secret[i] = i * 7 + 3;
+			for (size_t i = 0; i < (args.k - 1) * args.length; i++)
+				args.random[i] = i * 13 + 5;
+
+			double seconds;
+			if (mode == SWEEP_COMBINE) {
+				splitBuffer(shares, x, args.n, args.secret, args.random, args.k, args.length);
+				args.combiner = combinerCreate(x, args.k);
+				CHECKSTATE(args.combiner);
+				seconds = time_calls(combine_buffer, &args);
+				combinerFree(args.combiner);
+			} else if (mode == SWEEP_ENCODE) {
+				args.encoder = encoderCreate(x, args.n, args.k);
+				CHECKSTATE(args.encoder);
+				seconds = time_calls(encode_buffer, &args);
+				encoderFree(args.encoder);
+			} else
+				seconds = time_calls(split_buffer, &args);
+
+			int last = c == ARRAY_SIZE(share_counts) - 1 && s == ARRAY_SIZE(secret_sizes) - 1;
+			printf("    {\"n\": %u, \"k\": %u, \"size\": %lu, \"threads\": %u, \"mb_per_s\": %.1f}%s\n",
+					args.n, args.k, args.length, threads, args.length / seconds / 1e6, last ? "" : ",");
+
+			for (uint8_t i = 0; i < args.n; i++)
+				free(shares[i]);
+			free(args.secret);
+			free(args.random);
+		}
+	}
+	printf("  ],\n");
+}
+
+// Times encoding and decoding with the matrices and with the FFT, for n = P - 1 and every fft_k
+static void fft_sweep(struct pool* pool, unsigned threads) {
+	static const enum fft_mode modes[] = { FFT_NEVER, FFT_ALWAYS };
+	uint8_t x[P - 1];
+	uint8_t* shares[P - 1];
+	struct split_args args = { pool, P - 1, 0, FFT_SIZE, x, malloc(FFT_SIZE), malloc((P - 1) * FFT_SIZE) };
+	CHECKSTATE(args.secret && args.random);
+	for (uint8_t i = 0; i < args.n; i++) {
+		x[i] = i + 1;
+		shares[i] = malloc(FFT_SIZE);
+		CHECKSTATE(shares[i]);
+	}
+	args.shares = shares;
+	for (size_t i = 0; i < FFT_SIZE; i++)
+		args.secret[i] = i * 7 + 3;
+	for (size_t i = 0; i < (P - 1) * FFT_SIZE; i++)
+		args.random[i] = i * 13 + 5;
+
+	printf("  \"fft\": [\n");
+	for (size_t c = 0; c < ARRAY_SIZE(fft_k); c++) {
+		double encode[ARRAY_SIZE(modes)], decode[ARRAY_SIZE(modes)];
+		args.k = fft_k[c];
+		for (size_t m = 0; m < ARRAY_SIZE(modes); m++) {
+			fft_select(modes[m]);
+			args.encoder = encoderCreate(x, args.n, args.k);
+			args.decoder = decoderCreate(x, args.k);
+			CHECKSTATE(args.encoder && args.decoder);
+			encode[m] = args.length / time_calls(encode_buffer, &args) / 1e6;
+			decode[m] = args.length / time_calls(decode_buffer, &args) / 1e6;
+			encoderFree(args.encoder);
+			decoderFree(args.decoder);
+		}
+		printf("    {\"n\": %u, \"k\": %u, \"size\": %u, \"threads\": %u, \"encode_matrix_mb_per_s\": %.1f, \"encode_fft_mb_per_s\": %.1f, \"encode_auto_fft\": %s, "
+				"\"decode_matrix_mb_per_s\": %.1f, \"decode_fft_mb_per_s\": %.1f, \"decode_auto_fft\": %s}%s\n",
+				args.n, args.k, FFT_SIZE, threads, encode[0], encode[1], fft_encode_cheaper(args.n, args.k) ? "true" : "false",
+				decode[0], decode[1], fft_decode_cheaper(args.k) ? "true" : "false", c == ARRAY_SIZE(fft_k) - 1 ? "" : ",");
+	}
+	printf("  ],\n");
+	fft_select(FFT_AUTO);
+
+	for (uint8_t i = 0; i < args.n; i++)
+		free(shares[i]);
+	free(args.secret);
+	free(args.random);
+}
+
+// Times packed encoding per byte of secret, each share row of FFT_SIZE bytes carrying l of them
+static void packed_sweep(struct pool* pool, unsigned threads) {
+	uint8_t x[PACKED_N];
+	uint8_t* shares[PACKED_N];
+	struct split_args args = { pool, PACKED_N, PACKED_K, FFT_SIZE, x, malloc(16 * FFT_SIZE), malloc((PACKED_K - 1) * FFT_SIZE) };
+	CHECKSTATE(args.secret && args.random);
+	for (uint8_t i = 0; i < args.n; i++) {
+		x[i] = i + 1;
+		shares[i] = malloc(FFT_SIZE);
+		CHECKSTATE(shares[i]);
+	}
+	args.shares = shares;
+	for (size_t i = 0; i < 16 * FFT_SIZE; i++)
+		args.secret[i] = i * 7 + 3;
+	for (size_t i = 0; i < (PACKED_K - 1) * FFT_SIZE; i++)
+		args.random[i] = i * 13 + 5;
+
+	printf("  \"packed\": [\n");
+	for (size_t c = 0; c < ARRAY_SIZE(packed_l); c++) {
+		args.encoder = packedEncoderCreate(x, args.n, args.k, packed_l[c]);
+		CHECKSTATE(args.encoder);
+		const double seconds = time_calls(encode_buffer, &args);
+		encoderFree(args.encoder);
+		printf("    {\"n\": %u, \"k\": %u, \"l\": %u, \"threads\": %u, \"secret_mb_per_s\": %.1f}%s\n",
+				args.n, args.k, packed_l[c], threads, packed_l[c] * args.length / seconds / 1e6, c == ARRAY_SIZE(packed_l) - 1 ? "" : ",");
+	}
+	printf("  ],\n");
+
+	for (uint8_t i = 0; i < args.n; i++)
+		free(shares[i]);
+	free(args.secret);
+	free(args.random);
+}
+
+int main(int argc, char* argv[]) {
+	unsigned threads = argc > 1 ? atoi(argv[1]) : 1;
+	if (argc > 2 || threads == 0) {
+		fprintf(stderr, "Usage: %s [threads]\n", argv[0]);
+		return 1;
+	}
+	struct pool* pool = (void*)0;
+	if (threads > 1) {
+		pool = poolCreate(threads);
+		CHECKSTATE(pool);
+	}
+
+	for (size_t i = 0; i < BUFFER_SIZE; i++)
+		src[i] = i * 7 + 3;
+
+	printf("{\n");
+	printf("  \"field\": [\n");
+	print_field_op("field_mul", "table", time_calls(mul_table_all, NULL) / (P * P), 0);
+	print_field_op("field_mul", "ct", time_calls(mul_ct_all, NULL) / (P * P), 0);
+	print_field_op("field_invert", "table", time_calls(invert_table_all, NULL) / (P - 1), 0);
+	print_field_op("field_invert", "ct", time_calls(invert_ct_all, NULL) / (P - 1), 0);
+	print_field_op("field_pow", "table", time_calls(pow_table_all, NULL) / (P - 1), 0);
+	print_field_op("field_pow", "ct", time_calls(pow_ct_all, NULL) / (P - 1), 1);
+	printf("  ],\n");
+
+	printf("  \"mul_add_buf\": [\n");
+	enum field_kernel best_kernel = field_kernel_selected();
+	int first = 1;
+	for (enum field_kernel kernel = 0; kernel < FIELD_KERNEL_COUNT; kernel++) {
+		if (!field_kernel_supported(kernel))
+			continue;
+#ifdef FIELD_CONSTANT_TIME
+		if (!field_kernel_constant_time(kernel))
+			continue;
+#endif
+		field_kernel_select(kernel);
+		printf("%s    {\"kernel\": \"%s\", \"constant_time\": %s, \"mb_per_s\": %.1f}", first ? "" : ",\n",
+				field_kernel_name(kernel), field_kernel_constant_time(kernel) ? "true" : "false",
+				BUFFER_SIZE / time_calls(mul_add_buffer, NULL) / 1e6);
+		first = 0;
+	}
+	field_kernel_select(best_kernel);
+	printf("\n  ],\n");
+	printf("  \"kernel\": \"%s\",\n", field_kernel_name(best_kernel));
+
+	sweep(pool, threads, SWEEP_SPLIT);
+	sweep(pool, threads, SWEEP_ENCODE);
+	sweep(pool, threads, SWEEP_COMBINE);
+	fft_sweep(pool, threads);
+	packed_sweep(pool, threads);
+
+	printf("  \"vss_verify\": [\n");
+	for (size_t c = 0; c < ARRAY_SIZE(vss_counts); c++) {
+		uint8_t x[P - 1], coefficients[VSS_K][VSS_SCALAR_SIZE], commitments[VSS_K][VSS_POINT_SIZE], shares[P - 1][VSS_SCALAR_SIZE], wide[64];
+		struct vss_args args = { vss_counts[c], commitments, x, shares };
+		for (uint8_t i = 0; i < VSS_K; i++) {
+			for (uint8_t j = 0; j < 64; j++)
+				wide[j] = i * 64 + j * 7 + 3;
+			vssScalarFromRandom(coefficients[i], wide);
+		}
+		for (uint8_t i = 0; i < args.count; i++)
+			x[i] = i + 1;
+		vssSplit(shares, commitments, x, args.count, (const uint8_t (*)[VSS_SCALAR_SIZE])coefficients, VSS_K);
+		printf("    {\"k\": %u, \"shares\": %u, \"each_shares_per_s\": %.1f, \"batch_shares_per_s\": %.1f}%s\n",
+				VSS_K, args.count, args.count / time_calls(vss_verify_each, &args), args.count / time_calls(vss_verify_batch, &args),
+				c == ARRAY_SIZE(vss_counts) - 1 ? "" : ",");
+	}
+	printf("  ],\n");
+
+	printf("  \"audit\": [\n");
+	for (size_t c = 0; c < ARRAY_SIZE(audit_counts); c++) {
+		struct audit_args args = { pool, audit_counts[c].n, audit_counts[c].k };
+		uint8_t x[args.n];
+		for (uint8_t i = 0; i < args.n; i++)
+			x[i] = 1 + (i * 7) % 255;
+		args.x = x;
+		double seconds = time_calls(audit, &args);
+		printf("    {\"n\": %u, \"k\": %u, \"threads\": %u, \"subsets\": %lu, \"subsets_per_s\": %.0f}%s\n",
+				args.n, args.k, threads, args.subsets, args.subsets / seconds, c == ARRAY_SIZE(audit_counts) - 1 ? "" : ",");
+	}
+	printf("  ]\n");
+	printf("}\n");
+
+	if (pool)
+		poolFree(pool);
+	return 0;
+}
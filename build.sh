@@ -1,6 +1,22 @@
 #!/bin/sh
-$CC $CFLAGS -Wall -Werror -O2 -std=c99 shamirssecret.c -DTEST -o shamirssecret && ./shamirssecret &&
+$CC $CFLAGS -Wall -Werror -O2 -std=c99 shamirssecret.c field.c pool.c audit.c random.c erasure.c chacha20.c share.c ed25519.c wide.c fft.c -pthread -DTEST -o shamirssecret && ./shamirssecret &&
+$CC $CFLAGS -Wall -Werror -O2 -std=c99 shamirssecret.c field.c pool.c audit.c random.c erasure.c chacha20.c share.c ed25519.c wide.c fft.c -pthread -DTEST -DFIELD_CONSTANT_TIME -o shamirssecret && ./shamirssecret &&
 $CC $CFLAGS -Wall -Werror -O2 -c shamirssecret.c -o shamirssecret.o &&
-$CC $CFLAGS -Wall -Werror -O2 -std=c99 main.c shamirssecret.o -o shamirssecret &&
+$CC $CFLAGS -Wall -Werror -O2 -c field.c -o field.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c pool.c -o pool.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c audit.c -o audit.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c random.c -o random.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c erasure.c -o erasure.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c chacha20.c -o chacha20.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c share.c -o share.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c ed25519.c -o ed25519.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c wide.c -o wide.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c fft.c -o fft.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c server.c -o server.o &&
+$CC $CFLAGS -Wall -Werror -O2 -c secmem.c -o secmem.o &&
+$CC $CFLAGS -Wall -Werror -O2 -std=c99 main.c shamirssecret.o field.o pool.o audit.o random.o erasure.o chacha20.o share.o ed25519.o wide.o fft.o server.o secmem.o -pthread -o shamirssecret &&
+$CC $CFLAGS -Wall -Werror -O2 -std=c99 bench.c shamirssecret.o field.o pool.o audit.o random.o erasure.o chacha20.o ed25519.o wide.o fft.o -pthread -o bench &&
+${CXX:-c++} $CXXFLAGS -Wall -Werror -O2 -std=c++20 shamirssecret_test.cpp shamirssecret.o field.o pool.o audit.o random.o erasure.o chacha20.o ed25519.o wide.o fft.o -pthread -o shamirssecret_test && ./shamirssecret_test &&
+$CC $CFLAGS -Wall -Werror -O2 -std=c99 loadgen.c shamirssecret.o field.o pool.o audit.o random.o erasure.o chacha20.o ed25519.o wide.o fft.o server.o secmem.o -pthread -o loadgen &&
 $CC $CFLAGS -Wall -Werror -O2 -std=c99 pgp-words.c -o pgp-words &&
 echo "Success!"
@@ -0,0 +1,283 @@
+/*
+ * ChaCha20, Poly1305 and their AEAD construction
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chacha20.h"
+#include "field.h"
+
+#define CHECKSTATE(x) assert(x)
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(a, b, c, d) \
+	a += b; d ^= a; d = ROTL32(d, 16); \
+	c += d; b ^= c; b = ROTL32(b, 12); \
+	a += b; d ^= a; d = ROTL32(d, 8); \
+	c += d; b ^= c; b = ROTL32(b, 7);
+
+static uint32_t load32_le(const uint8_t p[4]) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store32_le(uint8_t p[4], uint32_t v) {
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+void chacha20_block(uint8_t out[CHACHA20_BLOCK_SIZE], const uint32_t key[8], uint64_t counter, uint64_t nonce) {
+	uint32_t input[16] = {
+		0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+		key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+		counter, counter >> 32, nonce, nonce >> 32
+	};
+	uint32_t x[16];
+	int i;
+	memcpy(x, input, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		QUARTERROUND(x[0], x[4], x[8], x[12])
+		QUARTERROUND(x[1], x[5], x[9], x[13])
+		QUARTERROUND(x[2], x[6], x[10], x[14])
+		QUARTERROUND(x[3], x[7], x[11], x[15])
+		QUARTERROUND(x[0], x[5], x[10], x[15])
+		QUARTERROUND(x[1], x[6], x[11], x[12])
+		QUARTERROUND(x[2], x[7], x[8], x[13])
+		QUARTERROUND(x[3], x[4], x[9], x[14])
+	}
+	for (i = 0; i < 16; i++)
+		store32_le(&out[4 * i], x[i] + input[i]);
+	memset(x, 0, sizeof(x));
+}
+
+void chacha20_key(uint32_t key[8], const uint8_t bytes[CHACHA20_KEY_SIZE]) {
+	int i;
+	for (i = 0; i < 8; i++)
+		key[i] = load32_le(&bytes[4 * i]);
+}
+
+/*
+ * Poly1305 with h and r in five 26-bit limbs, so that every product fits in 64 bits
+ */
+void poly1305_init(struct poly1305* poly, const uint8_t key[POLY1305_KEY_SIZE]) {
+	// Clamp r
+	poly->r[0] = load32_le(&key[0]) & 0x3ffffff;
+	poly->r[1] = (load32_le(&key[3]) >> 2) & 0x3ffff03;
+	poly->r[2] = (load32_le(&key[6]) >> 4) & 0x3ffc0ff;
+	poly->r[3] = (load32_le(&key[9]) >> 6) & 0x3f03fff;
+	poly->r[4] = (load32_le(&key[12]) >> 8) & 0x00fffff;
+	poly->pad[0] = load32_le(&key[16]);
+	poly->pad[1] = load32_le(&key[20]);
+	poly->pad[2] = load32_le(&key[24]);
+	poly->pad[3] = load32_le(&key[28]);
+	memset(poly->h, 0, sizeof(poly->h));
+	poly->buffered = 0;
+}
+
+// h = (h + block) * r for every 16-byte block, hibit being 2^128 (in the top limb) for all but a final partial block
+static void poly1305_blocks(struct poly1305* poly, const uint8_t data[], size_t length, uint32_t hibit) {
+	const uint32_t r0 = poly->r[0], r1 = poly->r[1], r2 = poly->r[2], r3 = poly->r[3], r4 = poly->r[4];
+	const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32_t h0 = poly->h[0], h1 = poly->h[1], h2 = poly->h[2], h3 = poly->h[3], h4 = poly->h[4];
+	for (; length >= 16; length -= 16, data += 16) {
+		h0 += load32_le(&data[0]) & 0x3ffffff;
+		h1 += (load32_le(&data[3]) >> 2) & 0x3ffffff;
+		h2 += (load32_le(&data[6]) >> 4) & 0x3ffffff;
+		h3 += (load32_le(&data[9]) >> 6) & 0x3ffffff;
+		h4 += (load32_le(&data[12]) >> 8) | hibit;
+
+		uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+		uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+		uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+		uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+		uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+		d1 += d0 >> 26; h0 = d0 & 0x3ffffff;
+		d2 += d1 >> 26; h1 = d1 & 0x3ffffff;
+		d3 += d2 >> 26; h2 = d2 & 0x3ffffff;
+		d4 += d3 >> 26; h3 = d3 & 0x3ffffff;
+		h0 += (uint32_t)(d4 >> 26) * 5; h4 = d4 & 0x3ffffff;
+		h1 += h0 >> 26; h0 &= 0x3ffffff;
+	}
+	poly->h[0] = h0; poly->h[1] = h1; poly->h[2] = h2; poly->h[3] = h3; poly->h[4] = h4;
+}
+
+void poly1305_update(struct poly1305* poly, const uint8_t data[], size_t length) {
+	if (poly->buffered) {
+		size_t take = 16 - poly->buffered < length ? 16 - poly->buffered : length;
+		memcpy(&poly->buffer[poly->buffered], data, take);
+		poly->buffered += take;
+		data += take;
+		length -= take;
+		if (poly->buffered < 16)
+			return;
+		poly1305_blocks(poly, poly->buffer, 16, 1 << 24);
+		poly->buffered = 0;
+	}
+	poly1305_blocks(poly, data, length & ~(size_t)15, 1 << 24);
+	data += length & ~(size_t)15;
+	length &= 15;
+	memcpy(poly->buffer, data, length);
+	poly->buffered = length;
+}
+
+void poly1305_finish(struct poly1305* poly, uint8_t tag[POLY1305_TAG_SIZE]) {
+	uint32_t h0, h1, h2, h3, h4, g0, g1, g2, g3, g4, mask;
+	uint64_t f;
+	if (poly->buffered) {
+		poly->buffer[poly->buffered] = 1;
+		memset(&poly->buffer[poly->buffered + 1], 0, 16 - poly->buffered - 1);
+		poly1305_blocks(poly, poly->buffer, 16, 0);
+	}
+
+	// Fully carry h
+	h0 = poly->h[0]; h1 = poly->h[1]; h2 = poly->h[2]; h3 = poly->h[3]; h4 = poly->h[4];
+	h2 += h1 >> 26; h1 &= 0x3ffffff;
+	h3 += h2 >> 26; h2 &= 0x3ffffff;
+	h4 += h3 >> 26; h3 &= 0x3ffffff;
+	h0 += (h4 >> 26) * 5; h4 &= 0x3ffffff;
+	h1 += h0 >> 26; h0 &= 0x3ffffff;
+
+	// Select h - p if h >= p = 2^130 - 5, without branching
+	g0 = h0 + 5; g1 = h1 + (g0 >> 26); g0 &= 0x3ffffff;
+	g2 = h2 + (g1 >> 26); g1 &= 0x3ffffff;
+	g3 = h3 + (g2 >> 26); g2 &= 0x3ffffff;
+	g4 = h4 + (g3 >> 26) - (1 << 26); g3 &= 0x3ffffff;
+	mask = (g4 >> 31) - 1; // all ones if g4 did not underflow, ie h >= p
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+	h3 = (h3 & ~mask) | (g3 & mask);
+	h4 = (h4 & ~mask) | (g4 & mask);
+
+	// tag = (h + pad) mod 2^128
+	h0 = h0 | (h1 << 26);
+	h1 = (h1 >> 6) | (h2 << 20);
+	h2 = (h2 >> 12) | (h3 << 14);
+	h3 = (h3 >> 18) | (h4 << 8);
+	f = (uint64_t)h0 + poly->pad[0]; store32_le(&tag[0], f);
+	f = (uint64_t)h1 + poly->pad[1] + (f >> 32); store32_le(&tag[4], f);
+	f = (uint64_t)h2 + poly->pad[2] + (f >> 32); store32_le(&tag[8], f);
+	f = (uint64_t)h3 + poly->pad[3] + (f >> 32); store32_le(&tag[12], f);
+
+	memset(poly, 0, sizeof(struct poly1305));
+}
+
+/*
+ * RFC 8439 ChaCha20-Poly1305, where every key encrypts exactly one message so
+ * the nonce is always zero, and there is never any associated data
+ */
+struct aead {
+	uint32_t key[8];
+	uint64_t counter, length;
+	int partial; // whether the last call ended part way through a block
+	struct poly1305 poly;
+};
+
+/**
+ * Starts encrypting or decrypting a message under key
+ * Returns NULL if memory could not be allocated
+ */
+struct aead* aeadCreate(const uint8_t key[AEAD_KEY_SIZE]) {
+	uint8_t block[CHACHA20_BLOCK_SIZE];
+	struct aead* aead = SECRET_ALLOC(sizeof(struct aead));
+	if (!aead)
+		return aead;
+	chacha20_key(aead->key, key);
+	chacha20_block(block, aead->key, 0, 0);
+	poly1305_init(&aead->poly, block);
+	memset(block, 0, sizeof(block));
+	aead->counter = 1;
+	aead->length = 0;
+	aead->partial = 0;
+	return aead;
+}
+
+static void aead_xor(struct aead* aead, uint8_t buf[], size_t length) {
+	uint8_t block[CHACHA20_BLOCK_SIZE];
+	size_t i;
+	CHECKSTATE(!aead->partial);
+	// The counter is only 32 bits in RFC 8439, limiting messages to 256 GiB
+	CHECKSTATE((aead->length + length + CHACHA20_BLOCK_SIZE - 1) / CHACHA20_BLOCK_SIZE < ((uint64_t)1 << 32));
+	aead->length += length;
+	while (length) {
+		size_t count = length < CHACHA20_BLOCK_SIZE ? length : CHACHA20_BLOCK_SIZE;
+		chacha20_block(block, aead->key, aead->counter++, 0);
+		for (i = 0; i < count; i++)
+			buf[i] ^= block[i];
+		buf += count;
+		length -= count;
+		aead->partial = count < CHACHA20_BLOCK_SIZE;
+	}
+	memset(block, 0, sizeof(block));
+}
+
+/**
+ * Encrypts length bytes in place, continuing the message from the last call
+ * Every call but the last must be a multiple of 64 bytes long
+ */
+void aeadEncrypt(struct aead* aead, uint8_t buf[], size_t length) {
+	aead_xor(aead, buf, length);
+	poly1305_update(&aead->poly, buf, length);
+}
+
+/**
+ * Decrypts length bytes in place, continuing the message from the last call
+ * Every call but the last must be a multiple of 64 bytes long, and nothing decrypted
+ * may be trusted until aeadVerify has succeeded
+ */
+void aeadDecrypt(struct aead* aead, uint8_t buf[], size_t length) {
+	poly1305_update(&aead->poly, buf, length);
+	aead_xor(aead, buf, length);
+}
+
+static void aead_tag(struct aead* aead, uint8_t tag[AEAD_TAG_SIZE]) {
+	static const uint8_t zeros[16];
+	uint8_t lengths[16] = { 0 };
+	int i;
+	poly1305_update(&aead->poly, zeros, (16 - aead->length % 16) % 16);
+	for (i = 0; i < 8; i++)
+		lengths[8 + i] = aead->length >> (8 * i); // 0 bytes of associated data, then the ciphertext length
+	poly1305_update(&aead->poly, lengths, sizeof(lengths));
+	poly1305_finish(&aead->poly, tag);
+	SECRET_FREE(aead, sizeof(struct aead));
+}
+
+/**
+ * Calculates the tag over the whole message and frees the aead
+ */
+void aeadFinish(struct aead* aead, uint8_t tag[AEAD_TAG_SIZE]) {
+	aead_tag(aead, tag);
+}
+
+/**
+ * Checks the message decrypted so far against tag (in constant time) and frees the aead
+ * Returns 1 if the message is authentic, 0 otherwise
+ */
+int aeadVerify(struct aead* aead, const uint8_t tag[AEAD_TAG_SIZE]) {
+	uint8_t expected[AEAD_TAG_SIZE], difference = 0;
+	int i;
+	aead_tag(aead, expected);
+	for (i = 0; i < AEAD_TAG_SIZE; i++)
+		difference |= expected[i] ^ tag[i];
+	memset(expected, 0, sizeof(expected));
+	return difference == 0;
+}
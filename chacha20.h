@@ -0,0 +1,53 @@
+/*
+ * ChaCha20, Poly1305 and their AEAD construction
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHACHA20_KEY_SIZE 32
+#define CHACHA20_BLOCK_SIZE 64
+#define POLY1305_KEY_SIZE 32
+#define POLY1305_TAG_SIZE 16
+
+/**
+ * Calculates the ChaCha20 block with the given counter (words 12 and 13) and nonce (words 14 and 15)
+ * With counter < 2^32 this is the RFC 8439 block with the 96-bit nonce 0, nonce
+ */
+void chacha20_block(uint8_t out[CHACHA20_BLOCK_SIZE], const uint32_t key[8], uint64_t counter, uint64_t nonce);
+
+void chacha20_key(uint32_t key[8], const uint8_t bytes[CHACHA20_KEY_SIZE]);
+
+struct poly1305 {
+	uint32_t r[5], h[5], pad[4];
+	uint8_t buffer[16];
+	size_t buffered;
+};
+
+void poly1305_init(struct poly1305* poly, const uint8_t key[POLY1305_KEY_SIZE]);
+void poly1305_update(struct poly1305* poly, const uint8_t data[], size_t length);
+// Writes the tag and wipes the state
+void poly1305_finish(struct poly1305* poly, uint8_t tag[POLY1305_TAG_SIZE]);
+
+#endif // CHACHA20_H
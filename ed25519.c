@@ -0,0 +1,563 @@
+/*
+ * The ed25519 group (after TweetNaCl) and Feldman verifiable secret sharing over it
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ed25519.h"
+#include "chacha20.h"
+#include "shamirssecret.h"
+
+#define CHECKSTATE(x) assert(x)
+
+/*
+ * Arithmetic modulo 2^255 - 19, in 16 signed 64-bit limbs of 16 bits each
+ */
+static const gf25519 gf0 = { 0 }, gf1 = { 1 },
+	D = { 0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203 },
+	D2 = { 0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406 },
+	BX = { 0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169 },
+	BY = { 0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666 },
+	SQRTM1 = { 0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83 };
+
+static void gf_copy(gf25519 out, const gf25519 a) {
+	memcpy(out, a, sizeof(gf25519));
+}
+
+static void gf_carry(gf25519 o) {
+	int i;
+	for (i = 0; i < 16; i++) {
+		o[i] += 1 << 16;
+		int64_t c = o[i] >> 16;
+		o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+		o[i] -= c * (1 << 16);
+	}
+}
+
+// Swaps p and q if b is 1, in constant time
+static void gf_swap(gf25519 p, gf25519 q, int b) {
+	int64_t c = ~(b - 1);
+	int i;
+	for (i = 0; i < 16; i++) {
+		int64_t t = c & (p[i] ^ q[i]);
+		p[i] ^= t;
+		q[i] ^= t;
+	}
+}
+
+static void gf_pack(uint8_t o[32], const gf25519 n) {
+	gf25519 m, t;
+	int i, j;
+	gf_copy(t, n);
+	gf_carry(t);
+	gf_carry(t);
+	gf_carry(t);
+	for (j = 0; j < 2; j++) {
+		m[0] = t[0] - 0xffed;
+		for (i = 1; i < 15; i++) {
+			m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+			m[i - 1] &= 0xffff;
+		}
+		m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+		int b = (m[15] >> 16) & 1;
+		m[14] &= 0xffff;
+		gf_swap(t, m, 1 - b);
+	}
+	for (i = 0; i < 16; i++) {
+		o[2 * i] = t[i] & 0xff;
+		o[2 * i + 1] = t[i] >> 8;
+	}
+}
+
+static void gf_unpack(gf25519 o, const uint8_t n[32]) {
+	int i;
+	for (i = 0; i < 16; i++)
+		o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+	o[15] &= 0x7fff;
+}
+
+static int gf_equal(const gf25519 a, const gf25519 b) {
+	uint8_t c[32], d[32];
+	gf_pack(c, a);
+	gf_pack(d, b);
+	return memcmp(c, d, 32) == 0;
+}
+
+static int gf_parity(const gf25519 a) {
+	uint8_t d[32];
+	gf_pack(d, a);
+	return d[0] & 1;
+}
+
+static void gf_add(gf25519 o, const gf25519 a, const gf25519 b) {
+	int i;
+	for (i = 0; i < 16; i++)
+		o[i] = a[i] + b[i];
+}
+
+static void gf_sub(gf25519 o, const gf25519 a, const gf25519 b) {
+	int i;
+	for (i = 0; i < 16; i++)
+		o[i] = a[i] - b[i];
+}
+
+static void gf_mul(gf25519 o, const gf25519 a, const gf25519 b) {
+	int64_t t[31] = { 0 };
+	int i, j;
+	for (i = 0; i < 16; i++)
+		for (j = 0; j < 16; j++)
+			t[i + j] += a[i] * b[j];
+	for (i = 0; i < 15; i++)
+		t[i] += 38 * t[i + 16];
+	memcpy(o, t, sizeof(gf25519));
+	gf_carry(o);
+	gf_carry(o);
+}
+
+static void gf_square(gf25519 o, const gf25519 a) {
+	gf_mul(o, a, a);
+}
+
+static void gf_invert(gf25519 o, const gf25519 i) {
+	gf25519 c;
+	int a;
+	gf_copy(c, i);
+	for (a = 253; a >= 0; a--) {
+		gf_square(c, c);
+		if (a != 2 && a != 4)
+			gf_mul(c, c, i);
+	}
+	gf_copy(o, c);
+}
+
+// o = i^((p - 5) / 8)
+static void gf_pow2523(gf25519 o, const gf25519 i) {
+	gf25519 c;
+	int a;
+	gf_copy(c, i);
+	for (a = 250; a >= 0; a--) {
+		gf_square(c, c);
+		if (a != 1)
+			gf_mul(c, c, i);
+	}
+	gf_copy(o, c);
+}
+
+/*
+ * The group
+ */
+void ge25519_identity(struct ge25519* p) {
+	gf_copy(p->x, gf0);
+	gf_copy(p->y, gf1);
+	gf_copy(p->z, gf1);
+	gf_copy(p->t, gf0);
+}
+
+static void ge_base(struct ge25519* p) {
+	gf_copy(p->x, BX);
+	gf_copy(p->y, BY);
+	gf_copy(p->z, gf1);
+	gf_mul(p->t, BX, BY);
+}
+
+static void ge_neg(struct ge25519* p) {
+	gf_sub(p->x, gf0, p->x);
+	gf_sub(p->t, gf0, p->t);
+}
+
+void ge25519_add(struct ge25519* p, const struct ge25519* q) {
+	gf25519 a, b, c, d, t, e, f, g, h;
+	gf_sub(a, p->y, p->x);
+	gf_sub(t, q->y, q->x);
+	gf_mul(a, a, t);
+	gf_add(b, p->x, p->y);
+	gf_add(t, q->x, q->y);
+	gf_mul(b, b, t);
+	gf_mul(c, p->t, q->t);
+	gf_mul(c, c, D2);
+	gf_mul(d, p->z, q->z);
+	gf_add(d, d, d);
+	gf_sub(e, b, a);
+	gf_sub(f, d, c);
+	gf_add(g, d, c);
+	gf_add(h, b, a);
+	gf_mul(p->x, e, f);
+	gf_mul(p->y, h, g);
+	gf_mul(p->z, g, f);
+	gf_mul(p->t, e, h);
+}
+
+static void ge_swap(struct ge25519* p, struct ge25519* q, int b) {
+	gf_swap(p->x, q->x, b);
+	gf_swap(p->y, q->y, b);
+	gf_swap(p->z, q->z, b);
+	gf_swap(p->t, q->t, b);
+}
+
+void ge25519_scalarmult_base(struct ge25519* out, const uint8_t s[SC25519_SIZE]) {
+	struct ge25519 q;
+	int i;
+	ge_base(&q);
+	ge25519_identity(out);
+	for (i = 255; i >= 0; i--) {
+		int b = (s[i / 8] >> (i & 7)) & 1;
+		ge_swap(out, &q, b);
+		ge25519_add(&q, out);
+		ge25519_add(out, out);
+		ge_swap(out, &q, b);
+	}
+	memset(&q, 0, sizeof(q));
+}
+
+void ge25519_pack(uint8_t out[GE25519_SIZE], const struct ge25519* p) {
+	gf25519 zi, tx, ty;
+	gf_invert(zi, p->z);
+	gf_mul(tx, p->x, zi);
+	gf_mul(ty, p->y, zi);
+	gf_pack(out, ty);
+	out[31] ^= gf_parity(tx) << 7;
+}
+
+int ge25519_unpack(struct ge25519* out, const uint8_t in[GE25519_SIZE]) {
+	gf25519 t, chk, num, den, den2, den4, den6;
+	uint8_t check[32];
+	gf_copy(out->z, gf1);
+	gf_unpack(out->y, in);
+	// y must be reduced, so that every point has one encoding
+	gf_pack(check, out->y);
+	check[31] |= in[31] & 0x80;
+	if (memcmp(check, in, 32) != 0)
+		return 0;
+
+	// x^2 = (y^2 - 1) / (d y^2 + 1)
+	gf_square(num, out->y);
+	gf_mul(den, num, D);
+	gf_sub(num, num, out->z);
+	gf_add(den, out->z, den);
+
+	gf_square(den2, den);
+	gf_square(den4, den2);
+	gf_mul(den6, den4, den2);
+	gf_mul(t, den6, num);
+	gf_mul(t, t, den);
+
+	gf_pow2523(t, t);
+	gf_mul(t, t, num);
+	gf_mul(t, t, den);
+	gf_mul(t, t, den);
+	gf_mul(out->x, t, den);
+
+	gf_square(chk, out->x);
+	gf_mul(chk, chk, den);
+	if (!gf_equal(chk, num))
+		gf_mul(out->x, out->x, SQRTM1);
+
+	gf_square(chk, out->x);
+	gf_mul(chk, chk, den);
+	if (!gf_equal(chk, num))
+		return 0;
+
+	// The sign bit picks between x and -x, and x = 0 has no negative
+	if (gf_parity(out->x) != (in[31] >> 7)) {
+		if (gf_equal(out->x, gf0))
+			return 0;
+		gf_sub(out->x, gf0, out->x);
+	}
+	gf_mul(out->t, out->x, out->y);
+	return 1;
+}
+
+int ge25519_multiexp(struct ge25519* out, const struct ge25519 points[], const uint8_t scalars[][SC25519_SIZE], size_t count) {
+	// table[16 * i + m] = m * points[i]
+	struct ge25519* table = malloc(16 * count * sizeof(struct ge25519) + 1);
+	size_t i;
+	int w, m;
+	if (!table)
+		return 0;
+	for (i = 0; i < count; i++) {
+		ge25519_identity(&table[16 * i]);
+		for (m = 1; m < 16; m++) {
+			table[16 * i + m] = table[16 * i + m - 1];
+			ge25519_add(&table[16 * i + m], &points[i]);
+		}
+	}
+
+	ge25519_identity(out);
+	for (w = 63; w >= 0; w--) {
+		for (m = 0; m < 4; m++)
+			ge25519_add(out, out);
+		for (i = 0; i < count; i++) {
+			const int window = (scalars[i][w / 2] >> (4 * (w & 1))) & 0xf;
+			if (window)
+				ge25519_add(out, &table[16 * i + window]);
+		}
+	}
+	free(table);
+	return 1;
+}
+
+int ge25519_is_small_order(const struct ge25519* p) {
+	struct ge25519 q = *p;
+	int i;
+	for (i = 0; i < 3; i++)
+		ge25519_add(&q, &q);
+	// The identity is the only point with x = 0 and y = z
+	return gf_equal(q.x, gf0) && gf_equal(q.y, q.z);
+}
+
+/*
+ * Arithmetic modulo l, in 64 signed limbs of 8 bits each as TweetNaCl does it
+ */
+static const int64_t L[32] = {
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+static void sc_reduce_limbs(uint8_t r[SC25519_SIZE], int64_t x[64]) {
+	int64_t carry;
+	int i, j;
+	for (i = 63; i >= 32; i--) {
+		carry = 0;
+		for (j = i - 32; j < i - 12; j++) {
+			x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+	carry = 0;
+	for (j = 0; j < 32; j++) {
+		x[j] += carry - (x[31] >> 4) * L[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for (j = 0; j < 32; j++)
+		x[j] -= carry * L[j];
+	for (i = 0; i < 32; i++) {
+		x[i + 1] += x[i] >> 8;
+		r[i] = x[i] & 255;
+	}
+}
+
+void sc25519_reduce(uint8_t out[SC25519_SIZE], const uint8_t in[64]) {
+	int64_t x[64];
+	int i;
+	for (i = 0; i < 64; i++)
+		x[i] = in[i];
+	sc_reduce_limbs(out, x);
+}
+
+void sc25519_add(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], const uint8_t b[SC25519_SIZE]) {
+	int64_t x[64] = { 0 };
+	int i;
+	for (i = 0; i < 32; i++)
+		x[i] = (int64_t)a[i] + b[i];
+	sc_reduce_limbs(out, x);
+}
+
+void sc25519_mul(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], const uint8_t b[SC25519_SIZE]) {
+	int64_t x[64] = { 0 };
+	int i, j;
+	for (i = 0; i < 32; i++)
+		for (j = 0; j < 32; j++)
+			x[i + j] += (int64_t)a[i] * b[j];
+	sc_reduce_limbs(out, x);
+}
+
+void sc25519_mul_small(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], uint8_t b) {
+	int64_t x[64] = { 0 };
+	int i;
+	for (i = 0; i < 32; i++)
+		x[i] = (int64_t)a[i] * b;
+	sc_reduce_limbs(out, x);
+}
+
+// l - 1 and l - 2 (little endian)
+static const uint8_t l_minus_1[SC25519_SIZE] = {
+	0xec, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+static const uint8_t l_minus_2[SC25519_SIZE] = {
+	0xeb, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+void sc25519_neg(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE]) {
+	sc25519_mul(out, a, l_minus_1);
+}
+
+void sc25519_invert(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE]) {
+	// a^(l - 2), which only depends on a through the multiplies, so is constant time
+	uint8_t c[SC25519_SIZE] = { 1 };
+	int i;
+	for (i = 252; i >= 0; i--) {
+		sc25519_mul(c, c, c);
+		if ((l_minus_2[i / 8] >> (i & 7)) & 1)
+			sc25519_mul(c, c, a);
+	}
+	memcpy(out, c, SC25519_SIZE);
+}
+
+int sc25519_is_canonical(const uint8_t s[SC25519_SIZE]) {
+	int i;
+	for (i = 31; i >= 0; i--) {
+		if (s[i] != L[i])
+			return s[i] < L[i];
+	}
+	return 0;
+}
+
+/*
+ * Feldman VSS
+ */
+void vssScalarFromRandom(uint8_t scalar[VSS_SCALAR_SIZE], const uint8_t random[64]) {
+	sc25519_reduce(scalar, random);
+}
+
+void vssSplit(uint8_t shares[][VSS_SCALAR_SIZE], uint8_t commitments[][VSS_POINT_SIZE], const uint8_t x[], uint8_t total_shares,
+		const uint8_t coefficients[][VSS_SCALAR_SIZE], uint8_t shares_required) {
+	uint8_t i, j;
+	for (j = 0; j < shares_required; j++) {
+		struct ge25519 commitment;
+		CHECKSTATE(sc25519_is_canonical(coefficients[j]));
+		ge25519_scalarmult_base(&commitment, coefficients[j]);
+		ge25519_pack(commitments[j], &commitment);
+	}
+	// Horner's rule, with every multiply by a one-byte x
+	for (i = 0; i < total_shares; i++) {
+		CHECKSTATE(x[i] != 0);
+		memcpy(shares[i], coefficients[shares_required - 1], VSS_SCALAR_SIZE);
+		for (j = shares_required - 1; j > 0; j--) {
+			sc25519_mul_small(shares[i], shares[i], x[i]);
+			sc25519_add(shares[i], shares[i], coefficients[j - 1]);
+		}
+	}
+}
+
+/*
+ * Checks that sum(weights[i] * shares[i]) * base point is sum over j of
+ * (sum(weights[i] * x[i]^j)) * commitments[j] (up to small-order components),
+ * which holds for every share with a nonzero weight if the shares are all valid, and
+ * with random weights fails except with negligible probability if any is not.
+ * The sum of weighted shares is secret, so it is multiplied by the base point in
+ * constant time; everything the multi-exponentiation sees is public.
+ */
+static int vss_check(const uint8_t commitments[][VSS_POINT_SIZE], uint8_t shares_required, const uint8_t x[],
+		const uint8_t shares[][VSS_SCALAR_SIZE], const uint8_t weights[][VSS_SCALAR_SIZE], size_t count) {
+	struct ge25519* points = malloc(shares_required * sizeof(struct ge25519) + 1);
+	uint8_t (*scalars)[SC25519_SIZE] = calloc(shares_required, SC25519_SIZE);
+	uint8_t total[SC25519_SIZE] = { 0 }, power[SC25519_SIZE], product[SC25519_SIZE];
+	struct ge25519 left, right;
+	int valid = points && scalars;
+	size_t i;
+	uint8_t j;
+
+	for (j = 0; valid && j < shares_required; j++)
+		valid = ge25519_unpack(&points[j], commitments[j]);
+	for (i = 0; valid && i < count; i++) {
+		valid = sc25519_is_canonical(shares[i]) && x[i] != 0;
+		sc25519_mul(product, weights[i], shares[i]);
+		sc25519_add(total, total, product);
+		memcpy(power, weights[i], SC25519_SIZE);
+		for (j = 0; j < shares_required; j++) {
+			sc25519_add(scalars[j], scalars[j], power);
+			sc25519_mul_small(power, power, x[i]);
+		}
+	}
+	if (valid)
+		valid = ge25519_multiexp(&right, points, (const uint8_t (*)[SC25519_SIZE])scalars, shares_required);
+	if (valid) {
+		ge25519_scalarmult_base(&left, total);
+		ge_neg(&left);
+		ge25519_add(&right, &left);
+		valid = ge25519_is_small_order(&right);
+	}
+
+	memset(total, 0, sizeof(total));
+	memset(product, 0, sizeof(product));
+	memset(&left, 0, sizeof(left));
+	free(points);
+	free(scalars);
+	return valid;
+}
+
+int vssVerify(const uint8_t commitments[][VSS_POINT_SIZE], uint8_t shares_required, uint8_t x, const uint8_t share[VSS_SCALAR_SIZE]) {
+	const uint8_t weight[1][VSS_SCALAR_SIZE] = { { 1 } };
+	return vss_check(commitments, shares_required, &x, (const uint8_t (*)[VSS_SCALAR_SIZE])share, weight, 1);
+}
+
+int vssVerifyBatch(const uint8_t commitments[][VSS_POINT_SIZE], uint8_t shares_required, const uint8_t x[],
+		const uint8_t shares[][VSS_SCALAR_SIZE], size_t count, const struct random_source* random) {
+	// 128-bit weights are plenty to make passing with a bad share as unlikely as guessing one
+	uint8_t (*weights)[VSS_SCALAR_SIZE] = calloc(count + 1, VSS_SCALAR_SIZE);
+	size_t i;
+	int valid = weights != (void*)0;
+	for (i = 0; valid && i < count; i++)
+		valid = random->read(random->ctx, weights[i], 16);
+	if (valid)
+		valid = vss_check(commitments, shares_required, x, shares, (const uint8_t (*)[VSS_SCALAR_SIZE])weights, count);
+	free(weights);
+	return valid;
+}
+
+void vssCombine(uint8_t secret[VSS_SCALAR_SIZE], const uint8_t x[], const uint8_t shares[][VSS_SCALAR_SIZE], uint8_t shares_required) {
+	uint8_t total[SC25519_SIZE] = { 0 }, weight[SC25519_SIZE], denominator[SC25519_SIZE], term[SC25519_SIZE];
+	uint8_t i, j;
+	for (i = 0; i < shares_required; i++) {
+		// Lagrange weight at 0: the product of x[j] / (x[j] - x[i]) over j != i
+		uint8_t sign = 0;
+		memset(weight, 0, SC25519_SIZE);
+		memset(denominator, 0, SC25519_SIZE);
+		weight[0] = denominator[0] = 1;
+		for (j = 0; j < shares_required; j++) {
+			if (j == i)
+				continue;
+			CHECKSTATE(x[j] != x[i] && x[j] != 0);
+			sc25519_mul_small(weight, weight, x[j]);
+			sc25519_mul_small(denominator, denominator, x[j] > x[i] ? x[j] - x[i] : x[i] - x[j]);
+			sign ^= x[j] < x[i];
+		}
+		sc25519_invert(denominator, denominator);
+		sc25519_mul(weight, weight, denominator);
+		if (sign)
+			sc25519_neg(weight, weight);
+		sc25519_mul(term, weight, shares[i]);
+		sc25519_add(total, total, term);
+	}
+	memcpy(secret, total, VSS_SCALAR_SIZE);
+	memset(total, 0, sizeof(total));
+	memset(term, 0, sizeof(term));
+}
+
+void vssDeriveKey(uint8_t key[AEAD_KEY_SIZE], const uint8_t secret[VSS_SCALAR_SIZE]) {
+	// The first commitment is the secret times the base point, so keep the key one PRF call away from the secret
+	static const uint64_t nonce = 0x79656b20535356; // "VSS key"
+	uint32_t chacha_key[8];
+	uint8_t block[CHACHA20_BLOCK_SIZE];
+	chacha20_key(chacha_key, secret);
+	chacha20_block(block, chacha_key, 0, nonce);
+	memcpy(key, block, AEAD_KEY_SIZE);
+	memset(chacha_key, 0, sizeof(chacha_key));
+	memset(block, 0, sizeof(block));
+}
@@ -0,0 +1,76 @@
+/*
+ * Arithmetic in the ed25519 group and modulo its order
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ED25519_H
+#define ED25519_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Scalars are 32 bytes little endian, modulo the prime order
+ * l = 2^252 + 27742317777372353535851937790883648493 of the base point
+ */
+#define SC25519_SIZE 32
+
+// out = in mod l, for 64 bytes little endian (so 64 random bytes give a uniform scalar)
+void sc25519_reduce(uint8_t out[SC25519_SIZE], const uint8_t in[64]);
+void sc25519_add(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], const uint8_t b[SC25519_SIZE]);
+void sc25519_neg(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE]);
+void sc25519_mul(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], const uint8_t b[SC25519_SIZE]);
+void sc25519_mul_small(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE], uint8_t b);
+// a must not be 0
+void sc25519_invert(uint8_t out[SC25519_SIZE], const uint8_t a[SC25519_SIZE]);
+// Whether s < l, ie s is the only encoding of its value
+int sc25519_is_canonical(const uint8_t s[SC25519_SIZE]);
+
+/*
+ * Points are in extended twisted Edwards coordinates (TweetNaCl-style 16-bit limbs)
+ * and encode to 32 bytes as in RFC 8032
+ */
+#define GE25519_SIZE 32
+
+typedef int64_t gf25519[16];
+struct ge25519 {
+	gf25519 x, y, z, t;
+};
+
+void ge25519_identity(struct ge25519* p);
+// p += q
+void ge25519_add(struct ge25519* p, const struct ge25519* q);
+// out = s * base point, in constant time
+void ge25519_scalarmult_base(struct ge25519* out, const uint8_t s[SC25519_SIZE]);
+void ge25519_pack(uint8_t out[GE25519_SIZE], const struct ge25519* p);
+// Returns 0 if in is not the canonical encoding of a point
+int ge25519_unpack(struct ge25519* out, const uint8_t in[GE25519_SIZE]);
+
+/*
+ * out = sum of scalars[i] * points[i], interleaving all the points over one shared
+ * chain of doublings (Straus, with 4-bit windows)
+ * Variable time, so only for public scalars. Returns 0 if memory could not be allocated.
+ */
+int ge25519_multiexp(struct ge25519* out, const struct ge25519 points[], const uint8_t scalars[][SC25519_SIZE], size_t count);
+
+// Whether 8 * p is the identity, ie p is in the small-order subgroup
+int ge25519_is_small_order(const struct ge25519* p);
+
+#endif // ED25519_H
@@ -0,0 +1,925 @@
+/*
+ * Matrices over the field and matrix-times-buffer encoding
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "erasure.h"
+#ifndef IN_KERNEL
+#include "fft.h"
+#include "pool.h"
+#endif
+
+void matrix_vandermonde(uint8_t matrix[], const uint8_t x[], uint8_t rows, uint8_t cols) {
+	uint8_t i, j;
+	for (i = 0; i < rows; i++) {
+		uint8_t x_pow = 1;
+		for (j = 0; j < cols; j++) {
+			matrix[i * cols + j] = x_pow;
+			x_pow = field_mul(x_pow, x[i]);
+		}
+	}
+}
+
+int matrix_cauchy(uint8_t matrix[], const uint8_t x[], uint8_t rows, const uint8_t y[], uint8_t cols) {
+	uint8_t i, j;
+	for (i = 0; i < rows; i++)
+		for (j = 0; j < i; j++)
+			if (x[i] == x[j])
+				return 0;
+	for (i = 0; i < cols; i++)
+		for (j = 0; j < i; j++)
+			if (y[i] == y[j])
+				return 0;
+	for (i = 0; i < rows; i++) {
+		for (j = 0; j < cols; j++) {
+			if (x[i] == y[j])
+				return 0;
+			matrix[i * cols + j] = field_invert(field_sub(x[i], y[j]));
+		}
+	}
+	return 1;
+}
+
+int matrix_lagrange(uint8_t matrix[], const uint8_t x[], uint8_t rows, const uint8_t points[], uint8_t cols) {
+	uint8_t i, j, m;
+	for (j = 0; j < cols; j++)
+		for (m = 0; m < j; m++)
+			if (points[j] == points[m])
+				return 0;
+	for (i = 0; i < rows; i++) {
+		for (j = 0; j < cols; j++) {
+			uint8_t numerator = 1, denominator = 1;
+			for (m = 0; m < cols; m++) {
+				if (m == j)
+					continue;
+				numerator = field_mul(numerator, field_sub(x[i], points[m]));
+				denominator = field_mul(denominator, field_sub(points[j], points[m]));
+			}
+			matrix[i * cols + j] = field_mul(numerator, field_invert(denominator));
+		}
+	}
+	return 1;
+}
+
+int matrix_invert(uint8_t matrix[], uint8_t size) {
+	// Reduce [matrix | identity] to [identity | inverse]
+	const size_t width = 2 * size;
+	uint8_t* work = SECRET_ALLOC(size * width);
+	size_t i, j, row; // width goes past 255 for size > 127
+	int ret = 0;
+	if (!work)
+		return 0;
+	for (i = 0; i < size; i++) {
+		memcpy(&work[i * width], &matrix[i * size], size);
+		memset(&work[i * width + size], 0, size);
+		work[i * width + size + i] = 1;
+	}
+
+	for (i = 0; i < size; i++) {
+		uint8_t* pivot_row = &work[i * width];
+		for (row = i; row < size && work[row * width + i] == 0; row++) {}
+		if (row == size)
+			goto out;
+		if (row != i) {
+			for (j = 0; j < width; j++) {
+				uint8_t t = pivot_row[j];
+				pivot_row[j] = work[row * width + j];
+				work[row * width + j] = t;
+			}
+		}
+
+		const uint8_t pivot_inverse = field_invert(pivot_row[i]);
+		for (j = 0; j < width; j++)
+			pivot_row[j] = field_mul(pivot_row[j], pivot_inverse);
+		for (row = 0; row < size; row++) {
+			const uint8_t factor = work[row * width + i];
+			if (row == i || factor == 0)
+				continue;
+			for (j = 0; j < width; j++)
+				work[row * width + j] = field_sub(work[row * width + j], field_mul(factor, pivot_row[j]));
+		}
+	}
+
+	for (i = 0; i < size; i++)
+		memcpy(&matrix[i * size], &work[i * width + size], size);
+	ret = 1;
+out:
+	SECRET_FREE(work, size * width);
+	return ret;
+}
+
+void matrix_mul_range(uint8_t* const out[], const uint8_t matrix[], uint8_t rows, const uint8_t* const in[], uint8_t cols, size_t offset, size_t count) {
+	uint8_t i;
+	for (i = 0; i < rows; i++)
+		field_dot_buf(out[i], in, &matrix[i * cols], cols, offset, count);
+}
+
+/*
+ * Shamir's scheme as a matrix: the inputs are the secret followed by the
+ * random coefficient rows, and row i of the matrix holds x[i]^0 .. x[i]^(k-1),
+ * so output i is q(x[i]) for every byte. For large enough total_shares and
+ * shares_required the same outputs come from the additive FFT instead (see fft.h).
+ */
+struct encoder {
+	uint8_t total_shares, shares_required, fft;
+	uint8_t secret_rows; // 1, or for packed sharing the number of secrets (shares_required then counting every column)
+	uint8_t x[P - 1];
+	uint8_t matrix[];
+};
+
+/**
+ * Calculates the encoding matrix for the given total_shares X coordinates
+ * Returns NULL if memory could not be allocated
+ */
+struct encoder* encoderCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required) {
+	uint8_t i;
+	struct encoder* encoder = ALLOC(sizeof(struct encoder) + total_shares * shares_required);
+	if (!encoder)
+		return encoder;
+	for (i = 0; i < total_shares; i++)
+		CHECKSTATE(x[i] != 0); // q(0) == secret
+	encoder->total_shares = total_shares;
+	encoder->shares_required = shares_required;
+	encoder->secret_rows = 1;
+#ifndef IN_KERNEL
+	encoder->fft = fft_encode_cheaper(total_shares, shares_required);
+#else
+	encoder->fft = 0;
+#endif
+	memcpy(encoder->x, x, total_shares);
+	matrix_vandermonde(encoder->matrix, x, total_shares, shares_required);
+	return encoder;
+}
+
+/**
+ * Packed sharing: row i is the Lagrange basis polynomials of the secret points at x[i], then
+ * Z(x[i]) * x[i]^m for the shares_required - 1 random coefficients of R, with Z the product of
+ * (x - secret point) (for one secret, exactly the Vandermonde row)
+ * Returns NULL if memory could not be allocated
+ */
+struct encoder* packedEncoderCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required, uint8_t secret_count) {
+	const unsigned cols = shares_required + secret_count - 1; // checked against P before it is narrowed
+	uint8_t points[secret_count], weights[secret_count];
+	uint8_t i, j;
+	struct encoder* encoder;
+	CHECKSTATE(secret_count > 0 && shares_required > 0 && cols < P);
+	for (i = 0; i < total_shares; i++)
+		CHECKSTATE(!packed_is_secret_x(x[i], secret_count));
+	encoder = ALLOC(sizeof(struct encoder) + total_shares * cols);
+	if (!encoder)
+		return encoder;
+	encoder->total_shares = total_shares;
+	encoder->shares_required = cols;
+	encoder->secret_rows = secret_count;
+	encoder->fft = 0;
+	memcpy(encoder->x, x, total_shares);
+	for (j = 0; j < secret_count; j++)
+		points[j] = packed_secret_x(j);
+	for (i = 0; i < total_shares; i++) {
+		uint8_t* row = &encoder->matrix[i * cols];
+		uint8_t z = 1;
+		if (!matrix_lagrange(weights, &x[i], 1, points, secret_count)) {
+			FREE(encoder);
+			return (void*)0;
+		}
+		memcpy(row, weights, secret_count);
+		for (j = 0; j < secret_count; j++)
+			z = field_mul(z, field_sub(x[i], points[j]));
+		for (j = secret_count; j < cols; j++) {
+			row[j] = z;
+			z = field_mul(z, x[i]);
+		}
+	}
+	return encoder;
+}
+
+static size_t encoder_chunk(const struct encoder* encoder) {
+#ifndef IN_KERNEL
+	if (encoder->fft) // The transform keeps two sets of coefficient rows
+		return chunk_size(encoder->total_shares + encoder->shares_required + (2u << fft_log_size(encoder->shares_required)));
+#endif
+	return chunk_size(encoder->total_shares + encoder->shares_required);
+}
+
+// Uses the matrix when there is no transform scratch (the encoder has no transform, or it could not be allocated)
+static void encoder_range(const struct encoder* encoder, uint8_t scratch[], uint8_t* const shares[], const uint8_t* const in[], size_t offset, size_t count) {
+#ifndef IN_KERNEL
+	if (scratch) {
+		fft_encode_range(shares, encoder->x, encoder->total_shares, in, encoder->shares_required, scratch, offset, count);
+		return;
+	}
+#endif
+	matrix_mul_range(shares, encoder->matrix, encoder->total_shares, in, encoder->shares_required, offset, count);
+}
+
+// encoder_range on the chunks at first, first + stride, ... sharing one scratch allocation
+static void encoder_chunks(const struct encoder* encoder, uint8_t* const shares[], const uint8_t* const in[], size_t length, size_t chunk, size_t first, size_t stride) {
+	size_t scratch_size = 0, offset;
+	uint8_t* scratch;
+	if (first >= length)
+		return;
+#ifndef IN_KERNEL
+	if (encoder->fft)
+		scratch_size = fft_encode_scratch(encoder->shares_required, length < chunk ? length : chunk);
+#endif
+	scratch = scratch_size ? SECRET_ALLOC(scratch_size) : (void*)0;
+	for (offset = first; offset < length; offset += stride)
+		encoder_range(encoder, scratch, shares, in, offset, length - offset < chunk ? length - offset : chunk);
+	if (scratch)
+		SECRET_FREE(scratch, scratch_size);
+}
+
+static void encoder_inputs(const struct encoder* encoder, const uint8_t* in[], const uint8_t secret[], const uint8_t random[], size_t length) {
+	uint8_t j;
+	for (j = 0; j < encoder->secret_rows; j++)
+		in[j] = &secret[j * length];
+	for (; j < encoder->shares_required; j++)
+		in[j] = &random[(j - encoder->secret_rows) * length];
+}
+
+/**
+ * splitBuffer with the X coordinates and shares_required the encoder was created with
+ */
+void encoderBuffer(const struct encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length) {
+	const uint8_t* in[encoder->shares_required];
+	const size_t chunk = encoder_chunk(encoder);
+	encoder_inputs(encoder, in, secret, random, length);
+	encoder_chunks(encoder, shares, in, length, chunk, 0, chunk);
+}
+
+void encoderFree(struct encoder* encoder) {
+	FREE(encoder);
+}
+
+size_t disperseLength(size_t length, uint8_t shares_required) {
+	return (length + shares_required - 1) / shares_required;
+}
+
+/**
+ * Calculates every fragment of data, which must have room for shares_required *
+ * disperseLength(length, shares_required) bytes (the padding is zeroed)
+ */
+void disperseBuffer(const struct encoder* encoder, uint8_t* fragments[], uint8_t data[], size_t length) {
+	const size_t fragment_length = disperseLength(length, encoder->shares_required);
+	memset(&data[length], 0, encoder->shares_required * fragment_length - length);
+	// Row 0 takes the place of the secret and the rest the place of the random rows
+	encoderBuffer(encoder, fragments, data, &data[fragment_length], fragment_length);
+}
+
+struct decoder {
+	uint8_t shares_required, outputs; // outputs == shares_required but for packed sharing
+	struct fft_plan* fft; // NULL if the matrix is cheaper
+	uint8_t matrix[];
+};
+
+/**
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct and nonzero
+ */
+struct decoder* decoderCreate(const uint8_t x[], uint8_t shares_required) {
+	uint8_t i;
+	struct decoder* decoder;
+	for (i = 0; i < shares_required; i++)
+		if (x[i] == 0)
+			return (void*)0;
+	decoder = ALLOC(sizeof(struct decoder) + shares_required * shares_required);
+	if (!decoder)
+		return decoder;
+	decoder->shares_required = shares_required;
+	decoder->outputs = shares_required;
+	decoder->fft = (void*)0;
+	matrix_vandermonde(decoder->matrix, x, shares_required, shares_required);
+	if (!matrix_invert(decoder->matrix, shares_required)) {
+		FREE(decoder);
+		return (void*)0;
+	}
+#ifndef IN_KERNEL
+	if (fft_decode_cheaper(shares_required) && (decoder->fft = ALLOC(sizeof(struct fft_plan)))) {
+		// matrix_invert already found x distinct, but the matrix works either way
+		if (!fft_plan_create(decoder->fft, x, shares_required)) {
+			FREE(decoder->fft);
+			decoder->fft = (void*)0;
+		}
+	}
+#endif
+	return decoder;
+}
+
+/**
+ * Packed sharing: the secrets are the values at the secret points of the polynomial through
+ * shares_required + secret_count - 1 shares, so row j is the Lagrange basis polynomials of
+ * the shares' X coordinates at secret point j
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct
+ */
+struct decoder* packedDecoderCreate(const uint8_t x[], uint8_t shares_required, uint8_t secret_count) {
+	const unsigned cols = shares_required + secret_count - 1; // checked against P before it is narrowed
+	uint8_t points[secret_count];
+	uint8_t j;
+	struct decoder* decoder;
+	CHECKSTATE(secret_count > 0 && shares_required > 0 && cols < P);
+	decoder = ALLOC(sizeof(struct decoder) + secret_count * cols);
+	if (!decoder)
+		return decoder;
+	decoder->shares_required = cols;
+	decoder->outputs = secret_count;
+	decoder->fft = (void*)0;
+	for (j = 0; j < secret_count; j++)
+		points[j] = packed_secret_x(j);
+	if (!matrix_lagrange(decoder->matrix, points, secret_count, x, cols)) {
+		FREE(decoder);
+		return (void*)0;
+	}
+	return decoder;
+}
+
+static size_t decoder_chunk(const struct decoder* decoder) {
+	return chunk_size(decoder->shares_required + decoder->outputs + (decoder->fft ? P : 0));
+}
+
+static void decoder_range(const struct decoder* decoder, uint8_t scratch[], uint8_t* const out[], const uint8_t* const fragments[], size_t offset, size_t count) {
+#ifndef IN_KERNEL
+	if (scratch) {
+		fft_decode_range(out, decoder->shares_required, fragments, decoder->fft, scratch, offset, count);
+		return;
+	}
+#endif
+	matrix_mul_range(out, decoder->matrix, decoder->outputs, fragments, decoder->shares_required, offset, count);
+}
+
+// decoder_range on the chunks at first, first + stride, ... sharing one scratch allocation
+static void decoder_chunks(const struct decoder* decoder, uint8_t* const out[], const uint8_t* const fragments[], size_t length, size_t chunk, size_t first, size_t stride) {
+	size_t scratch_size = 0, offset;
+	uint8_t* scratch;
+	if (first >= length)
+		return;
+#ifndef IN_KERNEL
+	if (decoder->fft)
+		scratch_size = fft_decode_scratch(length < chunk ? length : chunk);
+#endif
+	scratch = scratch_size ? SECRET_ALLOC(scratch_size) : (void*)0;
+	for (offset = first; offset < length; offset += stride)
+		decoder_range(decoder, scratch, out, fragments, offset, length - offset < chunk ? length - offset : chunk);
+	if (scratch)
+		SECRET_FREE(scratch, scratch_size);
+}
+
+static void decoder_outputs(const struct decoder* decoder, uint8_t* out[], uint8_t data[], size_t fragment_length) {
+	uint8_t j;
+	for (j = 0; j < decoder->outputs; j++)
+		out[j] = &data[j * fragment_length];
+}
+
+/**
+ * Rebuilds shares_required * fragment_length bytes of data (or with a packed decoder, secret_count
+ * rows of them) from one fragment per X coordinate
+ */
+void decoderBuffer(const struct decoder* decoder, uint8_t data[], const uint8_t* const fragments[], size_t fragment_length) {
+	uint8_t* out[decoder->outputs];
+	const size_t chunk = decoder_chunk(decoder);
+	decoder_outputs(decoder, out, data, fragment_length);
+	decoder_chunks(decoder, out, fragments, fragment_length, chunk, 0, chunk);
+}
+
+void decoderFree(struct decoder* decoder) {
+	if (decoder->fft)
+		FREE(decoder->fft);
+	FREE(decoder);
+}
+
+// weights[i] = the Lagrange basis polynomial of x[i] at 0, so the secret is the sum of weights[i] * share i
+static void lagrange_at_zero(uint8_t weights[], const uint8_t x[], uint8_t count) {
+	uint8_t i, j;
+	for (i = 0; i < count; i++) {
+		uint8_t numerator = 1, denominator = 1;
+		for (j = 0; j < count; j++) {
+			if (j == i)
+				continue;
+			numerator = field_mul(numerator, x[j]);
+			denominator = field_mul(denominator, field_sub(x[j], x[i]));
+		}
+		weights[i] = field_mul(numerator, field_invert(denominator));
+	}
+}
+
+static void refresh_range(const struct encoder* encoder, uint8_t* const shares[], const uint8_t* const old_shares[],
+		const uint8_t random[], size_t length, size_t offset, size_t count) {
+	const uint8_t* in[encoder->shares_required];
+	uint8_t i;
+	encoder_inputs(encoder, in, (void*)0, random, length);
+	for (i = 0; i < encoder->total_shares; i++) {
+		// Row i is 1, x[i], x[i]^2.., so putting the old share in place of the secret adds it to q(x[i]) - q(0)
+		in[0] = old_shares[i];
+		field_dot_buf(shares[i], in, &encoder->matrix[i * encoder->shares_required], encoder->shares_required, offset, count);
+	}
+}
+
+/**
+ * Proactive refresh: shares[i] = old_shares[i] + q(x[i]) for a random q with q(0) = 0 (its other
+ * coefficients being the rows of random, as in encoderBuffer), so the new shares give the same
+ * secret but cannot be combined with any of the old ones
+ * Needs every share which is to stay usable, as the rest keep the old polynomial
+ */
+void encoderRefresh(const struct encoder* encoder, uint8_t* shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length) {
+	CHECKSTATE(encoder->secret_rows == 1);
+	size_t chunk = chunk_size(2 * encoder->total_shares + encoder->shares_required), offset;
+	for (offset = 0; offset < length; offset += chunk)
+		refresh_range(encoder, shares, old_shares, random, length, offset, length - offset < chunk ? length - offset : chunk);
+}
+
+/*
+ * Re-sharing as a matrix: each old share is split again at the new X coordinates and new share j
+ * is the Lagrange-weighted sum of its pieces. The random parts of those splits only ever appear
+ * summed, so one set of new_shares_required - 1 random rows does for all of them, and row j is
+ *   new_x[j]^1 .. new_x[j]^(new_shares_required - 1), weight 0 .. weight shares_required - 1
+ * over the inputs (random rows, old shares). The random rows come first so that no partial sum
+ * is ever just the secret.
+ */
+struct resharer {
+	uint8_t new_total_shares, random_rows, cols;
+	uint8_t matrix[];
+};
+
+/**
+ * Returns NULL if memory could not be allocated, either set of X coordinates is not distinct and nonzero
+ * or shares_required + new_shares_required - 1 >= P
+ */
+struct resharer* resharerCreate(const uint8_t x[], uint8_t shares_required, const uint8_t new_x[], uint8_t new_total_shares, uint8_t new_shares_required) {
+	const unsigned cols = new_shares_required - 1 + shares_required; // checked against P before it is narrowed
+	uint8_t weights[shares_required];
+	struct resharer* resharer;
+	uint8_t i, j;
+	CHECKSTATE(shares_required > 0 && new_shares_required > 0 && new_total_shares >= new_shares_required);
+	if (cols >= P)
+		return (void*)0;
+	for (i = 0; i < shares_required; i++) {
+		if (x[i] == 0)
+			return (void*)0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return (void*)0;
+	}
+	for (i = 0; i < new_total_shares; i++) {
+		if (new_x[i] == 0)
+			return (void*)0;
+		for (j = 0; j < i; j++)
+			if (new_x[j] == new_x[i])
+				return (void*)0;
+	}
+	resharer = ALLOC(sizeof(struct resharer) + new_total_shares * cols);
+	if (!resharer)
+		return resharer;
+	resharer->new_total_shares = new_total_shares;
+	resharer->random_rows = new_shares_required - 1;
+	resharer->cols = cols;
+	lagrange_at_zero(weights, x, shares_required);
+	for (i = 0; i < new_total_shares; i++) {
+		uint8_t* row = &resharer->matrix[i * cols];
+		uint8_t x_pow = new_x[i];
+		for (j = 0; j < new_shares_required - 1; j++) {
+			row[j] = x_pow;
+			x_pow = field_mul(x_pow, new_x[i]);
+		}
+		memcpy(&row[new_shares_required - 1], weights, shares_required);
+	}
+	return resharer;
+}
+
+static void resharer_inputs(const struct resharer* resharer, const uint8_t* in[], const uint8_t* const old_shares[], const uint8_t random[], size_t length) {
+	uint8_t j;
+	for (j = 0; j < resharer->random_rows; j++)
+		in[j] = &random[j * length];
+	for (; j < resharer->cols; j++)
+		in[j] = old_shares[j - resharer->random_rows];
+}
+
+/**
+ * Calculates length bytes of every new share from one buffer per old X coordinate and
+ * (new_shares_required - 1) rows of length secure random bytes
+ */
+void resharerBuffer(const struct resharer* resharer, uint8_t* new_shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length) {
+	const uint8_t* in[resharer->cols];
+	size_t chunk = chunk_size(resharer->new_total_shares + resharer->cols), offset;
+	resharer_inputs(resharer, in, old_shares, random, length);
+	for (offset = 0; offset < length; offset += chunk)
+		matrix_mul_range(new_shares, resharer->matrix, resharer->new_total_shares, in, resharer->cols, offset, length - offset < chunk ? length - offset : chunk);
+}
+
+void resharerFree(struct resharer* resharer) {
+	FREE(resharer);
+}
+
+/*
+ * Robust combining. The total_shares values of each byte are a Reed-Solomon codeword, so
+ * they satisfy the total_shares - shares_required parity checks
+ *   sum over i of v[i] * x[i]^r * share i = 0 for r < total_shares - shares_required
+ * with v[i] = 1 / prod over j != i of (x[i] - x[j]), which is a matrix-times-buffer pass just
+ * like encoding. Bytes which pass are combined from the first shares_required shares in bulk;
+ * only bytes which fail are decoded on their own, and any shares found to be wrong are
+ * dropped from the bulk pass for the rest of the buffer so that the same fault is not decoded
+ * over and over. Every buffer starts with all shares again, as otherwise faults in enough
+ * different shares at different places would leave fewer than shares_required to combine from.
+ */
+struct corrector {
+	uint8_t total_shares, shares_required;
+	uint8_t good_count, check_count;
+	size_t chunk;
+	uint8_t* x;		// [total_shares]
+	uint8_t* bad;		// [total_shares], set once a share has been wrong anywhere
+	uint8_t* excluded;	// [total_shares], set once a share has been wrong in the current buffer
+	uint8_t* good;		// [total_shares], the indices of the shares not excluded
+	uint8_t* check;		// [total_shares], the indices of the shares the parity checks cover
+	uint8_t* weights;	// [shares_required], the Lagrange weights of the first good shares
+	uint8_t* parity;	// [(check_count - shares_required) * check_count]
+	uint8_t* syndromes;	// [(total_shares - shares_required) * chunk]
+	uint8_t* system;	// [total_shares * (total_shares + 1)], for berlekamp_welch
+};
+
+// The size of everything from corrector->x on, which holds share bytes and so is secret
+static size_t corrector_size(uint8_t total_shares, uint8_t shares_required, size_t chunk) {
+	const uint8_t redundancy = total_shares - shares_required;
+	return 5 * total_shares + shares_required + redundancy * total_shares + redundancy * chunk + total_shares * (total_shares + 1);
+}
+
+static uint8_t poly_eval(const uint8_t poly[], uint8_t degree, uint8_t x) {
+	uint8_t result = poly[degree];
+	uint8_t i;
+	for (i = degree; i > 0; i--)
+		result = field_add(field_mul(result, x), poly[i - 1]);
+	return result;
+}
+
+/**
+ * Sets up the bulk pass for the current good shares: while the good shares alone still have
+ * at least e = (n - k) / 2 parity checks the checks cover just them, otherwise all the shares
+ * are checked, as with fewer checks than e a byte with e wrong good shares could pass them all
+ * (and then any byte which fails is decoded one byte at a time)
+ * With fewer good shares than needed there is no bulk pass at all (see correctorBuffer)
+ */
+static void corrector_plan(struct corrector* corrector) {
+	const uint8_t k = corrector->shares_required;
+	uint8_t i, j, r;
+	corrector->good_count = 0;
+	for (i = 0; i < corrector->total_shares; i++)
+		if (!corrector->excluded[i])
+			corrector->good[corrector->good_count++] = i;
+	if (corrector->good_count < k)
+		return;
+	if (corrector->good_count > k && corrector->good_count - k >= (corrector->total_shares - k) / 2) {
+		corrector->check_count = corrector->good_count;
+		memcpy(corrector->check, corrector->good, corrector->good_count);
+	} else {
+		corrector->check_count = corrector->total_shares;
+		for (i = 0; i < corrector->total_shares; i++)
+			corrector->check[i] = i;
+	}
+
+	for (i = 0; i < corrector->check_count; i++) {
+		const uint8_t xi = corrector->x[corrector->check[i]];
+		uint8_t v = 1, x_pow = 1;
+		for (j = 0; j < corrector->check_count; j++)
+			if (j != i)
+				v = field_mul(v, field_sub(xi, corrector->x[corrector->check[j]]));
+		v = field_invert(v);
+		for (r = 0; r < corrector->check_count - k; r++) {
+			corrector->parity[r * corrector->check_count + i] = field_mul(v, x_pow);
+			x_pow = field_mul(x_pow, xi);
+		}
+	}
+
+	uint8_t good_x[k];
+	for (i = 0; i < k; i++)
+		good_x[i] = corrector->x[corrector->good[i]];
+	lagrange_at_zero(corrector->weights, good_x, k);
+}
+
+/**
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct and nonzero
+ */
+struct corrector* correctorCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required) {
+	const uint8_t redundancy = total_shares - shares_required;
+	struct corrector* corrector;
+	uint8_t i, j;
+	CHECKSTATE(shares_required > 0 && total_shares >= shares_required);
+	for (i = 0; i < total_shares; i++) {
+		if (x[i] == 0)
+			return (void*)0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return (void*)0;
+	}
+	corrector = ALLOC(sizeof(struct corrector));
+	if (!corrector)
+		return corrector;
+	corrector->total_shares = total_shares;
+	corrector->shares_required = shares_required;
+	corrector->chunk = chunk_size(2 * total_shares);
+	corrector->x = SECRET_ALLOC(corrector_size(total_shares, shares_required, corrector->chunk));
+	if (!corrector->x) {
+		FREE(corrector);
+		return (void*)0;
+	}
+	corrector->bad = &corrector->x[total_shares];
+	corrector->excluded = &corrector->bad[total_shares];
+	corrector->good = &corrector->excluded[total_shares];
+	corrector->check = &corrector->good[total_shares];
+	corrector->weights = &corrector->check[total_shares];
+	corrector->parity = &corrector->weights[shares_required];
+	corrector->syndromes = &corrector->parity[redundancy * total_shares];
+	corrector->system = &corrector->syndromes[redundancy * corrector->chunk];
+	memcpy(corrector->x, x, total_shares);
+	memset(corrector->bad, 0, total_shares);
+	memset(corrector->excluded, 0, total_shares);
+	corrector_plan(corrector);
+	return corrector;
+}
+
+/**
+ * Berlekamp-Welch for one byte: finds the polynomial f of degree < k which goes through all
+ * but at most e = (n - k) / 2 of the points (x[i], y[i]) by solving
+ *   Q(x[i]) = y[i] * E(x[i])
+ * for Q of degree < e + k and monic E of degree e, and dividing Q by E
+ * in system (room for n rows of n + 1), which is wiped afterwards along with the local copies of Q and f
+ * Returns 0 if there is no such f, otherwise sets *secret to f(0) and wrong[i] if f(x[i]) != y[i]
+ */
+static int berlekamp_welch(const uint8_t x[], const uint8_t y[], uint8_t n, uint8_t k, uint8_t system[], uint8_t* secret, uint8_t wrong[]) {
+	const unsigned e = (n - k) / 2;
+	const unsigned unknowns = 2 * e + k, width = unknowns + 1;
+	uint8_t q[2 * e + k], f[k], solution[unknowns];
+	unsigned pivot_col[unknowns];
+	unsigned i, j, c, row, rank = 0, errors = 0;
+	int ret = 0;
+
+	// Row i: x[i]^0 .. x[i]^(e+k-1) (for Q), y[i] * x[i]^0 .. y[i] * x[i]^(e-1) (for E) | y[i] * x[i]^e
+	for (i = 0; i < n; i++) {
+		uint8_t x_pow = 1;
+		for (j = 0; j < e + k; j++) {
+			system[i * width + j] = x_pow;
+			if (j < e)
+				system[i * width + e + k + j] = field_mul(y[i], x_pow);
+			if (j == e)
+				system[i * width + unknowns] = field_mul(y[i], x_pow);
+			x_pow = field_mul(x_pow, x[i]);
+		}
+	}
+
+	// Gauss-Jordan, leaving any free unknowns 0
+	for (j = 0; j < unknowns && rank < n; j++) {
+		for (row = rank; row < n && system[row * width + j] == 0; row++) {}
+		if (row == n)
+			continue;
+		if (row != rank) {
+			for (c = 0; c < width; c++) {
+				uint8_t t = system[rank * width + c];
+				system[rank * width + c] = system[row * width + c];
+				system[row * width + c] = t;
+			}
+		}
+		const uint8_t pivot_inverse = field_invert(system[rank * width + j]);
+		for (c = 0; c < width; c++)
+			system[rank * width + c] = field_mul(system[rank * width + c], pivot_inverse);
+		for (row = 0; row < n; row++) {
+			const uint8_t factor = system[row * width + j];
+			if (row == rank || factor == 0)
+				continue;
+			for (c = 0; c < width; c++)
+				system[row * width + c] = field_sub(system[row * width + c], field_mul(factor, system[rank * width + c]));
+		}
+		pivot_col[rank++] = j;
+	}
+	// Inconsistent if some all-zero row has a nonzero right-hand side
+	for (row = rank; row < n; row++)
+		if (system[row * width + unknowns] != 0)
+			goto out;
+
+	memset(solution, 0, sizeof(solution));
+	for (row = 0; row < rank; row++)
+		solution[pivot_col[row]] = system[row * width + unknowns];
+
+	// Q / E by long division, E being monic; the remainder must be 0
+	memcpy(q, solution, e + k);
+	for (i = e + k; i-- > e;) {
+		const uint8_t coefficient = q[i];
+		f[i - e] = coefficient;
+		for (j = 0; j < e; j++)
+			q[i - e + j] = field_sub(q[i - e + j], field_mul(coefficient, solution[e + k + j]));
+		q[i] = 0;
+	}
+	for (i = 0; i < e; i++)
+		if (q[i] != 0)
+			goto out;
+
+	for (i = 0; i < n; i++) {
+		wrong[i] = poly_eval(f, k - 1, x[i]) != y[i];
+		errors += wrong[i];
+	}
+	if (errors > e)
+		goto out;
+	*secret = f[0];
+	ret = 1;
+out:
+	memset(system, 0, n * width);
+	SECRET_WIPE(q, sizeof(q));
+	SECRET_WIPE(f, sizeof(f));
+	SECRET_WIPE(solution, sizeof(solution));
+	return ret;
+}
+
+/**
+ * Derives length bytes of the secret from one buffer per X coordinate the corrector was created with
+ * Returns 0 if some byte had too many wrong shares to correct
+ */
+int correctorBuffer(struct corrector* corrector, uint8_t secret[], const uint8_t* const shares[], size_t length) {
+	const uint8_t n = corrector->total_shares, k = corrector->shares_required;
+	uint8_t ys[n], wrong[n];
+	size_t offset = 0, b;
+	uint8_t i, r, any_excluded = 0;
+	int ret = 0;
+	for (i = 0; i < n; i++)
+		any_excluded |= corrector->excluded[i];
+	if (any_excluded) {
+		memset(corrector->excluded, 0, n);
+		corrector_plan(corrector);
+	}
+	while (offset < length) {
+		const size_t count = length - offset < corrector->chunk ? length - offset : corrector->chunk;
+		const uint8_t rows = corrector->check_count - k;
+
+		// No k shares can be trusted for the rest of the buffer, so every byte is decoded on its own
+		if (corrector->good_count < k) {
+			for (b = offset; b < length; b++) {
+				for (i = 0; i < n; i++)
+					ys[i] = shares[i][b];
+				if (!berlekamp_welch(corrector->x, ys, n, k, corrector->system, &secret[b], wrong))
+					goto out;
+				for (i = 0; i < n; i++)
+					corrector->bad[i] |= wrong[i];
+			}
+			break;
+		}
+
+		const uint8_t* in[n];
+		uint8_t* syndromes[rows + 1];
+		int replanned = 0;
+
+		for (i = 0; i < k; i++)
+			in[i] = shares[corrector->good[i]] + offset;
+		field_dot_buf(secret + offset, in, corrector->weights, k, 0, count);
+
+		for (i = 0; i < corrector->check_count; i++)
+			in[i] = shares[corrector->check[i]] + offset;
+		for (r = 0; r < rows; r++)
+			syndromes[r] = &corrector->syndromes[r * corrector->chunk];
+		matrix_mul_range(syndromes, corrector->parity, rows, in, corrector->check_count, 0, count);
+
+		for (b = 0; b < count && !replanned; b++) {
+			uint8_t flagged = 0;
+			for (r = 0; r < rows; r++)
+				flagged |= syndromes[r][b];
+			if (!flagged)
+				continue;
+
+			for (i = 0; i < n; i++)
+				ys[i] = shares[i][offset + b];
+			if (!berlekamp_welch(corrector->x, ys, n, k, corrector->system, &secret[offset + b], wrong))
+				goto out;
+			for (i = 0; i < n; i++) {
+				corrector->bad[i] |= wrong[i];
+				if (wrong[i] && !corrector->excluded[i]) {
+					corrector->excluded[i] = 1;
+					replanned = 1;
+				}
+			}
+			if (replanned) {
+				// Everything up to and including this byte is done, carry on with the new plan after it
+				corrector_plan(corrector);
+				offset += b + 1;
+			}
+		}
+		if (!replanned)
+			offset += count;
+	}
+	ret = 1;
+out:
+	SECRET_WIPE(ys, sizeof(ys)); // A column of share bytes, which is the secret once k of them are known
+	return ret;
+}
+
+int correctorShareBad(const struct corrector* corrector, uint8_t i) {
+	return corrector->bad[i];
+}
+
+void correctorFree(struct corrector* corrector) {
+	SECRET_FREE(corrector->x, corrector_size(corrector->total_shares, corrector->shares_required, corrector->chunk));
+	FREE(corrector);
+}
+
+#ifndef IN_KERNEL
+struct encoder_job {
+	const struct encoder* encoder;
+	uint8_t* const* shares;
+	const uint8_t* const* in;
+	size_t length, chunk, tasks;
+};
+
+static void encoder_task(void* arg, size_t task) {
+	const struct encoder_job* job = arg;
+	encoder_chunks(job->encoder, job->shares, job->in, job->length, job->chunk, task * job->chunk, job->tasks * job->chunk);
+}
+
+/**
+ * encoderBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ * Each thread takes every tasks'th chunk, so that it only allocates the transform's scratch once
+ */
+void encoderBufferParallel(struct pool* pool, const struct encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length) {
+	const uint8_t* in[encoder->shares_required];
+	const size_t chunk = encoder_chunk(encoder);
+	encoder_inputs(encoder, in, secret, random, length);
+	struct encoder_job job = { encoder, shares, in, length, chunk, pool_strided_tasks(pool, length, chunk) };
+	pool_run(pool, encoder_task, &job, job.tasks);
+}
+
+void disperseBufferParallel(struct pool* pool, const struct encoder* encoder, uint8_t* fragments[], uint8_t data[], size_t length) {
+	const size_t fragment_length = disperseLength(length, encoder->shares_required);
+	memset(&data[length], 0, encoder->shares_required * fragment_length - length);
+	encoderBufferParallel(pool, encoder, fragments, data, &data[fragment_length], fragment_length);
+}
+
+struct refresh_job {
+	const struct encoder* encoder;
+	uint8_t* const* shares;
+	const uint8_t* const* old_shares;
+	const uint8_t* random;
+	size_t length, chunk;
+};
+
+static void refresh_task(void* arg, size_t task) {
+	const struct refresh_job* job = arg;
+	size_t offset = task * job->chunk;
+	size_t count = job->length - offset < job->chunk ? job->length - offset : job->chunk;
+	refresh_range(job->encoder, job->shares, job->old_shares, job->random, job->length, offset, count);
+}
+
+void encoderRefreshParallel(struct pool* pool, const struct encoder* encoder, uint8_t* shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length) {
+	CHECKSTATE(encoder->secret_rows == 1);
+	struct refresh_job job = { encoder, shares, old_shares, random, length, chunk_size(2 * encoder->total_shares + encoder->shares_required) };
+	pool_run(pool, refresh_task, &job, (length + job.chunk - 1) / job.chunk);
+}
+
+struct resharer_job {
+	const struct resharer* resharer;
+	uint8_t* const* new_shares;
+	const uint8_t* const* in;
+	size_t length, chunk;
+};
+
+static void resharer_task(void* arg, size_t task) {
+	const struct resharer_job* job = arg;
+	size_t offset = task * job->chunk;
+	size_t count = job->length - offset < job->chunk ? job->length - offset : job->chunk;
+	matrix_mul_range(job->new_shares, job->resharer->matrix, job->resharer->new_total_shares, job->in, job->resharer->cols, offset, count);
+}
+
+void resharerBufferParallel(struct pool* pool, const struct resharer* resharer, uint8_t* new_shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length) {
+	const uint8_t* in[resharer->cols];
+	resharer_inputs(resharer, in, old_shares, random, length);
+	struct resharer_job job = { resharer, new_shares, in, length, chunk_size(resharer->new_total_shares + resharer->cols) };
+	pool_run(pool, resharer_task, &job, (length + job.chunk - 1) / job.chunk);
+}
+
+struct decoder_job {
+	const struct decoder* decoder;
+	uint8_t* const* out;
+	const uint8_t* const* fragments;
+	size_t length, chunk, tasks;
+};
+
+static void decoder_task(void* arg, size_t task) {
+	const struct decoder_job* job = arg;
+	decoder_chunks(job->decoder, job->out, job->fragments, job->length, job->chunk, task * job->chunk, job->tasks * job->chunk);
+}
+
+// Strided across the pool like encoderBufferParallel
+void decoderBufferParallel(struct pool* pool, const struct decoder* decoder, uint8_t data[], const uint8_t* const fragments[], size_t fragment_length) {
+	uint8_t* out[decoder->outputs];
+	const size_t chunk = decoder_chunk(decoder);
+	decoder_outputs(decoder, out, data, fragment_length);
+	struct decoder_job job = { decoder, out, fragments, fragment_length, chunk, pool_strided_tasks(pool, fragment_length, chunk) };
+	pool_run(pool, decoder_task, &job, job.tasks);
+}
+#endif // !defined(IN_KERNEL)
@@ -0,0 +1,89 @@
+/*
+ * Matrices over the field and matrix-times-buffer encoding
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ERASURE_H
+#define ERASURE_H
+
+#include "field.h"
+
+// Buffers are worked on in chunks of about this many bytes across all rows, so that
+// every row of a chunk stays in (L2) cache while it is being calculated
+#define CACHE_SIZE (256 * 1024)
+#define MIN_CHUNK_SIZE 512
+
+static inline size_t chunk_size(unsigned rows) {
+	size_t chunk = CACHE_SIZE / rows;
+	chunk -= chunk % 64;
+	return chunk < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE : chunk;
+}
+
+/*
+ * Matrices are rows * cols bytes, row-major. Multiplying one by a set of cols
+ * input buffers gives rows output buffers, each byte of output i being
+ * sum over j of matrix[i][j] * input j (at the same offset), so a matrix
+ * with a row per share encodes all shares in one pass over the inputs.
+ */
+
+/**
+ * matrix[i][j] = x[i]^j
+ * Any cols rows are linearly independent as long as the x[i] are distinct
+ */
+void matrix_vandermonde(uint8_t matrix[], const uint8_t x[], uint8_t rows, uint8_t cols);
+
+/**
+ * matrix[i][j] = 1 / (x[i] - y[j]), every square submatrix of which is invertible
+ * Returns 0 if the x[i] and y[j] are not all distinct
+ */
+int matrix_cauchy(uint8_t matrix[], const uint8_t x[], uint8_t rows, const uint8_t y[], uint8_t cols);
+
+/**
+ * matrix[i][j] = the Lagrange basis polynomial of points[j] (over all cols points) at x[i],
+ * so multiplying by the values at the points gives the values at the x[i]
+ * Returns 0 if the points are not distinct
+ */
+int matrix_lagrange(uint8_t matrix[], const uint8_t x[], uint8_t rows, const uint8_t points[], uint8_t cols);
+
+/**
+ * Inverts the size * size matrix in place by Gauss-Jordan elimination
+ * Returns 0 (leaving matrix untouched) if it is singular or memory could not be allocated
+ */
+int matrix_invert(uint8_t matrix[], uint8_t size);
+
+/**
+ * Sets bytes [offset, offset + count) of every out[i] (i < rows) to matrix * in
+ * The inputs are read once per output, so count should be about chunk_size(rows + cols)
+ */
+void matrix_mul_range(uint8_t* const out[], const uint8_t matrix[], uint8_t rows, const uint8_t* const in[], uint8_t cols, size_t offset, size_t count);
+
+/**
+ * The X coordinate which packed sharing puts secret j (of secret_count) at: 0 for the first,
+ * as in plain Shamir, then down from P - 1, so shares can take any X coordinate up to P - secret_count
+ */
+static inline uint8_t packed_secret_x(uint8_t j) {
+	return j == 0 ? 0 : P - j;
+}
+
+static inline int packed_is_secret_x(uint8_t x, uint8_t secret_count) {
+	return x == 0 || x > P - secret_count;
+}
+
+#endif // ERASURE_H
@@ -0,0 +1,316 @@
+/*
+ * Additive FFT over GF(2^8) for evaluating and interpolating many points at once
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "fft.h"
+
+// subspace[r][t] = the coefficient of x^(2^t) in W_r, which has no other terms
+static uint8_t subspace[FFT_BITS][FFT_BITS];
+// normalizer[r] = W_r(v_r), so X_j is made of the W_r(x) / normalizer[r]
+static uint8_t normalizer[FFT_BITS], normalizer_inverse[FFT_BITS];
+// skew[r][x] = W_r(x) / W_r(v_r), which only depends on the bits of x from r up
+static uint8_t skew[FFT_BITS][P];
+// derivative[r] = the (constant) derivative of W_r(x) / W_r(v_r)
+static uint8_t derivative[FFT_BITS];
+
+static uint8_t subspace_at(unsigned r, uint8_t x) {
+	uint8_t ret = 0, x_pow = x; // x^(2^t)
+	unsigned t;
+	for (t = 0; t <= r; t++) {
+		ret = field_add(ret, field_mul(subspace[r][t], x_pow));
+		x_pow = field_mul(x_pow, x_pow);
+	}
+	return ret;
+}
+
+__attribute__((constructor))
+static void fft_init(void) {
+	unsigned r, t, x;
+	// W_0(x) = x and W_(r+1)(x) = W_r(x) * W_r(x + v_r) = W_r(x)^2 + W_r(v_r) * W_r(x)
+	subspace[0][0] = 1;
+	for (r = 0; r < FFT_BITS; r++) {
+		normalizer[r] = subspace_at(r, 1 << r);
+		normalizer_inverse[r] = field_invert(normalizer[r]);
+		derivative[r] = field_mul(subspace[r][0], normalizer_inverse[r]);
+		for (x = 0; x < P; x++)
+			skew[r][x] = field_mul(subspace_at(r, x), normalizer_inverse[r]);
+		if (r + 1 == FFT_BITS)
+			break;
+		for (t = 0; t <= r; t++) {
+			subspace[r + 1][t + 1] = field_add(subspace[r + 1][t + 1], field_mul(subspace[r][t], subspace[r][t]));
+			subspace[r + 1][t] = field_add(subspace[r + 1][t], field_mul(normalizer[r], subspace[r][t]));
+		}
+	}
+}
+
+unsigned fft_log_size(unsigned count) {
+	unsigned log_size = 0;
+	while ((1u << log_size) < count)
+		log_size++;
+	return log_size;
+}
+
+// dst[i] += src[i], a word at a time as the compiler cannot rule out that the rows overlap
+static void add_buf(uint8_t dst[], const uint8_t src[], size_t count) {
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		uint64_t d, s;
+		memcpy(&d, &dst[i], 8);
+		memcpy(&s, &src[i], 8);
+		d ^= s;
+		memcpy(&dst[i], &d, 8);
+	}
+	for (; i < count; i++)
+		dst[i] = field_add(dst[i], src[i]);
+}
+
+/*
+ * A block of 2^(s+1) rows is divided by W_s (monic, of degree 2^s = half the block) by long
+ * division, which leaves the remainder in the low half and the quotient in the high half.
+ * As W_s only has the terms x^(2^t), each quotient row only touches s other rows.
+ */
+void fft_from_monomial(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count) {
+	const unsigned size = 1u << log_size;
+	unsigned s, start, i, t;
+	for (s = log_size; s-- > 0;) {
+		const unsigned half = 1u << s;
+		for (start = 0; start < size; start += 2 * half) {
+			for (i = 2 * half - 1; i >= half; i--)
+				for (t = 0; t < s; t++)
+					field_mul_add_buf(&rows[start + i - half + (1u << t)][offset], &rows[start + i][offset], subspace[s][t], count);
+			// The quotient of W_s is normalizer[s] times that of W_s(x) / W_s(v_s)
+			for (i = half; i < 2 * half; i++)
+				field_mul_buf(&rows[start + i][offset], &rows[start + i][offset], normalizer[s], count);
+		}
+	}
+}
+
+void fft_to_monomial(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count) {
+	const unsigned size = 1u << log_size;
+	unsigned s, start, i, t;
+	for (s = 0; s < log_size; s++) {
+		const unsigned half = 1u << s;
+		for (start = 0; start < size; start += 2 * half) {
+			for (i = half; i < 2 * half; i++)
+				field_mul_buf(&rows[start + i][offset], &rows[start + i][offset], normalizer_inverse[s], count);
+			// Undoes the division steps in the opposite order, each quotient row being final by then
+			for (i = half; i < 2 * half; i++)
+				for (t = 0; t < s; t++)
+					field_mul_add_buf(&rows[start + i - half + (1u << t)][offset], &rows[start + i][offset], subspace[s][t], count);
+		}
+	}
+}
+
+/*
+ * With f = f_0 + (W_r(x) / W_r(v_r)) * f_1 over a block of 2^(r+1) points whose low r bits
+ * vary, the scaled W_r is a constant w on the low half of the points and w + 1 on the high
+ * half, so f_0 + w * f_1 and then that plus f_1 are the halves' polynomials.
+ */
+void fft_evaluate(uint8_t* const rows[], unsigned log_size, uint8_t shift, size_t offset, size_t count) {
+	const unsigned size = 1u << log_size;
+	unsigned r, start, i;
+	for (r = log_size; r-- > 0;) {
+		const unsigned half = 1u << r;
+		for (start = 0; start < size; start += 2 * half) {
+			const uint8_t w = skew[r][shift ^ start];
+			for (i = start; i < start + half; i++) {
+				if (w)
+					field_mul_add_buf(&rows[i][offset], &rows[i + half][offset], w, count);
+				add_buf(&rows[i + half][offset], &rows[i][offset], count);
+			}
+		}
+	}
+}
+
+void fft_interpolate(uint8_t* const rows[], unsigned log_size, uint8_t shift, size_t offset, size_t count) {
+	const unsigned size = 1u << log_size;
+	unsigned r, start, i;
+	for (r = 0; r < log_size; r++) {
+		const unsigned half = 1u << r;
+		for (start = 0; start < size; start += 2 * half) {
+			const uint8_t w = skew[r][shift ^ start];
+			for (i = start; i < start + half; i++) {
+				add_buf(&rows[i + half][offset], &rows[i][offset], count);
+				if (w)
+					field_mul_add_buf(&rows[i][offset], &rows[i + half][offset], w, count);
+			}
+		}
+	}
+}
+
+/*
+ * X_j' = sum over the bits r of j of derivative[r] * X_(j - 2^r), so row i of the result only
+ * reads rows above i and the rows can be replaced from the bottom up.
+ */
+void fft_derivative(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count) {
+	const unsigned size = 1u << log_size;
+	const uint8_t* src[FFT_BITS];
+	uint8_t c[FFT_BITS];
+	unsigned i, r, terms;
+	for (i = 0; i < size; i++) {
+		terms = 0;
+		for (r = 0; r < log_size; r++) {
+			if (i & (1u << r))
+				continue;
+			src[terms] = rows[i | (1u << r)];
+			c[terms++] = derivative[r];
+		}
+		if (terms)
+			field_dot_buf(rows[i], src, c, terms, offset, count);
+		else
+			memset(&rows[i][offset], 0, count);
+	}
+}
+
+size_t fft_encode_scratch(uint8_t shares_required, size_t count) {
+	return (2u << fft_log_size(shares_required)) * count;
+}
+
+void fft_encode_range(uint8_t* const shares[], const uint8_t x[], uint8_t total_shares, const uint8_t* const coefficients[], uint8_t shares_required, uint8_t scratch[], size_t offset, size_t count) {
+	const unsigned log_size = fft_log_size(shares_required), size = 1u << log_size;
+	uint8_t share_at[P] = { 0 }; // 1 + the index of the share at each X coordinate
+	uint8_t* rows[2 * size];
+	unsigned shift, i;
+	for (i = 0; i < 2 * size; i++)
+		rows[i] = &scratch[i * count];
+	for (i = 0; i < size; i++) {
+		if (i < shares_required)
+			memcpy(rows[i], &coefficients[i][offset], count);
+		else
+			memset(rows[i], 0, count);
+	}
+	fft_from_monomial(rows, log_size, 0, count);
+
+	for (i = 0; i < total_shares; i++) {
+		CHECKSTATE(x[i] != 0); // q(0) == secret
+		share_at[x[i]] = i + 1;
+	}
+	// The whole field is P / size cosets of the points fft_evaluate reaches at once, so only
+	// evaluate those cosets which have a share in them
+	for (shift = 0; shift < P; shift += size) {
+		for (i = 0; i < size && !share_at[shift + i]; i++) {}
+		if (i == size)
+			continue;
+		for (i = 0; i < size; i++)
+			memcpy(rows[size + i], rows[i], count);
+		fft_evaluate(&rows[size], log_size, shift, 0, count);
+		for (i = 0; i < size; i++)
+			if (share_at[shift + i])
+				memcpy(&shares[share_at[shift + i] - 1][offset], rows[size + i], count);
+	}
+}
+
+int fft_plan_create(struct fft_plan* plan, const uint8_t x[], uint8_t shares_required) {
+	unsigned u, w;
+	uint8_t i;
+	memset(plan->fragment, 0, P);
+	for (i = 0; i < shares_required; i++) {
+		if (x[i] == 0 || plan->fragment[x[i]])
+			return 0;
+		plan->fragment[x[i]] = i + 1;
+	}
+	for (u = 0; u < P; u++) {
+		uint8_t product = 1;
+		for (w = 0; w < P; w++)
+			if (w != u && !plan->fragment[w])
+				product = field_mul(product, field_sub(u, w));
+		plan->factor[u] = plan->fragment[u] ? product : field_invert(product);
+	}
+	return 1;
+}
+
+size_t fft_decode_scratch(size_t count) {
+	return P * count;
+}
+
+void fft_decode_range(uint8_t* const out[], uint8_t shares_required, const uint8_t* const fragments[], const struct fft_plan* plan, uint8_t scratch[], size_t offset, size_t count) {
+	uint8_t* rows[P];
+	unsigned u;
+	uint8_t j;
+	for (u = 0; u < P; u++)
+		rows[u] = &scratch[u * count];
+
+	// pi * q has degree < P (pi has P - shares_required roots), so its values at every point give it exactly
+	for (u = 0; u < P; u++) {
+		if (plan->fragment[u])
+			field_mul_buf(rows[u], &fragments[plan->fragment[u] - 1][offset], plan->factor[u], count);
+		else
+			memset(rows[u], 0, count);
+	}
+	fft_interpolate(rows, FFT_BITS, 0, 0, count);
+	fft_derivative(rows, FFT_BITS, 0, count);
+	fft_evaluate(rows, FFT_BITS, 0, 0, count);
+
+	// At a root u of pi, (pi * q)'(u) = pi'(u) * q(u)
+	for (u = 0; u < P; u++) {
+		if (plan->fragment[u])
+			memcpy(rows[u], &fragments[plan->fragment[u] - 1][offset], count);
+		else
+			field_mul_buf(rows[u], rows[u], plan->factor[u], count);
+	}
+	fft_interpolate(rows, FFT_BITS, 0, 0, count);
+	// q has degree < shares_required, so every higher novel basis coefficient is 0
+	fft_to_monomial(rows, fft_log_size(shares_required), 0, count);
+	for (j = 0; j < shares_required; j++)
+		memcpy(&out[j][offset], rows[j], count);
+}
+
+/*
+ * Costs are counted in row multiply-adds per byte, a plain add or copy of a row counting
+ * as a quarter of one. The matrix kernels keep their sums in registers, so each of their
+ * multiply-adds is cheaper than one of the transforms'; FFT_WEIGHT is that ratio, as
+ * measured by the benchmark's "fft" results.
+ */
+// (x86-64 with GFNI, n = 255: the FFT encodes faster from k = 16 and decodes faster from about k = 192)
+#define FFT_WEIGHT 4
+
+static enum fft_mode fft_mode = FFT_AUTO;
+
+void fft_select(enum fft_mode mode) {
+	fft_mode = mode;
+}
+
+// fft_from_monomial on 2^log_size rows
+static unsigned conversion_cost(unsigned log_size) {
+	const unsigned size = 1u << log_size;
+	return size / 2 * (log_size * (log_size - 1) / 2 + log_size);
+}
+
+// fft_evaluate or fft_interpolate on 2^log_size rows
+static unsigned transform_cost(unsigned log_size) {
+	const unsigned size = 1u << log_size;
+	return size / 2 * log_size + size / 2 * log_size / 4;
+}
+
+int fft_encode_cheaper(uint8_t total_shares, uint8_t shares_required) {
+	const unsigned log_size = fft_log_size(shares_required), size = 1u << log_size;
+	unsigned cosets = P / size < total_shares ? P / size : total_shares;
+	if (fft_mode != FFT_AUTO)
+		return fft_mode == FFT_ALWAYS;
+	return FFT_WEIGHT * (conversion_cost(log_size) + cosets * (transform_cost(log_size) + size / 2)) < (unsigned)total_shares * shares_required;
+}
+
+int fft_decode_cheaper(uint8_t shares_required) {
+	if (fft_mode != FFT_AUTO)
+		return fft_mode == FFT_ALWAYS;
+	return FFT_WEIGHT * (3 * transform_cost(FFT_BITS) + FFT_BITS / 2 * P + 3 * P / 4 + conversion_cost(fft_log_size(shares_required)))
+			< (unsigned)shares_required * shares_required;
+}
@@ -0,0 +1,104 @@
+/*
+ * Additive FFT over GF(2^8) for evaluating and interpolating many points at once
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include "field.h"
+
+/*
+ * The Lin-Chung-Han transform: with the field's bits as the basis v_r = 1 << r,
+ * W_r(x) is the product of (x - u) over every u < 2^r and the "novel basis" is
+ * X_j(x) = product over the bits r set in j of W_r(x) / W_r(v_r). A polynomial
+ * of degree < 2^log_size written in that basis is evaluated at all of the points
+ * shift ^ i (i < 2^log_size) in 2^log_size * log_size / 2 butterflies, each one
+ * multiply-add and one add of a row, instead of 2^log_size multiply-adds per point.
+ *
+ * Like matrix_mul_range, every function works on bytes [offset, offset + count) of
+ * each of its 2^log_size rows, one polynomial per byte position.
+ */
+
+#define FFT_BITS 8
+
+// The smallest log_size with 2^log_size >= count
+unsigned fft_log_size(unsigned count);
+
+// Replaces the coefficients of x^0 .. x^(2^log_size - 1) in rows by those of X_0 .. X_(2^log_size - 1)
+void fft_from_monomial(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count);
+// The inverse of fft_from_monomial
+void fft_to_monomial(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count);
+
+// Replaces novel basis coefficients with the values at shift ^ i (shift a multiple of 2^log_size)
+void fft_evaluate(uint8_t* const rows[], unsigned log_size, uint8_t shift, size_t offset, size_t count);
+// The inverse of fft_evaluate
+void fft_interpolate(uint8_t* const rows[], unsigned log_size, uint8_t shift, size_t offset, size_t count);
+
+// Replaces novel basis coefficients with those of the formal derivative
+void fft_derivative(uint8_t* const rows[], unsigned log_size, size_t offset, size_t count);
+
+/**
+ * Sets bytes [offset, offset + count) of every shares[i] (i < total_shares) to q(x[i]), where
+ * coefficients[j] holds the coefficient of x^j of q, so the result is exactly matrix_vandermonde's
+ * scratch must hold fft_encode_scratch(shares_required, count) bytes, and is left holding secrets
+ */
+void fft_encode_range(uint8_t* const shares[], const uint8_t x[], uint8_t total_shares, const uint8_t* const coefficients[], uint8_t shares_required, uint8_t scratch[], size_t offset, size_t count);
+// Callers allocate the scratch once for every chunk of up to count bytes rather than once per chunk
+size_t fft_encode_scratch(uint8_t shares_required, size_t count);
+
+/*
+ * Erasure decoding: with pi(x) the product of (x - u) over every point u there is no
+ * fragment for, the transform of pi * q from the fragments (pi being 0 at every other
+ * point) and its formal derivative give q(u) = (pi * q)'(u) / pi'(u) at every missing u.
+ */
+struct fft_plan {
+	uint8_t fragment[P]; // 1 + the index of the fragment at X coordinate u, 0 if there is none
+	uint8_t factor[P];   // pi(u) where there is a fragment, 1 / pi'(u) where there is not
+};
+
+/**
+ * Returns 0 if the X coordinates are not distinct and nonzero
+ */
+int fft_plan_create(struct fft_plan* plan, const uint8_t x[], uint8_t shares_required);
+
+/**
+ * Sets bytes [offset, offset + count) of every out[j] (j < shares_required) to the coefficient
+ * of x^j of the polynomial through the fragments, exactly what the inverted Vandermonde matrix gives
+ * scratch must hold fft_decode_scratch(count) bytes, and is left holding secrets
+ */
+void fft_decode_range(uint8_t* const out[], uint8_t shares_required, const uint8_t* const fragments[], const struct fft_plan* plan, uint8_t scratch[], size_t offset, size_t count);
+size_t fft_decode_scratch(size_t count);
+
+/*
+ * Whether to use the transforms in place of plain matrix multiplication. FFT_AUTO
+ * compares the rough cost of each per byte, weighted as measured by the benchmark.
+ */
+enum fft_mode {
+	FFT_AUTO,
+	FFT_NEVER,
+	FFT_ALWAYS,
+};
+
+void fft_select(enum fft_mode mode);
+int fft_encode_cheaper(uint8_t total_shares, uint8_t shares_required);
+int fft_decode_cheaper(uint8_t shares_required);
+
+#endif // FFT_H
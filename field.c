@@ -0,0 +1,526 @@
+/*
+ * GF(2^8) multiply kernels across whole buffers
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "field.h"
+
+#if !defined(IN_KERNEL) && (defined(__x86_64__) || defined(__i386__))
+#define FIELD_SIMD
+#include <immintrin.h>
+#endif
+
+#ifndef always_inline
+#define always_inline inline __attribute__((always_inline))
+#endif
+
+/*
+ * Every kernel multiplies by a constant c, so the SIMD kernels split each
+ * source byte into nibbles and look up c * nibble in two 16-byte tables held
+ * in registers (PSHUFB), or use GF2P8MULB directly. GF2P8MULB reduces modulo
+ * x^8 + x^4 + x^3 + x + 1 (0x11b), the same polynomial the exp/log tables in
+ * field.h encode, so all kernels give identical results.
+ */
+
+struct field_tables {
+	uint8_t lo[16]; // c * i
+	uint8_t hi[16]; // c * (i << 4)
+};
+
+static void field_tables_calc(struct field_tables* tables, uint8_t c) {
+	uint8_t i;
+	for (i = 0; i < 16; i++) {
+		tables->lo[i] = field_mul(c, i);
+		tables->hi[i] = field_mul(c, i << 4);
+	}
+}
+
+// The few bytes which do not fill a whole vector register, without touching any tables
+static always_inline void scalar_tail(uint8_t dst[], const uint8_t src[], uint8_t c, size_t i, size_t length, int add) {
+	for (; i < length; i++) {
+		uint8_t prod = field_mul_ct(c, src[i]);
+		dst[i] = add ? field_add(dst[i], prod) : prod;
+	}
+}
+
+// The same for a sum of rows, dst[i] = sum over j of c[j] * src[j][i]
+static always_inline void dot_tail(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t i, size_t length) {
+	uint8_t j;
+	for (; i < length; i++) {
+		uint8_t sum = 0;
+		for (j = 0; j < rows; j++)
+			sum = field_add(sum, field_mul_ct(c[j], src[j][offset + i]));
+		dst[offset + i] = sum;
+	}
+}
+
+static always_inline void kernel_scalar(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	uint8_t row[P];
+	size_t i;
+	for (i = 0; i < P; i++)
+		row[i] = field_mul(c, i);
+	if (add) {
+		for (i = 0; i < length; i++)
+			dst[i] = field_add(dst[i], row[src[i]]);
+	} else {
+		for (i = 0; i < length; i++)
+			dst[i] = row[src[i]];
+	}
+}
+
+// Multiplies the eight bytes packed in a word at once with shifts and masks (no tables or branches)
+static always_inline void kernel_scalar_ct(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	const uint64_t high_bits = 0x8080808080808080ULL;
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t a, prod = 0, d;
+		uint8_t bit;
+		memcpy(&a, &src[i], 8);
+		for (bit = 0; bit < 8; bit++) {
+			uint64_t carry = a & high_bits;
+			prod ^= a & -(uint64_t)((c >> bit) & 1);
+			a = ((a & ~high_bits) << 1) ^ ((carry >> 7) * 0x1b); // x^8 == x^4 + x^3 + x + 1
+		}
+		if (add) {
+			memcpy(&d, &dst[i], 8);
+			prod ^= d;
+		}
+		memcpy(&dst[i], &prod, 8);
+	}
+	scalar_tail(dst, src, c, i, length, add);
+}
+
+#ifdef FIELD_SIMD
+__attribute__((target("ssse3")))
+static always_inline void kernel_ssse3(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	struct field_tables tables;
+	field_tables_calc(&tables, c);
+	const __m128i lo = _mm_loadu_si128((const __m128i*)tables.lo);
+	const __m128i hi = _mm_loadu_si128((const __m128i*)tables.hi);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		__m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+		__m128i prod = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+				_mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+		if (add)
+			prod = _mm_xor_si128(prod, _mm_loadu_si128((const __m128i*)&dst[i]));
+		_mm_storeu_si128((__m128i*)&dst[i], prod);
+	}
+	scalar_tail(dst, src, c, i, length, add);
+}
+
+__attribute__((target("avx2")))
+static always_inline void kernel_avx2(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	struct field_tables tables;
+	field_tables_calc(&tables, c);
+	const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables.lo));
+	const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables.hi));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)&src[i]);
+		__m256i prod = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+				_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+		if (add)
+			prod = _mm256_xor_si256(prod, _mm256_loadu_si256((const __m256i*)&dst[i]));
+		_mm256_storeu_si256((__m256i*)&dst[i], prod);
+	}
+	scalar_tail(dst, src, c, i, length, add);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static always_inline void kernel_avx512(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	struct field_tables tables;
+	field_tables_calc(&tables, c);
+	const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables.lo));
+	const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables.hi));
+	const __m512i mask = _mm512_set1_epi8(0x0f);
+	size_t i = 0;
+	while (i < length) {
+		__mmask64 k = length - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (length - i)) - 1;
+		__m512i s = _mm512_maskz_loadu_epi8(k, &src[i]);
+		__m512i prod = _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)),
+				_mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask)));
+		if (add)
+			prod = _mm512_xor_si512(prod, _mm512_maskz_loadu_epi8(k, &dst[i]));
+		_mm512_mask_storeu_epi8(&dst[i], k, prod);
+		i += 64;
+	}
+}
+
+__attribute__((target("gfni,avx2")))
+static always_inline void kernel_gfni_avx2(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	const __m256i constant = _mm256_set1_epi8(c);
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i prod = _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)&src[i]), constant);
+		if (add)
+			prod = _mm256_xor_si256(prod, _mm256_loadu_si256((const __m256i*)&dst[i]));
+		_mm256_storeu_si256((__m256i*)&dst[i], prod);
+	}
+	scalar_tail(dst, src, c, i, length, add);
+}
+
+__attribute__((target("gfni,avx512f,avx512bw")))
+static always_inline void kernel_gfni_avx512(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length, int add) {
+	const __m512i constant = _mm512_set1_epi8(c);
+	size_t i = 0;
+	while (i < length) {
+		__mmask64 k = length - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (length - i)) - 1;
+		__m512i prod = _mm512_gf2p8mul_epi8(_mm512_maskz_loadu_epi8(k, &src[i]), constant);
+		if (add)
+			prod = _mm512_xor_si512(prod, _mm512_maskz_loadu_epi8(k, &dst[i]));
+		_mm512_mask_storeu_epi8(&dst[i], k, prod);
+		i += 64;
+	}
+}
+
+/*
+ * The dot kernels sum the products of up to 255 rows into four output vectors
+ * in registers before storing them, rather than loading and storing dst once
+ * per row, and load each row's constant once per four vectors. The (tiny)
+ * per-row tables are recalculated on every call, so callers should pass a
+ * few hundred bytes or more at a time.
+ */
+__attribute__((target("ssse3")))
+static void kernel_ssse3_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	struct field_tables tables[rows];
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	uint8_t j;
+	for (j = 0; j < rows; j++)
+		field_tables_calc(&tables[j], c[j]);
+	for (; i + 16 <= length; i += 16) {
+		__m128i sum = _mm_setzero_si128();
+		for (j = 0; j < rows; j++) {
+			__m128i s = _mm_loadu_si128((const __m128i*)&src[j][offset + i]);
+			sum = _mm_xor_si128(sum, _mm_xor_si128(
+					_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)tables[j].lo), _mm_and_si128(s, mask)),
+					_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)tables[j].hi), _mm_and_si128(_mm_srli_epi64(s, 4), mask))));
+		}
+		_mm_storeu_si128((__m128i*)&dst[offset + i], sum);
+	}
+	dot_tail(dst, src, c, rows, offset, i, length);
+}
+
+__attribute__((target("avx2")))
+static void kernel_avx2_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	struct field_tables tables[rows];
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	uint8_t j;
+	for (j = 0; j < rows; j++)
+		field_tables_calc(&tables[j], c[j]);
+#define AVX2_PRODUCT(s) _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)), \
+		_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)))
+	for (; i + 128 <= length; i += 128) {
+		__m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+		for (j = 0; j < rows; j++) {
+			const uint8_t* row = &src[j][offset + i];
+			const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[j].lo));
+			const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[j].hi));
+			const __m256i s0 = _mm256_loadu_si256((const __m256i*)row), s1 = _mm256_loadu_si256((const __m256i*)(row + 32));
+			const __m256i s2 = _mm256_loadu_si256((const __m256i*)(row + 64)), s3 = _mm256_loadu_si256((const __m256i*)(row + 96));
+			sum0 = _mm256_xor_si256(sum0, AVX2_PRODUCT(s0));
+			sum1 = _mm256_xor_si256(sum1, AVX2_PRODUCT(s1));
+			sum2 = _mm256_xor_si256(sum2, AVX2_PRODUCT(s2));
+			sum3 = _mm256_xor_si256(sum3, AVX2_PRODUCT(s3));
+		}
+		_mm256_storeu_si256((__m256i*)&dst[offset + i], sum0);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 32], sum1);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 64], sum2);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 96], sum3);
+	}
+#undef AVX2_PRODUCT
+	for (; i + 32 <= length; i += 32) {
+		__m256i sum = _mm256_setzero_si256();
+		for (j = 0; j < rows; j++) {
+			__m256i s = _mm256_loadu_si256((const __m256i*)&src[j][offset + i]);
+			__m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[j].lo));
+			__m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[j].hi));
+			sum = _mm256_xor_si256(sum, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+					_mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask))));
+		}
+		_mm256_storeu_si256((__m256i*)&dst[offset + i], sum);
+	}
+	dot_tail(dst, src, c, rows, offset, i, length);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void kernel_avx512_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	struct field_tables tables[rows];
+	const __m512i mask = _mm512_set1_epi8(0x0f);
+	size_t i = 0;
+	uint8_t j;
+	for (j = 0; j < rows; j++)
+		field_tables_calc(&tables[j], c[j]);
+#define AVX512_PRODUCT(s) _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)), \
+		_mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask)))
+	for (; i + 256 <= length; i += 256) {
+		__m512i sum0 = _mm512_setzero_si512(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+		for (j = 0; j < rows; j++) {
+			const uint8_t* row = &src[j][offset + i];
+			const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables[j].lo));
+			const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables[j].hi));
+			const __m512i s0 = _mm512_loadu_si512(row), s1 = _mm512_loadu_si512(row + 64);
+			const __m512i s2 = _mm512_loadu_si512(row + 128), s3 = _mm512_loadu_si512(row + 192);
+			sum0 = _mm512_xor_si512(sum0, AVX512_PRODUCT(s0));
+			sum1 = _mm512_xor_si512(sum1, AVX512_PRODUCT(s1));
+			sum2 = _mm512_xor_si512(sum2, AVX512_PRODUCT(s2));
+			sum3 = _mm512_xor_si512(sum3, AVX512_PRODUCT(s3));
+		}
+		_mm512_storeu_si512(&dst[offset + i], sum0);
+		_mm512_storeu_si512(&dst[offset + i + 64], sum1);
+		_mm512_storeu_si512(&dst[offset + i + 128], sum2);
+		_mm512_storeu_si512(&dst[offset + i + 192], sum3);
+	}
+#undef AVX512_PRODUCT
+	while (i < length) {
+		__mmask64 k = length - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (length - i)) - 1;
+		__m512i sum = _mm512_setzero_si512();
+		for (j = 0; j < rows; j++) {
+			__m512i s = _mm512_maskz_loadu_epi8(k, &src[j][offset + i]);
+			__m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables[j].lo));
+			__m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)tables[j].hi));
+			sum = _mm512_xor_si512(sum, _mm512_xor_si512(_mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask)),
+					_mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask))));
+		}
+		_mm512_mask_storeu_epi8(&dst[offset + i], k, sum);
+		i += 64;
+	}
+}
+
+__attribute__((target("gfni,avx2")))
+static void kernel_gfni_avx2_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	size_t i = 0;
+	uint8_t j;
+	for (; i + 128 <= length; i += 128) {
+		__m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+		for (j = 0; j < rows; j++) {
+			const uint8_t* row = &src[j][offset + i];
+			const __m256i constant = _mm256_set1_epi8(c[j]);
+			sum0 = _mm256_xor_si256(sum0, _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)row), constant));
+			sum1 = _mm256_xor_si256(sum1, _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)(row + 32)), constant));
+			sum2 = _mm256_xor_si256(sum2, _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)(row + 64)), constant));
+			sum3 = _mm256_xor_si256(sum3, _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)(row + 96)), constant));
+		}
+		_mm256_storeu_si256((__m256i*)&dst[offset + i], sum0);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 32], sum1);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 64], sum2);
+		_mm256_storeu_si256((__m256i*)&dst[offset + i + 96], sum3);
+	}
+	for (; i + 32 <= length; i += 32) {
+		__m256i sum = _mm256_setzero_si256();
+		for (j = 0; j < rows; j++)
+			sum = _mm256_xor_si256(sum, _mm256_gf2p8mul_epi8(_mm256_loadu_si256((const __m256i*)&src[j][offset + i]), _mm256_set1_epi8(c[j])));
+		_mm256_storeu_si256((__m256i*)&dst[offset + i], sum);
+	}
+	dot_tail(dst, src, c, rows, offset, i, length);
+}
+
+__attribute__((target("gfni,avx512f,avx512bw")))
+static void kernel_gfni_avx512_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	size_t i = 0;
+	uint8_t j;
+	for (; i + 256 <= length; i += 256) {
+		__m512i sum0 = _mm512_setzero_si512(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+		for (j = 0; j < rows; j++) {
+			const uint8_t* row = &src[j][offset + i];
+			const __m512i constant = _mm512_set1_epi8(c[j]);
+			sum0 = _mm512_xor_si512(sum0, _mm512_gf2p8mul_epi8(_mm512_loadu_si512(row), constant));
+			sum1 = _mm512_xor_si512(sum1, _mm512_gf2p8mul_epi8(_mm512_loadu_si512(row + 64), constant));
+			sum2 = _mm512_xor_si512(sum2, _mm512_gf2p8mul_epi8(_mm512_loadu_si512(row + 128), constant));
+			sum3 = _mm512_xor_si512(sum3, _mm512_gf2p8mul_epi8(_mm512_loadu_si512(row + 192), constant));
+		}
+		_mm512_storeu_si512(&dst[offset + i], sum0);
+		_mm512_storeu_si512(&dst[offset + i + 64], sum1);
+		_mm512_storeu_si512(&dst[offset + i + 128], sum2);
+		_mm512_storeu_si512(&dst[offset + i + 192], sum3);
+	}
+	while (i < length) {
+		__mmask64 k = length - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (length - i)) - 1;
+		__m512i sum = _mm512_setzero_si512();
+		for (j = 0; j < rows; j++)
+			sum = _mm512_xor_si512(sum, _mm512_gf2p8mul_epi8(_mm512_maskz_loadu_epi8(k, &src[j][offset + i]), _mm512_set1_epi8(c[j])));
+		_mm512_mask_storeu_epi8(&dst[offset + i], k, sum);
+		i += 64;
+	}
+}
+#endif // defined(FIELD_SIMD)
+
+typedef void (*field_kernel_fn)(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length);
+typedef void (*field_dot_fn)(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length);
+
+// Instantiates the multiply and multiply-accumulate variants of a kernel so that add is a constant in each
+#define KERNEL_VARIANTS(name, attributes) \
+	attributes static void name##_mul(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length) { \
+		name(dst, src, c, length, 0); \
+	} \
+	attributes static void name##_mul_add(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length) { \
+		name(dst, src, c, length, 1); \
+	}
+
+KERNEL_VARIANTS(kernel_scalar, )
+KERNEL_VARIANTS(kernel_scalar_ct, )
+
+// The scalar kernels gain nothing from keeping a sum in a register, so their dot kernels add up row by row
+#define DOT_BY_ROWS(name) \
+	static void name##_dot(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) { \
+		uint8_t j; \
+		if (!rows) { \
+			memset(&dst[offset], 0, length); \
+			return; \
+		} \
+		name##_mul(&dst[offset], &src[0][offset], c[0], length); \
+		for (j = 1; j < rows; j++) \
+			name##_mul_add(&dst[offset], &src[j][offset], c[j], length); \
+	}
+
+DOT_BY_ROWS(kernel_scalar)
+DOT_BY_ROWS(kernel_scalar_ct)
+#ifdef FIELD_SIMD
+KERNEL_VARIANTS(kernel_ssse3, __attribute__((target("ssse3"))))
+KERNEL_VARIANTS(kernel_avx2, __attribute__((target("avx2"))))
+KERNEL_VARIANTS(kernel_avx512, __attribute__((target("avx512f,avx512bw"))))
+KERNEL_VARIANTS(kernel_gfni_avx2, __attribute__((target("gfni,avx2"))))
+KERNEL_VARIANTS(kernel_gfni_avx512, __attribute__((target("gfni,avx512f,avx512bw"))))
+#define KERNEL(name, fn) { name, fn##_mul, fn##_mul_add, fn##_dot, 1 }
+#else
+#define KERNEL(name, fn) { name, (void*)0, (void*)0, (void*)0, 1 }
+#endif
+
+// The SIMD kernels keep their lookup tables in registers, so only the
+// plain scalar kernel indexes memory with the source data
+static const struct {
+	const char* name;
+	field_kernel_fn mul, mul_add;
+	field_dot_fn dot;
+	int constant_time;
+} kernels[FIELD_KERNEL_COUNT] = {
+	[FIELD_KERNEL_SCALAR] = { "scalar", kernel_scalar_mul, kernel_scalar_mul_add, kernel_scalar_dot, 0 },
+	[FIELD_KERNEL_SCALAR_CT] = { "scalar-ct", kernel_scalar_ct_mul, kernel_scalar_ct_mul_add, kernel_scalar_ct_dot, 1 },
+	[FIELD_KERNEL_SSSE3] = KERNEL("ssse3", kernel_ssse3),
+	[FIELD_KERNEL_AVX2] = KERNEL("avx2", kernel_avx2),
+	[FIELD_KERNEL_AVX512] = KERNEL("avx512", kernel_avx512),
+	[FIELD_KERNEL_GFNI_AVX2] = KERNEL("gfni-avx2", kernel_gfni_avx2),
+	[FIELD_KERNEL_GFNI_AVX512] = KERNEL("gfni-avx512", kernel_gfni_avx512),
+};
+
+/**
+ * Whether the running CPU can execute the given kernel
+ */
+int field_kernel_supported(enum field_kernel kernel) {
+	switch (kernel) {
+	case FIELD_KERNEL_SCALAR:
+	case FIELD_KERNEL_SCALAR_CT:
+		return 1;
+#ifdef FIELD_SIMD
+	case FIELD_KERNEL_SSSE3:
+		return __builtin_cpu_supports("ssse3");
+	case FIELD_KERNEL_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case FIELD_KERNEL_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+	case FIELD_KERNEL_GFNI_AVX2:
+		return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx2");
+	case FIELD_KERNEL_GFNI_AVX512:
+		return __builtin_cpu_supports("gfni") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Whether the kernel never indexes memory with the data it multiplies
+ */
+int field_kernel_constant_time(enum field_kernel kernel) {
+	CHECKSTATE(kernel < FIELD_KERNEL_COUNT);
+	return kernels[kernel].constant_time;
+}
+
+#ifndef FIELD_CONSTANT_TIME
+static enum field_kernel selected_kernel = FIELD_KERNEL_SCALAR;
+#else
+static enum field_kernel selected_kernel = FIELD_KERNEL_SCALAR_CT;
+#endif
+
+/**
+ * Selects the kernel used by the buffer functions (by default the fastest supported one, which
+ * is always a constant-time one when built with -DFIELD_CONSTANT_TIME)
+ */
+void field_kernel_select(enum field_kernel kernel) {
+	CHECKSTATE(kernel < FIELD_KERNEL_COUNT && field_kernel_supported(kernel));
+#ifdef FIELD_CONSTANT_TIME
+	CHECKSTATE(field_kernel_constant_time(kernel));
+#endif
+	selected_kernel = kernel;
+}
+
+enum field_kernel field_kernel_selected(void) {
+	return selected_kernel;
+}
+
+const char* field_kernel_name(enum field_kernel kernel) {
+	CHECKSTATE(kernel < FIELD_KERNEL_COUNT);
+	return kernels[kernel].name;
+}
+
+#ifdef FIELD_SIMD
+// Pick the kernel before main() (and any threads) start, so that the hot path is a plain load
+__attribute__((constructor))
+static void field_kernel_init(void) {
+	// Ordered from fastest to slowest
+	static const enum field_kernel preference[] = {
+		FIELD_KERNEL_GFNI_AVX512, FIELD_KERNEL_GFNI_AVX2, FIELD_KERNEL_AVX512,
+		FIELD_KERNEL_AVX2, FIELD_KERNEL_SSSE3,
+	};
+	size_t i;
+	__builtin_cpu_init();
+	for (i = 0; i < sizeof(preference) / sizeof(preference[0]); i++) {
+		if (field_kernel_supported(preference[i])) {
+			selected_kernel = preference[i];
+			return;
+		}
+	}
+}
+#endif
+
+/**
+ * dst[i] = c * src[i] for every i < length
+ */
+void field_mul_buf(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length) {
+	kernels[selected_kernel].mul(dst, src, c, length);
+}
+
+/**
+ * dst[i] += c * src[i] for every i < length
+ */
+void field_mul_add_buf(uint8_t dst[], const uint8_t src[], uint8_t c, size_t length) {
+	kernels[selected_kernel].mul_add(dst, src, c, length);
+}
+
+/**
+ * dst[offset + i] = sum over j < rows of c[j] * src[j][offset + i] for every i < length
+ */
+void field_dot_buf(uint8_t dst[], const uint8_t* const src[], const uint8_t c[], uint8_t rows, size_t offset, size_t length) {
+	kernels[selected_kernel].dot(dst, src, c, rows, offset, length);
+}
@@ -0,0 +1,267 @@
+/*
+ * Load generator for the split/combine server (-d): measures request latency under pipelining
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shamirssecret.h"
+#include "server.h"
+
+/*
+ * Each connection first splits requests secrets and then combines every one of them again
+ * from k of its shares (checking the result), each phase keeping up to depth requests in
+ * flight: one thread writes requests whenever fewer than depth are outstanding while another
+ * reads the responses, so neither side can block the other on a full socket buffer.
+ */
+struct connection {
+	const char* path;
+	unsigned requests, depth;
+	uint8_t n, k;
+	uint32_t length;
+	unsigned index;
+	int fd;
+	sem_t slots;
+	uint8_t* shares;	// [requests][n][1 + length], the split responses
+	double* sent;		// [requests], when each request of the current phase was written
+	double* latency[2];	// [requests] per phase
+	double seconds[2];
+	unsigned mismatches;
+	volatile int failed;
+};
+
+enum { PHASE_SPLIT, PHASE_COMBINE };
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t secret_byte(const struct connection* c, unsigned r, uint32_t b) {
+	return c->index * 101 + r * 31 + b * 7;
+}
+
+static size_t share_span(const struct connection* c) {
+	return 1 + (size_t)c->length;
+}
+
+struct reader_args {
+	struct connection* c;
+	int phase;
+};
+
+static void* read_responses(void* arg) {
+	struct reader_args* args = arg;
+	struct connection* c = args->c;
+	const size_t body_length = args->phase == PHASE_SPLIT ? c->n * share_span(c) : c->length;
+	uint8_t encoded[SERVER_HEADER_SIZE];
+	uint8_t* body = malloc(body_length);
+	if (!body) {
+		c->failed = 1;
+		return (void*)0;
+	}
+	for (unsigned r = 0; r < c->requests; r++) {
+		struct server_header response;
+		if (!server_read_full(c->fd, encoded, SERVER_HEADER_SIZE)) {
+			c->failed = 1;
+			break;
+		}
+		server_header_decode(&response, encoded);
+		if (response.op != SERVER_OK || response.id != r || !server_read_full(c->fd, body, body_length)) {
+			c->failed = 1;
+			break;
+		}
+		c->latency[args->phase][r] = now() - c->sent[r];
+		sem_post(&c->slots);
+		if (args->phase == PHASE_SPLIT)
+			memcpy(&c->shares[r * c->n * share_span(c)], body, body_length);
+		else
+			for (uint32_t b = 0; b < c->length; b++)
+				if (body[b] != secret_byte(c, r, b)) {
+					c->mismatches++;
+					break;
+				}
+	}
+	// Let the writer out if it is waiting for a response which will never come
+	if (c->failed)
+		for (unsigned i = 0; i < c->requests; i++)
+			sem_post(&c->slots);
+	free(body);
+	return (void*)0;
+}
+
+static void run_phase(struct connection* c, int phase) {
+	const size_t body_length = phase == PHASE_SPLIT ? c->length : c->k * share_span(c);
+	uint8_t* request = malloc(SERVER_HEADER_SIZE + body_length);
+	struct reader_args args = { c, phase };
+	pthread_t reader;
+	if (!request || sem_init(&c->slots, 0, c->depth) != 0 || pthread_create(&reader, (void*)0, read_responses, &args) != 0) {
+		c->failed = 1;
+		free(request);
+		return;
+	}
+	const double start = now();
+	for (unsigned r = 0; r < c->requests && !c->failed; r++) {
+		struct server_header header = { phase == PHASE_SPLIT ? SERVER_OP_SPLIT : SERVER_OP_COMBINE, phase == PHASE_SPLIT ? c->n : c->k, c->k, r, c->length };
+		server_header_encode(request, &header);
+		if (phase == PHASE_SPLIT) {
+			for (uint32_t b = 0; b < c->length; b++)
+				request[SERVER_HEADER_SIZE + b] = secret_byte(c, r, b);
+		} else {
+			// A different k of the shares each time
+			for (uint8_t j = 0; j < c->k; j++)
+				memcpy(&request[SERVER_HEADER_SIZE + j * share_span(c)], &c->shares[(r * c->n + (r + j) % c->n) * share_span(c)], share_span(c));
+		}
+		sem_wait(&c->slots);
+		c->sent[r] = now();
+		if (!server_write_full(c->fd, request, SERVER_HEADER_SIZE + body_length))
+			c->failed = 1;
+	}
+	pthread_join(reader, (void*)0);
+	c->seconds[phase] = now() - start;
+	sem_destroy(&c->slots);
+	free(request);
+}
+
+static void* run_connection(void* arg) {
+	struct connection* c = arg;
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, c->path, sizeof(addr.sun_path) - 1);
+	c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (c->fd < 0 || connect(c->fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		c->failed = 1;
+		return (void*)0;
+	}
+	run_phase(c, PHASE_SPLIT);
+	if (!c->failed)
+		run_phase(c, PHASE_COMBINE);
+	close(c->fd);
+	return (void*)0;
+}
+
+static int compare_double(const void* a, const void* b) {
+	const double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void print_phase(const char* name, struct connection connections[], unsigned count, unsigned requests, int phase, int last) {
+	double* all = malloc((size_t)count * requests * sizeof(double));
+	double seconds = 0;
+	if (!all) {
+		fprintf(stderr, "Could not allocate latencies\n");
+		exit(1);
+	}
+	for (unsigned i = 0; i < count; i++) {
+		memcpy(&all[(size_t)i * requests], connections[i].latency[phase], requests * sizeof(double));
+		if (connections[i].seconds[phase] > seconds)
+			seconds = connections[i].seconds[phase];
+	}
+	const size_t total = (size_t)count * requests;
+	qsort(all, total, sizeof(double), compare_double);
+	printf("  \"%s\": {\"requests_per_s\": %.0f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}%s\n", name, total / seconds,
+			all[total / 2] * 1e6, all[total * 99 / 100] * 1e6, all[total - 1] * 1e6, last ? "" : ",");
+	free(all);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2 || argc > 8) {
+		fprintf(stderr, "Usage: %s <socket path> [connections [requests per connection [pipeline depth [secret length [n [k]]]]]]\n", argv[0]);
+		return 1;
+	}
+	const unsigned count = argc > 2 ? atoi(argv[2]) : 4, requests = argc > 3 ? atoi(argv[3]) : 10000, depth = argc > 4 ? atoi(argv[4]) : 8;
+	const int length = argc > 5 ? atoi(argv[5]) : 32, n = argc > 6 ? atoi(argv[6]) : 5, k = argc > 7 ? atoi(argv[7]) : 3;
+	if (count == 0 || requests == 0 || depth == 0 || length <= 0 || length > SERVER_MAX_LENGTH || n <= 0 || n >= P || k <= 0 || k > n) {
+		fprintf(stderr, "connections, requests and depth must be > 0, length at most %u and 0 < k <= n < %u\n", SERVER_MAX_LENGTH, P);
+		return 1;
+	}
+
+	struct connection* connections = calloc(count, sizeof(struct connection));
+	pthread_t* threads = malloc(count * sizeof(pthread_t));
+	if (!connections || !threads) {
+		fprintf(stderr, "Could not allocate connections\n");
+		return 1;
+	}
+	for (unsigned i = 0; i < count; i++) {
+		struct connection* c = &connections[i];
+		c->path = argv[1];
+		c->requests = requests;
+		c->depth = depth;
+		c->n = n;
+		c->k = k;
+		c->length = length;
+		c->index = i;
+		c->shares = malloc((size_t)requests * n * (1 + length));
+		c->sent = malloc(requests * sizeof(double));
+		c->latency[PHASE_SPLIT] = malloc(requests * sizeof(double));
+		c->latency[PHASE_COMBINE] = malloc(requests * sizeof(double));
+		if (!c->shares || !c->sent || !c->latency[PHASE_SPLIT] || !c->latency[PHASE_COMBINE]) {
+			fprintf(stderr, "Could not allocate %u requests\n", requests);
+			return 1;
+		}
+	}
+	for (unsigned i = 0; i < count; i++)
+		if (pthread_create(&threads[i], (void*)0, run_connection, &connections[i]) != 0) {
+			fprintf(stderr, "Could not start %u connections\n", count);
+			return 1;
+		}
+	unsigned mismatches = 0;
+	int failed = 0;
+	for (unsigned i = 0; i < count; i++) {
+		pthread_join(threads[i], (void*)0);
+		mismatches += connections[i].mismatches;
+		failed |= connections[i].failed;
+	}
+	if (failed) {
+		fprintf(stderr, "Requests to %s failed\n", argv[1]);
+		return 1;
+	}
+
+	printf("{\n");
+	printf("  \"connections\": %u, \"requests\": %u, \"depth\": %u, \"length\": %d, \"n\": %d, \"k\": %d,\n", count, requests, depth, length, n, k);
+	print_phase("split", connections, count, requests, PHASE_SPLIT, 0);
+	print_phase("combine", connections, count, requests, PHASE_COMBINE, 1);
+	printf("}\n");
+	if (mismatches) {
+		fprintf(stderr, "%u combined secrets did not match what was split\n", mismatches);
+		return 1;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		free(connections[i].shares);
+		free(connections[i].sent);
+		free(connections[i].latency[PHASE_SPLIT]);
+		free(connections[i].latency[PHASE_COMBINE]);
+	}
+	free(connections);
+	free(threads);
+	return 0;
+}
@@ -29,273 +29,1523 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "shamirssecret.h"
+#include "share.h"
+#include "server.h"
+#include "secmem.h"
 
-#define MAX_LENGTH 1024
+// Secrets and shares are streamed through memory in blocks of this many bytes
+#define BLOCK_SIZE 4096
 #define ERROREXIT(str...) {fprintf(stderr, str); exit(1);}
+// With -m, each file is mapped this many blocks at a time so that no more than that of it is ever in memory at once
+#define MAP_WINDOW_BLOCKS 16
+// Over GF(2^16) and GF(2^32) (-w) n and k may go up to this, well past the point where every share can be open at once
+#define MAX_WIDE_SHARES 65535
 
-#ifndef RAND_SOURCE
-#define RAND_SOURCE "/dev/random"
+#ifdef RAND_SOURCE
+// Seeds from RAND_SOURCE (eg a hardware RNG device) instead of getrandom()
+static int file_read(void* ctx, uint8_t buf[], size_t length) {
+	return fread(buf, 1, length, ctx) == length;
+}
 #endif
 
 #ifndef TEST
-static void derive_missing_part(uint8_t total_shares, uint8_t shares_required, bool parts_have[], const uint8_t* split_version, const uint8_t* split_x, uint8_t split_index, uint8_t split_size) {
-	const uint8_t (*D)[split_size] = (const uint8_t (*)[split_size])split_version;
-	uint8_t x[shares_required], q[shares_required];
-
-	// Fill in x/q with the selected shares
-	uint16_t x_pos = 0;
-	for (uint8_t i = 0; i < P-1; i++) {
-		if (parts_have[i]) {
-			x[x_pos] = split_x[i];
-			q[x_pos++] = D[i][split_index];
-		}
-	}
-	assert(x_pos == shares_required - 1);
-
-	// Now loop through ALL x we didn't already set (despite not having that many
-	// shares, because more shares could be added arbitrarily, any x should not be
-	// able to rule out any possible secrets) and try each possible q, making sure
-	// that each q gives us a new possibility for the secret.
-	for (uint16_t final_x = 1; final_x < P; final_x++) { 
-		bool x_already_used = false;
-		for (uint8_t j = 0; j < shares_required; j++) {
-			if (x[j] == final_x)
-				x_already_used = true;
+// Maps length bytes of fd from offset (which need not be page-aligned), returning a pointer to offset
+static uint8_t* map_window(int fd, off_t offset, size_t length, int prot, int flags) {
+	const off_t skip = offset % sysconf(_SC_PAGESIZE);
+	uint8_t* map = mmap((void*)0, length + skip, prot, flags, fd, offset - skip);
+	return map == MAP_FAILED ? (void*)0 : map + skip;
+}
+
+static void unmap_window(uint8_t* window, off_t offset, size_t length) {
+	const off_t skip = offset % sysconf(_SC_PAGESIZE);
+	const int unmapped = munmap(window - skip, length + skip);
+	assert(unmapped == 0);
+	(void)unmapped;
+}
+
+// Returns the size of the regular file open as fd, or -1 if it is not a regular file
+static off_t file_size(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return -1;
+	return st.st_size;
+}
+
+// The DRBG is seeded once and then streams coefficients (and X coordinates and split IDs) in bulk
+static struct drbg* seed_drbg(void) {
+#ifdef RAND_SOURCE
+	FILE* seed_file = fopen(RAND_SOURCE, "r");
+	if (!seed_file)
+		ERROREXIT("Could not open %s for reading.\n", RAND_SOURCE)
+	const struct random_source seed_source = { file_read, seed_file };
+#else
+	const struct random_source seed_source = randomSystem;
+#endif
+	struct drbg* drbg = drbgCreate(&seed_source);
+	if (!drbg)
+		ERROREXIT("Could not seed random number generator\n")
+#ifdef RAND_SOURCE
+	fclose(seed_file);
+#endif
+	return drbg;
+}
+
+/*
+ * Everything derived from the secret (its blocks, the random coefficients, combined output and
+ * keys) lives in a locked arena sized for exactly the buffers each mode needs, rather than on
+ * the heap or the stack. Secret and output files are unbuffered so that stdio never copies the
+ * secret into memory of its own.
+ */
+// capacity is the sum of secmem_size over the buffers which will be allocated from it
+static struct secmem* secure_arena(size_t capacity) {
+	struct secmem* arena = secmem_create(capacity);
+	if (!arena)
+		ERROREXIT("Could not lock %lu bytes of memory for the secret (see ulimit -l)\n", capacity)
+	return arena;
+}
+
+// The library's secrets (DRBG and AEAD state, and its scratch buffers) each get a locked mapping of their own
+static void* locked_alloc(void* ctx, size_t length) {
+	return secmem_malloc(length);
+}
+
+static void locked_free(void* ctx, void* ptr) {
+	secmem_free(ptr);
+}
+
+static void* secure_alloc(struct secmem* arena, size_t length) {
+	void* ptr = secmem_alloc(arena, length);
+	if (!ptr)
+		ERROREXIT("Ran out of locked memory for the secret\n")
+	return ptr;
+}
+
+// The secret being combined into until it is complete, so that no error exit leaves part of it behind
+static const char* partial_output = (void*)0;
+// Likewise the first partial_share_count shares being written (base<i>), until every one has its header
+static const char* partial_share_base = (void*)0;
+static uint32_t partial_share_count = 0;
+
+static void remove_partial_output(void) {
+	if (partial_output)
+		remove(partial_output);
+	if (partial_share_base) {
+		char name[strlen(partial_share_base) + 11];
+		for (uint32_t i = 0; i < partial_share_count; i++) {
+			sprintf(name, "%s%u", partial_share_base, i);
+			remove(name);
 		}
-		if (x_already_used)
+	}
+}
+
+static FILE* open_output(const char* name) {
+	FILE* fp = fopen(name, "w+");
+	if (!fp)
+		ERROREXIT("Could not open output file %s\n", name)
+	setvbuf(fp, (void*)0, _IONBF, 0);
+	partial_output = name;
+	return fp;
+}
+
+static void finish_output(FILE* fp) {
+	if (fclose(fp) != 0)
+		ERROREXIT("Could not finish writing %s\n", partial_output)
+	partial_output = (void*)0;
+}
+
+// Picks total_shares distinct nonzero X coordinates (clear of the secret points of packed sharing), at random or (--sequential-x) as 1 .. total_shares
+static void pick_x(struct drbg* drbg, uint8_t x[], uint8_t total_shares, uint8_t packing, bool sequential) {
+	if (sequential) {
+		for (uint32_t i = 0; i < total_shares; i++)
+			x[i] = i + 1;
+	} else
+		drbgPickPackedX(drbg, x, total_shares, packing);
+}
+
+/*
+ * Opens share base<i> for each i < count, leaving room for the header, which is only written
+ * (by finish_share) once the payload's length is known
+ */
+static void create_shares(const char* base, FILE* fps[], struct share_writer writers[], uint32_t count) {
+	const uint8_t placeholder[SHARE_HEADER_SIZE] = { 0 };
+	char name[strlen(base) + 11];
+	strcpy(name, base);
+	partial_share_base = base;
+	for (uint32_t i = 0; i < count; i++) {
+		sprintf(name + strlen(base), "%u", i);
+		fps[i] = fopen(name, "w+");
+		if (!fps[i])
+			ERROREXIT("Could not open output file %s\n", name)
+		partial_share_count = i + 1;
+
+		if (fwrite(placeholder, 1, SHARE_HEADER_SIZE, fps[i]) != SHARE_HEADER_SIZE)
+			ERROREXIT("Could not write %u bytes to %s\n", SHARE_HEADER_SIZE, name)
+		share_writer_init(&writers[i]);
+	}
+}
+
+// Once every share (and anything else written alongside them) is finished they are kept on exit
+static void finish_shares(void) {
+	partial_share_base = (void*)0;
+	partial_share_count = 0;
+}
+
+// Appends the chunk index after the payload, fills in the header and closes share i
+static void finish_share(FILE* fp, struct share_writer* writer, struct share_header* header, uint32_t i) {
+	uint8_t encoded[SHARE_HEADER_SIZE];
+	header->payload_length = writer->length;
+	share_header_encode(encoded, header);
+	if (fseeko(fp, SHARE_HEADER_SIZE + header->payload_length, SEEK_SET) != 0 || !share_writer_finish(writer, fp) ||
+			fseeko(fp, 0, SEEK_SET) != 0 || fwrite(encoded, 1, SHARE_HEADER_SIZE, fp) != SHARE_HEADER_SIZE ||
+			fclose(fp) != 0)
+		ERROREXIT("Could not finish writing share %u\n", i)
+}
+
+static void open_share(const char* name, FILE** fp, struct share_reader* reader) {
+	*fp = fopen(name, "r");
+	if (!*fp)
+		ERROREXIT("Couldn't open file %s for reading.\n", name)
+	switch (share_reader_open(reader, *fp)) {
+	case SHARE_OPEN_OK:
+		break;
+	case SHARE_OPEN_SHORT:
+		ERROREXIT("Share %s is truncated or has trailing data\n", name)
+	case SHARE_OPEN_CORRUPT:
+		ERROREXIT("Share %s has a corrupt header\n", name)
+	case SHARE_OPEN_UNSUPPORTED:
+		ERROREXIT("Share %s is in a format this version does not understand\n", name)
+	default:
+		ERROREXIT("Couldn't read the header of %s\n", name)
+	}
+}
+
+// Whether two headers say they are of the same split (the key shares in their mode data aside)
+static bool same_split(const struct share_header* header, const struct share_header* first) {
+	return memcmp(header->split_id, first->split_id, sizeof(first->split_id)) == 0 && header->field_bits == first->field_bits &&
+		header->k == first->k && header->n == first->n &&
+		header->mode == first->mode && header->packing == first->packing && header->chunk_size == first->chunk_size &&
+		header->secret_length == first->secret_length &&
+		!((header->mode == SHARE_MODE_DISPERSED || header->mode == SHARE_MODE_VERIFIABLE) &&
+		  memcmp(&header->mode_data[AEAD_KEY_SIZE], &first->mode_data[AEAD_KEY_SIZE], AEAD_TAG_SIZE) != 0);
+}
+
+// Rejects shares which could not have come from the same split before doing any maths on them
+static void check_same_split(const struct share_reader readers[], char* const files[], uint32_t count) {
+	const struct share_header* first = &readers[0].header;
+	for (uint32_t i = 0; i < count; i++) {
+		const struct share_header* header = &readers[i].header;
+		if (readers[i].legacy != readers[0].legacy)
+			ERROREXIT("%s and %s are not in the same format\n", files[i], files[0])
+		if (!readers[i].legacy && !same_split(header, first))
+			ERROREXIT("%s and %s are not shares of the same secret\n", files[i], files[0])
+		if (header->payload_length != first->payload_length)
+			ERROREXIT("Share %s is %s than %s\n", files[i], header->payload_length > first->payload_length ? "longer" : "shorter", files[0])
+		if (header->x == 0)
+			ERROREXIT("Share %s has an x coordinate of 0\n", files[i])
+		for (uint32_t j = 0; j < i; j++) {
+			if (readers[j].header.x == header->x)
+				ERROREXIT("%s and %s are the same share\n", files[j], files[i])
+		}
+	}
+}
+
+// Moves the shares which are to be kept to the front, closing the rest, and returns how many are left
+static uint8_t keep_shares(const bool keep[], char* files[], FILE* files_fps[], struct share_reader readers[], uint8_t x[], uint8_t count) {
+	uint8_t kept = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		if (!keep[i]) {
+			fclose(files_fps[i]);
+			share_reader_free(&readers[i]);
 			continue;
+		}
+		files[kept] = files[i];
+		files_fps[kept] = files_fps[i];
+		readers[kept] = readers[i];
+		x[kept++] = x[i];
+	}
+	return kept;
+}
+
+/*
+ * With -V the commitments, rather than whichever share happens to come first, say which split the
+ * shares are of. Leaves out (with a warning) shares of another split, then ones which don't match
+ * the commitments, then ones whose header disagrees with that of most of the rest, so that no one
+ * bad share can stop the combine. Returns how many shares are left at the front of the arrays.
+ */
+static uint8_t verify_commitments(const char* commitments_file, char* files[], FILE* files_fps[], struct share_reader readers[], uint8_t x[],
+		uint8_t count, uint8_t shares_required) {
+	uint8_t commitments[P - 1][VSS_POINT_SIZE], split_id[16], commitments_k;
+	FILE* fp = fopen(commitments_file, "r");
+	if (!fp || !share_commitments_read(fp, split_id, commitments, &commitments_k))
+		ERROREXIT("Could not read commitments from %s\n", commitments_file)
+	fclose(fp);
+	if (commitments_k != shares_required)
+		ERROREXIT("%s are not the commitments for these shares\n", commitments_file)
+
+	bool keep[count];
+	for (uint8_t i = 0; i < count; i++) {
+		const struct share_header* header = &readers[i].header;
+		keep[i] = !readers[i].legacy && header->mode == SHARE_MODE_VERIFIABLE && header->k == shares_required && header->x != 0 &&
+			memcmp(header->split_id, split_id, sizeof(split_id)) == 0;
+		if (!keep[i])
+			fprintf(stderr, "Share %s is not of the split %s are for, leaving it out\n", files[i], commitments_file);
+	}
+	count = keep_shares(keep, files, files_fps, readers, x, count);
+
+	// Check every share at once, and only go through them one by one to find out which are bad
+	struct secmem* vss_arena = secure_arena(secmem_size(count * VSS_SCALAR_SIZE));
+	uint8_t (*vss_shares)[VSS_SCALAR_SIZE] = secure_alloc(vss_arena, sizeof(uint8_t[count][VSS_SCALAR_SIZE]));
+	for (uint8_t i = 0; i < count; i++)
+		memcpy(vss_shares[i], readers[i].header.mode_data, VSS_SCALAR_SIZE);
+	if (count && !vssVerifyBatch((const uint8_t (*)[VSS_POINT_SIZE])commitments, shares_required, x,
+				(const uint8_t (*)[VSS_SCALAR_SIZE])vss_shares, count, &randomSystem)) {
+		for (uint8_t i = 0; i < count; i++) {
+			keep[i] = vssVerify((const uint8_t (*)[VSS_POINT_SIZE])commitments, shares_required, x[i], vss_shares[i]);
+			if (!keep[i])
+				fprintf(stderr, "Share %s does not match the commitments, leaving it out\n", files[i]);
+		}
+		count = keep_shares(keep, files, files_fps, readers, x, count);
+	}
+	secmem_destroy(vss_arena);
+	if (count < shares_required)
+		ERROREXIT("Only %u shares match the commitments, but %u are needed\n", count, shares_required)
+
+	// The rest of the header (the tag and lengths) isn't covered by the commitments, so go with what most shares say
+	uint8_t reference = 0, most = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		uint8_t agree = 0;
+		for (uint8_t j = 0; j < count; j++)
+			agree += same_split(&readers[j].header, &readers[i].header) && readers[j].header.payload_length == readers[i].header.payload_length;
+		if (agree > most) {
+			most = agree;
+			reference = i;
+		}
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		keep[i] = same_split(&readers[i].header, &readers[reference].header) &&
+			readers[i].header.payload_length == readers[reference].header.payload_length;
+		if (!keep[i])
+			fprintf(stderr, "Share %s disagrees with the other shares about the secret, leaving it out\n", files[i]);
+	}
+	count = keep_shares(keep, files, files_fps, readers, x, count);
+	if (count < shares_required)
+		ERROREXIT("Only %u shares match the commitments and agree about the secret, but %u are needed\n", count, shares_required)
+	printf("Verified %u shares against the commitments\n", count);
+	return count;
+}
+
+/*
+ * Splits secret_file straight from a read-only mapping into writable mappings of the share files.
+ * Each share file is already open with room left for its header and is preallocated here, so the
+ * kernels never fault on a hole or run out of space half-way through.
+ */
+static size_t split_mapped(struct pool* pool, struct drbg* drbg, const struct encoder* encoder, FILE* secret_file, FILE* out_fps[],
+		struct share_writer writers[], uint8_t total_shares, uint8_t shares_required, size_t window_size) {
+	const off_t secret_length = file_size(fileno(secret_file));
+	if (secret_length < 0)
+		ERROREXIT("-m requires the secret to be a regular file\n")
+	if (secret_length == 0)
+		ERROREXIT("Secret may not be empty\n")
+
+	for (uint8_t i = 0; i < total_shares; i++) {
+		if (fflush(out_fps[i]) != 0 || posix_fallocate(fileno(out_fps[i]), 0, SHARE_HEADER_SIZE + secret_length) != 0)
+			ERROREXIT("Could not allocate %lu bytes for share %u\n", SHARE_HEADER_SIZE + secret_length, i)
+	}
+
+	struct secmem* arena = secure_arena(secmem_size((shares_required - 1) * window_size));
+	uint8_t* random = secure_alloc(arena, (shares_required - 1) * window_size);
+	uint8_t* shares[total_shares];
+
+	for (off_t offset = 0; offset < secret_length; offset += window_size) {
+		const size_t length = secret_length - offset < window_size ? secret_length - offset : window_size;
+		const uint8_t* secret = map_window(fileno(secret_file), offset, length, PROT_READ, MAP_PRIVATE);
+		if (!secret)
+			ERROREXIT("Could not map %lu bytes of the secret\n", length)
+		for (uint8_t i = 0; i < total_shares; i++) {
+			shares[i] = map_window(fileno(out_fps[i]), SHARE_HEADER_SIZE + offset, length, PROT_READ | PROT_WRITE, MAP_SHARED);
+			if (!shares[i])
+				ERROREXIT("Could not map %lu bytes of share %u\n", length, i)
+		}
+
+		if (shares_required > 1)
+			drbgGenerate(drbg, random, (shares_required - 1) * length);
+		encoderBufferParallel(pool, encoder, shares, secret, random, length);
+
+		// The secret's pages belong to the file so cannot be wiped, but they can be dropped from the page cache
+		unmap_window((uint8_t*)secret, offset, length);
+		posix_fadvise(fileno(secret_file), offset, length, POSIX_FADV_DONTNEED);
+		for (uint8_t i = 0; i < total_shares; i++) {
+			if (!share_writer_update(&writers[i], shares[i], length))
+				ERROREXIT("Could not allocate chunk index\n")
+			unmap_window(shares[i], SHARE_HEADER_SIZE + offset, length);
+		}
+		printf("Finished processing %lu bytes.\n", offset + length);
+	}
+
+	secmem_destroy(arena);
+	return secret_length;
+}
+
+/*
+ * Combines from read-only mappings of the shares' payloads straight into a preallocated
+ * writable mapping of out_file, checking each share's chunks as they are mapped.
+ */
+static size_t combine_mapped(struct pool* pool, const struct combiner* combiner, FILE* files_fps[], char* files[],
+		struct share_reader readers[], uint8_t shares_required, FILE* out_file, const char* out_file_name, size_t window_size) {
+	for (uint8_t j = 0; j < shares_required; j++) {
+		if (file_size(fileno(files_fps[j])) < 0)
+			ERROREXIT("-m requires shares to be regular files\n")
+	}
+	const off_t secret_length = readers[0].header.payload_length;
+	if (secret_length == 0)
+		return 0;
+
+	if (posix_fallocate(fileno(out_file), 0, secret_length) != 0)
+		ERROREXIT("Could not allocate %lu bytes for %s\n", secret_length, out_file_name)
+
+	const uint8_t* shares[shares_required];
+	for (off_t offset = 0; offset < secret_length; offset += window_size) {
+		const size_t length = secret_length - offset < window_size ? secret_length - offset : window_size;
+		for (uint8_t j = 0; j < shares_required; j++) {
+			shares[j] = map_window(fileno(files_fps[j]), readers[j].payload_offset + offset, length, PROT_READ, MAP_PRIVATE);
+			if (!shares[j])
+				ERROREXIT("Could not map %lu bytes of %s\n", length, files[j])
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], shares[j], length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+		uint8_t* secret = map_window(fileno(out_file), offset, length, PROT_READ | PROT_WRITE, MAP_SHARED);
+		if (!secret)
+			ERROREXIT("Could not map %lu bytes of %s\n", length, out_file_name)
+
+		combinerBufferParallel(pool, combiner, secret, shares, length);
+
+		// Write the secret out now so that its pages can be dropped from the page cache
+		if (msync(secret, length, MS_SYNC) != 0)
+			ERROREXIT("Could not write %lu bytes to %s\n", length, out_file_name)
+		unmap_window(secret, offset, length);
+		posix_fadvise(fileno(out_file), offset, length, POSIX_FADV_DONTNEED);
+		for (uint8_t j = 0; j < shares_required; j++)
+			unmap_window((uint8_t*)shares[j], readers[j].payload_offset + offset, length);
+	}
+	return secret_length;
+}
+
+/*
+ * Combines only bytes [offset, offset + length) of the secret, starting each share at the chunk
+ * holding offset so that every byte used is still checked against the chunk index, and stopping
+ * at the end of the chunk holding the last byte. Shares are read in steps of step bytes, either
+ * through buffers or (with use_mmap) by mapping just that part of each share.
+ */
+static void combine_range(struct pool* pool, const struct combiner* combiner, FILE* files_fps[], char* files[],
+		struct share_reader readers[], uint8_t shares_required, bool use_mmap, uint64_t offset, uint64_t length,
+		FILE* out_file, const char* out_file_name, size_t step) {
+	const uint64_t payload_length = readers[0].header.payload_length;
+	uint64_t start = 0, end = offset + length;
+	for (uint8_t j = 0; j < shares_required; j++) {
+		if (!share_reader_seek(&readers[j], files_fps[j], offset, &start))
+			ERROREXIT("Couldn't seek to byte %lu of %s\n", offset, files[j])
+	}
+	if (!readers[0].legacy) {
+		const uint32_t chunk_size = readers[0].header.chunk_size;
+		end = (end + chunk_size - 1) / chunk_size * chunk_size;
+		if (end > payload_length)
+			end = payload_length;
+	}
+
+	struct secmem* arena = secure_arena(secmem_size(step) + (use_mmap ? 0 : secmem_size(shares_required * step)));
+	uint8_t* secret = secure_alloc(arena, step);
+	uint8_t (*Q)[step] = use_mmap ? (void*)0 : secure_alloc(arena, sizeof(uint8_t[shares_required][step]));
+	const uint8_t* shares[shares_required];
+	for (uint64_t position = start; position < end; position += step) {
+		const size_t read_length = end - position < step ? end - position : step;
+		for (uint8_t j = 0; j < shares_required; j++) {
+			if (use_mmap) {
+				shares[j] = map_window(fileno(files_fps[j]), readers[j].payload_offset + position, read_length, PROT_READ, MAP_PRIVATE);
+				if (!shares[j])
+					ERROREXIT("Could not map %lu bytes of %s\n", read_length, files[j])
+			} else {
+				if (fread(Q[j], 1, read_length, files_fps[j]) != read_length)
+					ERROREXIT("Couldn't read next %lu bytes from %s\n", read_length, files[j])
+				shares[j] = Q[j];
+			}
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], shares[j], read_length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+
+		// Only the part of this step inside the range is combined
+		const uint64_t from = position > offset ? position : offset;
+		const uint64_t to = position + read_length < offset + length ? position + read_length : offset + length;
+		if (from < to) {
+			const uint8_t* range_shares[shares_required];
+			for (uint8_t j = 0; j < shares_required; j++)
+				range_shares[j] = shares[j] + (from - position);
+			combinerBufferParallel(pool, combiner, secret, range_shares, to - from);
+			if (fwrite(secret, 1, to - from, out_file) != to - from)
+				ERROREXIT("Could not write %lu bytes to %s\n", to - from, out_file_name)
+		}
+
+		for (uint8_t j = 0; j < shares_required && use_mmap; j++)
+			unmap_window((uint8_t*)shares[j], readers[j].payload_offset + position, read_length);
+	}
+
+	secmem_destroy(arena);
+}
+
+/*
+ * With -K (SHARE_MODE_DISPERSED), the secret is encrypted under a random key with aead*,
+ * the key is split as usual and its shares go in the share headers (followed by the tag),
+ * or with -V (SHARE_MODE_VERIFIABLE) the key is derived from a secret shared with vss*, whose
+ * commitments are written to commitments (which is NULL otherwise),
+ * and the ciphertext is dispersed in stripes of shares_required * STRIPE_SIZE bytes, each
+ * fragment holding STRIPE_SIZE bytes of each stripe (the last stripe's share being smaller).
+ * The stripe size is part of the format, so it must not depend on -j.
+ */
+#define STRIPE_SIZE ((size_t)64 * 1024)
+
+static size_t split_dispersed(struct pool* pool, struct drbg* drbg, const struct encoder* encoder, FILE* secret_file, FILE* out_fps[],
+		struct share_writer writers[], uint8_t mode_data[][SHARE_MODE_DATA_SIZE], uint8_t (*commitments)[VSS_POINT_SIZE],
+		const uint8_t x[], uint8_t total_shares, uint8_t shares_required) {
+	struct secmem* arena = secure_arena(secmem_size(AEAD_KEY_SIZE) + secmem_size((shares_required - 1) * AEAD_KEY_SIZE) +
+			secmem_size(total_shares * AEAD_KEY_SIZE) + secmem_size(shares_required * VSS_SCALAR_SIZE) + secmem_size(64) +
+			secmem_size(shares_required * STRIPE_SIZE) + secmem_size(total_shares * STRIPE_SIZE));
+	uint8_t* key = secure_alloc(arena, AEAD_KEY_SIZE);
+	uint8_t* key_random = secure_alloc(arena, (shares_required - 1) * AEAD_KEY_SIZE);
+	uint8_t (*key_shares)[AEAD_KEY_SIZE] = secure_alloc(arena, sizeof(uint8_t[total_shares][AEAD_KEY_SIZE]));
+	uint8_t (*coefficients)[VSS_SCALAR_SIZE] = secure_alloc(arena, sizeof(uint8_t[shares_required][VSS_SCALAR_SIZE]));
+	uint8_t* wide = secure_alloc(arena, 64);
+	if (commitments) {
+		for (uint8_t j = 0; j < shares_required; j++) {
+			drbgGenerate(drbg, wide, 64);
+			vssScalarFromRandom(coefficients[j], wide);
+		}
+		vssSplit(key_shares, commitments, x, total_shares, (const uint8_t (*)[VSS_SCALAR_SIZE])coefficients, shares_required);
+		vssDeriveKey(key, coefficients[0]);
+	} else {
+		// The key is split exactly as any other secret would be
+		uint8_t* key_share_rows[total_shares];
+		for (uint8_t i = 0; i < total_shares; i++)
+			key_share_rows[i] = key_shares[i];
+		drbgGenerate(drbg, key, AEAD_KEY_SIZE);
+		drbgGenerate(drbg, key_random, (shares_required - 1) * AEAD_KEY_SIZE);
+		encoderBuffer(encoder, key_share_rows, key, key_random, AEAD_KEY_SIZE);
+	}
+
+	struct aead* aead = aeadCreate(key);
+	uint8_t* stripe = secure_alloc(arena, shares_required * STRIPE_SIZE);
+	uint8_t (*F)[STRIPE_SIZE] = secure_alloc(arena, sizeof(uint8_t[total_shares][STRIPE_SIZE]));
+	if (!aead)
+		ERROREXIT("Could not allocate encryption state\n")
+	uint8_t* fragments[total_shares];
+	for (uint8_t i = 0; i < total_shares; i++)
+		fragments[i] = F[i];
+
+	size_t secret_length = 0, stripe_length;
+	while ((stripe_length = fread(stripe, 1, shares_required * STRIPE_SIZE, secret_file)) > 0) {
+		const size_t fragment_length = disperseLength(stripe_length, shares_required);
+		aeadEncrypt(aead, stripe, stripe_length);
+		disperseBufferParallel(pool, encoder, fragments, stripe, stripe_length);
+		for (uint8_t i = 0; i < total_shares; i++) {
+			if (fwrite(fragments[i], 1, fragment_length, out_fps[i]) != fragment_length)
+				ERROREXIT("Could not write %lu bytes to share %u\n", fragment_length, i)
+			if (!share_writer_update(&writers[i], fragments[i], fragment_length))
+				ERROREXIT("Could not allocate chunk index\n")
+		}
+		secret_length += stripe_length;
+		printf("Finished processing %lu bytes.\n", secret_length);
+	}
+	if (ferror(secret_file))
+		ERROREXIT("Error reading secret\n")
+	if (secret_length == 0)
+		ERROREXIT("Secret may not be empty\n")
+
+	uint8_t tag[AEAD_TAG_SIZE];
+	aeadFinish(aead, tag);
+	for (uint8_t i = 0; i < total_shares; i++) {
+		memcpy(mode_data[i], key_shares[i], AEAD_KEY_SIZE);
+		memcpy(&mode_data[i][AEAD_KEY_SIZE], tag, AEAD_TAG_SIZE);
+	}
+
+	secmem_destroy(arena);
+	return secret_length;
+}
+
+static size_t combine_dispersed(struct pool* pool, const struct combiner* combiner, FILE* files_fps[], char* files[],
+		struct share_reader readers[], const uint8_t x[], uint8_t shares_required, FILE* out_file, const char* out_file_name) {
+	const uint64_t secret_length = readers[0].header.secret_length;
+	const uint8_t* tag = &readers[0].header.mode_data[AEAD_KEY_SIZE];
+
+	struct secmem* arena = secure_arena(secmem_size(AEAD_KEY_SIZE) + secmem_size(shares_required * VSS_SCALAR_SIZE) + secmem_size(VSS_SCALAR_SIZE) +
+			2 * secmem_size(shares_required * STRIPE_SIZE));
+	uint8_t* key = secure_alloc(arena, AEAD_KEY_SIZE);
+	if (readers[0].header.mode == SHARE_MODE_VERIFIABLE) {
+		const size_t mark = secmem_mark(arena);
+		uint8_t (*vss_shares)[VSS_SCALAR_SIZE] = secure_alloc(arena, sizeof(uint8_t[shares_required][VSS_SCALAR_SIZE]));
+		uint8_t* vss_secret = secure_alloc(arena, VSS_SCALAR_SIZE);
+		for (uint8_t j = 0; j < shares_required; j++)
+			memcpy(vss_shares[j], readers[j].header.mode_data, VSS_SCALAR_SIZE);
+		vssCombine(vss_secret, x, (const uint8_t (*)[VSS_SCALAR_SIZE])vss_shares, shares_required);
+		vssDeriveKey(key, vss_secret);
+		secmem_release(arena, mark);
+	} else {
+		const uint8_t* key_shares[shares_required];
+		for (uint8_t j = 0; j < shares_required; j++)
+			key_shares[j] = readers[j].header.mode_data;
+		combinerBuffer(combiner, key, key_shares, AEAD_KEY_SIZE);
+	}
+	struct aead* aead = aeadCreate(key);
+	struct decoder* decoder = decoderCreate(x, shares_required);
+	uint8_t* stripe = secure_alloc(arena, shares_required * STRIPE_SIZE);
+	uint8_t (*F)[STRIPE_SIZE] = secure_alloc(arena, sizeof(uint8_t[shares_required][STRIPE_SIZE]));
+	if (!aead || !decoder)
+		ERROREXIT("Could not allocate %lu bytes for shares\n", 2 * shares_required * STRIPE_SIZE)
+	const uint8_t* fragments[shares_required];
+	for (uint8_t j = 0; j < shares_required; j++)
+		fragments[j] = F[j];
+
+	for (uint64_t offset = 0; offset < secret_length; offset += shares_required * STRIPE_SIZE) {
+		const size_t stripe_length = secret_length - offset < shares_required * STRIPE_SIZE ? secret_length - offset : shares_required * STRIPE_SIZE;
+		const size_t fragment_length = disperseLength(stripe_length, shares_required);
+		for (uint8_t j = 0; j < shares_required; j++) {
+			if (fread(F[j], 1, fragment_length, files_fps[j]) != fragment_length)
+				ERROREXIT("Couldn't read next %lu bytes from %s\n", fragment_length, files[j])
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], F[j], fragment_length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+		decoderBufferParallel(pool, decoder, stripe, fragments, fragment_length);
+		aeadDecrypt(aead, stripe, stripe_length);
+		if (fwrite(stripe, 1, stripe_length, out_file) != stripe_length)
+			ERROREXIT("Could not write %lu bytes to %s\n", stripe_length, out_file_name)
+	}
+	// Nothing written is trustworthy until the tag checks out, and exiting removes it if not
+	if (!aeadVerify(aead, tag))
+		ERROREXIT("Shares are corrupt or not all from the same split\n")
+
+	secmem_destroy(arena);
+	decoderFree(decoder);
+	return secret_length;
+}
+
+/*
+ * Packed sharing (-l, SHARE_MODE_PACKED) cuts the secret into stripes of packing * STRIPE_SIZE bytes
+ * as -K does, and byte b of each share of a stripe is the value at its X coordinate of the polynomial
+ * carrying byte b of every row of the stripe. Shares are about 1/packing the size of the secret, and
+ * no k - 1 of them reveal anything, but k + packing - 1 are needed to combine.
+ */
+static uint64_t packed_payload_length(uint64_t secret_length, uint8_t packing) {
+	const uint64_t stripe_size = packing * STRIPE_SIZE;
+	return secret_length / stripe_size * STRIPE_SIZE + disperseLength(secret_length % stripe_size, packing);
+}
 
-		x[shares_required-1] = final_x;
-		bool possible_secrets[P];
-		memset(possible_secrets, 0, sizeof(possible_secrets));
-		for (uint16_t new_q = 0; new_q < P; new_q++) {
-			q[shares_required-1] = new_q;
-			possible_secrets[calculateSecret(x, q, shares_required)] = 1;
+static size_t split_packed(struct pool* pool, struct drbg* drbg, const struct encoder* encoder, FILE* secret_file, FILE* out_fps[],
+		struct share_writer writers[], uint8_t total_shares, uint8_t shares_required, uint8_t packing) {
+	struct secmem* arena = secure_arena(secmem_size(packing * STRIPE_SIZE) + secmem_size((shares_required - 1) * STRIPE_SIZE) + secmem_size(total_shares * STRIPE_SIZE));
+	uint8_t* stripe = secure_alloc(arena, packing * STRIPE_SIZE);
+	uint8_t* random = secure_alloc(arena, (shares_required - 1) * STRIPE_SIZE);
+	uint8_t (*D)[STRIPE_SIZE] = secure_alloc(arena, sizeof(uint8_t[total_shares][STRIPE_SIZE]));
+	uint8_t* shares[total_shares];
+	for (uint8_t i = 0; i < total_shares; i++)
+		shares[i] = D[i];
+
+	size_t secret_length = 0, stripe_length;
+	while ((stripe_length = fread(stripe, 1, packing * STRIPE_SIZE, secret_file)) > 0) {
+		// The rows are cut as disperseBuffer cuts them, the last zero-padded
+		const size_t row_length = disperseLength(stripe_length, packing);
+		memset(&stripe[stripe_length], 0, packing * row_length - stripe_length);
+		if (shares_required > 1)
+			drbgGenerate(drbg, random, (shares_required - 1) * row_length);
+		encoderBufferParallel(pool, encoder, shares, stripe, random, row_length);
+		for (uint8_t i = 0; i < total_shares; i++) {
+			if (fwrite(D[i], 1, row_length, out_fps[i]) != row_length)
+				ERROREXIT("Could not write %lu bytes to share %u\n", row_length, i)
+			if (!share_writer_update(&writers[i], D[i], row_length))
+				ERROREXIT("Could not allocate chunk index\n")
 		}
+		secret_length += stripe_length;
+		printf("Finished processing %lu bytes.\n", secret_length);
+	}
+
+	secmem_destroy(arena);
+	return secret_length;
+}
 
-		for (uint16_t i = 0; i < P; i++)
-			assert(possible_secrets[i]);
+// Combines from the first shares_required + packing - 1 shares
+static size_t combine_packed(struct pool* pool, FILE* files_fps[], char* files[], struct share_reader readers[], const uint8_t x[],
+		uint8_t shares_required, uint8_t packing, FILE* out_file, const char* out_file_name) {
+	const uint8_t needed = shares_required + packing - 1;
+	const uint64_t secret_length = readers[0].header.secret_length;
+	if (readers[0].header.payload_length != packed_payload_length(secret_length, packing))
+		ERROREXIT("Shares split with -l are not in a format this version understands\n")
+
+	struct decoder* decoder = packedDecoderCreate(x, shares_required, packing);
+	if (!decoder)
+		ERROREXIT("Could not allocate decoder\n")
+	struct secmem* arena = secure_arena(secmem_size(packing * STRIPE_SIZE) + secmem_size(needed * STRIPE_SIZE));
+	uint8_t* stripe = secure_alloc(arena, packing * STRIPE_SIZE);
+	uint8_t (*F)[STRIPE_SIZE] = secure_alloc(arena, sizeof(uint8_t[needed][STRIPE_SIZE]));
+	const uint8_t* fragments[needed];
+	for (uint8_t j = 0; j < needed; j++)
+		fragments[j] = F[j];
+
+	for (uint64_t offset = 0; offset < secret_length; offset += packing * STRIPE_SIZE) {
+		const size_t stripe_length = secret_length - offset < packing * STRIPE_SIZE ? secret_length - offset : packing * STRIPE_SIZE;
+		const size_t row_length = disperseLength(stripe_length, packing);
+		for (uint8_t j = 0; j < needed; j++) {
+			if (fread(F[j], 1, row_length, files_fps[j]) != row_length)
+				ERROREXIT("Couldn't read next %lu bytes from %s\n", row_length, files[j])
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], F[j], row_length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+		decoderBufferParallel(pool, decoder, stripe, fragments, row_length);
+		if (fwrite(stripe, 1, stripe_length, out_file) != stripe_length)
+			ERROREXIT("Could not write %lu bytes to %s\n", stripe_length, out_file_name)
 	}
 
-	//TODO: Check that gcc isn't optimizing this one away
-	memset(q, 0, sizeof(q));
+	secmem_destroy(arena);
+	decoderFree(decoder);
+	return secret_length;
 }
 
-static void check_possible_missing_part_derivations_intern(uint8_t total_shares, uint8_t shares_required, bool parts_have[], uint8_t parts_included, uint16_t progress, const uint8_t* split_version, const uint8_t* x, uint8_t split_index, uint8_t split_size) {
-	if (parts_included == shares_required-1)
-		return derive_missing_part(total_shares, shares_required, parts_have, split_version, x, split_index, split_size);
+/*
+ * Refresh (-r) and re-share (-R) stream the shares of one split block by block into the shares of a
+ * new split (with a new ID, so the two can never be mixed up) without ever calculating the secret.
+ * A refresh keeps the X coordinates and k, adding a random polynomial with a zero constant term to
+ * every share given; a re-share takes k of the shares to total_shares new ones needing shares_required.
+ */
+static void reshare_files(struct pool* pool, char* files[], uint8_t files_count, const char* out_base, bool refresh,
+		uint8_t total_shares, uint8_t shares_required, bool sequential, size_t block_size) {
+	FILE* in_fps[files_count];
+	struct share_reader readers[files_count];
+	uint8_t x[files_count];
+	for (uint8_t i = 0; i < files_count; i++) {
+		open_share(files[i], &in_fps[i], &readers[i]);
+		x[i] = readers[i].header.x;
+	}
+	check_same_split(readers, files, files_count);
+	const struct share_header* first = &readers[0].header;
+	if (readers[0].legacy)
+		ERROREXIT("Shares without a header cannot be %s, as their k is not known\n", refresh ? "refreshed" : "re-shared")
+	if (first->mode != SHARE_MODE_SHAMIR)
+		ERROREXIT("Shares split with -K, -V or -l cannot be %s\n", refresh ? "refreshed" : "re-shared")
+	if (files_count < first->k)
+		ERROREXIT("Need at least %u shares but got %u\n", first->k, files_count)
+	if (!refresh && first->k + shares_required - 1 >= P)
+		ERROREXIT("Re-sharing needs the old and new k to add up to at most %u, but they are %u and %u\n", P, first->k, shares_required)
+
+	struct drbg* drbg = seed_drbg();
+	// A refresh needs every input, a re-share just the first k of them
+	const uint8_t used_shares = refresh ? files_count : first->k;
+	uint8_t new_x[refresh ? files_count : total_shares];
+	if (refresh) {
+		if (files_count < first->n)
+			printf("Only %u of the %u shares are being refreshed, the rest cannot be combined with the new ones\n", files_count, first->n);
+		total_shares = files_count;
+		shares_required = first->k;
+		memcpy(new_x, x, files_count);
+	} else {
+		for (uint8_t i = used_shares; i < files_count; i++) {
+			fclose(in_fps[i]);
+			share_reader_free(&readers[i]);
+		}
+		pick_x(drbg, new_x, total_shares, 1, sequential);
+		if (!checkNoInformationLeak(new_x, total_shares, shares_required))
+			ERROREXIT("X coordinates would leak information about the secret\n")
+		printf("Verified that no %u shares reveal any information about the secret\n", shares_required - 1);
+	}
+
+	struct encoder* encoder = (void*)0;
+	struct resharer* resharer = (void*)0;
+	if (refresh ? !(encoder = encoderCreate(x, used_shares, shares_required)) : !(resharer = resharerCreate(x, used_shares, new_x, total_shares, shares_required)))
+		ERROREXIT("Could not allocate %s\n", refresh ? "encoder" : "resharer")
+
+	uint8_t split_id[16];
+	drbgGenerate(drbg, split_id, sizeof(split_id));
+	FILE* out_fps[total_shares];
+	struct share_writer writers[total_shares];
+	create_shares(out_base, out_fps, writers, total_shares);
+
+	struct secmem* arena = secure_arena(secmem_size(used_shares * block_size) + secmem_size(total_shares * block_size) + secmem_size((shares_required - 1) * block_size));
+	uint8_t (*Q)[block_size] = secure_alloc(arena, sizeof(uint8_t[used_shares][block_size]));
+	uint8_t (*D)[block_size] = secure_alloc(arena, sizeof(uint8_t[total_shares][block_size]));
+	uint8_t* random = secure_alloc(arena, (shares_required - 1) * block_size);
+	const uint8_t* old_shares[used_shares];
+	uint8_t* new_shares[total_shares];
+	for (uint8_t i = 0; i < used_shares; i++)
+		old_shares[i] = Q[i];
+	for (uint8_t i = 0; i < total_shares; i++)
+		new_shares[i] = D[i];
 
-	if (total_shares - progress < shares_required)
-		return;
+	for (uint64_t offset = 0; offset < first->payload_length; offset += block_size) {
+		const size_t block_length = first->payload_length - offset < block_size ? first->payload_length - offset : block_size;
+		for (uint8_t j = 0; j < used_shares; j++) {
+			if (fread(Q[j], 1, block_length, in_fps[j]) != block_length)
+				ERROREXIT("Couldn't read next %lu bytes from %s\n", block_length, files[j])
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], Q[j], block_length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+		if (shares_required > 1)
+			drbgGenerate(drbg, random, (shares_required - 1) * block_length);
+		if (refresh)
+			encoderRefreshParallel(pool, encoder, new_shares, old_shares, random, block_length);
+		else
+			resharerBufferParallel(pool, resharer, new_shares, old_shares, random, block_length);
+
+		for (uint8_t i = 0; i < total_shares; i++) {
+			if (fwrite(D[i], 1, block_length, out_fps[i]) != block_length)
+				ERROREXIT("Could not write %lu bytes to share %u\n", block_length, i)
+			if (!share_writer_update(&writers[i], D[i], block_length))
+				ERROREXIT("Could not allocate chunk index\n")
+		}
+	}
+
+	for (uint8_t i = 0; i < total_shares; i++) {
+		struct share_header header = {
+			.version = SHARE_VERSION, .field_bits = 8, .mode = SHARE_MODE_SHAMIR, .x = new_x[i], .k = shares_required,
+			.n = refresh ? first->n : total_shares, .chunk_size = SHARE_CHUNK_SIZE, .secret_length = first->secret_length,
+		};
+		memcpy(header.split_id, split_id, sizeof(split_id));
+		finish_share(out_fps[i], &writers[i], &header, i);
+	}
+	finish_shares();
+	printf("%s %u shares of %lu bytes into %u shares needing %u\n", refresh ? "Refreshed" : "Re-shared", used_shares, first->payload_length,
+			total_shares, shares_required);
+
+	for (uint8_t i = 0; i < used_shares; i++) {
+		fclose(in_fps[i]);
+		share_reader_free(&readers[i]);
+	}
 
-	check_possible_missing_part_derivations_intern(total_shares, shares_required, parts_have, parts_included, progress+1, split_version, x, split_index, split_size);
-	parts_have[progress] = 1;
-	check_possible_missing_part_derivations_intern(total_shares, shares_required, parts_have, parts_included+1, progress+1, split_version, x, split_index, split_size);
-	parts_have[progress] = 0;
+	secmem_destroy(arena);
+	if (encoder)
+		encoderFree(encoder);
+	if (resharer)
+		resharerFree(resharer);
+	drbgFree(drbg);
 }
 
-static void check_possible_missing_part_derivations(uint8_t total_shares, uint8_t shares_required, const uint8_t* split_version, const uint8_t* x, uint8_t split_index, uint8_t split_size) {
-	bool parts_have[P];
-	memset(parts_have, 0, sizeof(parts_have));
-	check_possible_missing_part_derivations_intern(total_shares, shares_required, parts_have, 0, 0, split_version, x, split_index, split_size);
+/*
+ * Splitting and combining over GF(2^16) or GF(2^32) (-w), for more than P - 1 shares. The secret
+ * is cut into little-endian field elements, the last zero-padded, so the payload may be up to 3
+ * bytes longer than the secret. Only the plain streaming mode is supported over the wider fields.
+ */
+static void split_wide(struct pool* pool, const char* in_file, const char* out_base, unsigned field_bits,
+		uint32_t total_shares, uint32_t shares_required, bool sequential, size_t block_size) {
+	const size_t element_size = field_bits / 8;
+	struct drbg* drbg = seed_drbg();
+	FILE* secret_file = fopen(in_file, "r");
+	if (!secret_file)
+		ERROREXIT("Could not open %s for reading.\n", in_file)
+	setvbuf(secret_file, (void*)0, _IONBF, 0);
+
+	uint32_t* x = malloc(total_shares * sizeof(uint32_t));
+	if (!x)
+		ERROREXIT("Could not allocate X coordinates\n")
+	if (sequential) {
+		for (uint32_t i = 0; i < total_shares; i++)
+			x[i] = i + 1;
+	} else if (!drbgPickWideX(drbg, field_bits, x, total_shares))
+		ERROREXIT("Could not allocate X coordinates\n")
+	if (!wideCheckX(field_bits, x, total_shares))
+		ERROREXIT("X coordinates would leak information about the secret\n")
+	printf("Verified that no %u shares reveal any information about the secret\n", shares_required - 1);
+
+	uint8_t split_id[16];
+	drbgGenerate(drbg, split_id, sizeof(split_id));
+	FILE** out_fps = malloc(total_shares * sizeof(FILE*));
+	struct share_writer* writers = malloc(total_shares * sizeof(struct share_writer));
+	if (!out_fps || !writers)
+		ERROREXIT("Could not allocate %u shares\n", total_shares)
+	create_shares(out_base, out_fps, writers, total_shares);
+
+	struct wide_encoder* encoder = wideEncoderCreate(field_bits, x, total_shares, shares_required);
+	uint8_t** shares = malloc(total_shares * sizeof(uint8_t*));
+	if (!encoder || !shares)
+		ERROREXIT("Could not allocate %u shares\n", total_shares)
+	struct secmem* arena = secure_arena(secmem_size(block_size) + secmem_size((shares_required - 1) * block_size) + secmem_size((size_t)total_shares * block_size));
+	uint8_t* secret = secure_alloc(arena, block_size);
+	uint8_t* random = secure_alloc(arena, (shares_required - 1) * block_size);
+	uint8_t* D = secure_alloc(arena, (size_t)total_shares * block_size);
+	for (uint32_t i = 0; i < total_shares; i++)
+		shares[i] = &D[i * block_size];
+
+	size_t secret_length = 0, block_length;
+	while ((block_length = fread(secret, 1, block_size, secret_file)) > 0) {
+		const size_t padded_length = (block_length + element_size - 1) / element_size * element_size;
+		memset(&secret[block_length], 0, padded_length - block_length);
+		if (shares_required > 1)
+			drbgGenerate(drbg, random, (shares_required - 1) * padded_length);
+		wideEncoderBufferParallel(pool, encoder, shares, secret, random, padded_length);
+
+		for (uint32_t i = 0; i < total_shares; i++) {
+			if (fwrite(shares[i], 1, padded_length, out_fps[i]) != padded_length)
+				ERROREXIT("Could not write %lu bytes to share %u\n", padded_length, i)
+			if (!share_writer_update(&writers[i], shares[i], padded_length))
+				ERROREXIT("Could not allocate chunk index\n")
+		}
+		secret_length += block_length;
+		printf("Finished processing %lu bytes.\n", secret_length);
+		// Only the last block may be short, as the padding must be at the very end
+		if (block_length != block_size)
+			break;
+	}
+	if (ferror(secret_file))
+		ERROREXIT("Error reading secret\n")
+	if (secret_length == 0)
+		ERROREXIT("Secret may not be empty\n")
+	fclose(secret_file);
+	printf("Split secret of length %lu over GF(2^%u)\n", secret_length, field_bits);
+
+	for (uint32_t i = 0; i < total_shares; i++) {
+		struct share_header header = {
+			.version = SHARE_VERSION, .field_bits = field_bits, .mode = SHARE_MODE_SHAMIR, .x = x[i], .k = shares_required,
+			.n = total_shares, .chunk_size = SHARE_CHUNK_SIZE, .secret_length = secret_length,
+		};
+		memcpy(header.split_id, split_id, sizeof(split_id));
+		finish_share(out_fps[i], &writers[i], &header, i);
+	}
+	finish_shares();
+
+	secmem_destroy(arena);
+	memset(x, 0, total_shares * sizeof(uint32_t));
+	free(shares);
+	free(x);
+	free(out_fps);
+	free(writers);
+	wideEncoderFree(encoder);
+	drbgFree(drbg);
+}
+
+static void combine_wide(struct pool* pool, char* files[], uint32_t files_count, uint32_t shares_required, const char* out_file_name, size_t block_size) {
+	FILE** fps = malloc(files_count * sizeof(FILE*));
+	struct share_reader* readers = malloc(files_count * sizeof(struct share_reader));
+	uint32_t* x = malloc(files_count * sizeof(uint32_t));
+	if (!fps || !readers || !x)
+		ERROREXIT("Could not allocate %u shares\n", files_count)
+	for (uint32_t i = 0; i < files_count; i++) {
+		open_share(files[i], &fps[i], &readers[i]);
+		x[i] = readers[i].header.x;
+	}
+	check_same_split(readers, files, files_count);
+	const struct share_header* first = &readers[0].header;
+	if (first->k != shares_required)
+		ERROREXIT("Shares need %u shares to combine but -k is %u\n", first->k, shares_required)
+	if (files_count != shares_required)
+		ERROREXIT("Shares over GF(2^%u) are combined from exactly k of them\n", first->field_bits)
+	if (first->mode != SHARE_MODE_SHAMIR || first->payload_length % (first->field_bits / 8) != 0 ||
+			first->secret_length > first->payload_length || first->payload_length - first->secret_length >= first->field_bits / 8)
+		ERROREXIT("Shares over GF(2^%u) are not in a format this version understands\n", first->field_bits)
+
+	struct wide_combiner* combiner = wideCombinerCreate(first->field_bits, x, shares_required);
+	const uint8_t** shares = malloc(shares_required * sizeof(uint8_t*));
+	if (!combiner || !shares)
+		ERROREXIT("Could not allocate %u shares\n", shares_required)
+	struct secmem* arena = secure_arena(secmem_size(block_size) + secmem_size((size_t)shares_required * block_size));
+	uint8_t* secret = secure_alloc(arena, block_size);
+	uint8_t* Q = secure_alloc(arena, (size_t)shares_required * block_size);
+	for (uint32_t i = 0; i < shares_required; i++)
+		shares[i] = &Q[i * block_size];
+
+	FILE* out_file = open_output(out_file_name);
+	for (uint64_t offset = 0; offset < first->payload_length; offset += block_size) {
+		const size_t block_length = first->payload_length - offset < block_size ? first->payload_length - offset : block_size;
+		for (uint32_t j = 0; j < shares_required; j++) {
+			if (fread(&Q[j * block_size], 1, block_length, fps[j]) != block_length)
+				ERROREXIT("Couldn't read next %lu bytes from %s\n", block_length, files[j])
+			uint64_t bad_chunk;
+			if (!share_reader_update(&readers[j], &Q[j * block_size], block_length, &bad_chunk))
+				ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+		}
+		wideCombinerBufferParallel(pool, combiner, secret, shares, block_length);
+		// The padding is dropped from the end
+		const size_t out_length = first->secret_length - offset < block_length ? first->secret_length - offset : block_length;
+		if (fwrite(secret, 1, out_length, out_file) != out_length)
+			ERROREXIT("Could not write %lu bytes to %s\n", out_length, out_file_name)
+	}
+	finish_output(out_file);
+	printf("Got secret of length %lu\n", first->secret_length);
+
+	for (uint32_t i = 0; i < files_count; i++) {
+		fclose(fps[i]);
+		share_reader_free(&readers[i]);
+	}
+
+	secmem_destroy(arena);
+	free(shares);
+	free(fps);
+	free(readers);
+	free(x);
+	wideCombinerFree(combiner);
 }
 
+// The field width of a split, from its first share
+static unsigned share_field_bits(const char* name) {
+	FILE* fp;
+	struct share_reader reader;
+	open_share(name, &fp, &reader);
+	const unsigned field_bits = reader.header.field_bits;
+	fclose(fp);
+	share_reader_free(&reader);
+	return field_bits;
+}
 
 int main(int argc, char* argv[]) {
-	assert(mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+	enum { MODE_NONE, MODE_SPLIT, MODE_COMBINE, MODE_REFRESH, MODE_RESHARE, MODE_SERVE } mode = MODE_NONE;
+	uint32_t total_shares = 0, shares_required = 0;
+	unsigned field_bits = 8, packing = 1;
+	char** files = (void*)0; uint32_t files_count = 0;
+	char *in_file = (void*)0, *out_file_param = (void*)0, *commitments_file = (void*)0, *socket_path = (void*)0;
+	unsigned threads = 1, audit_threads = 0;
+	bool audit = false, audit_shares = false, use_mmap = false, disperse = false, range = false, sequential_x = false;
+	uint64_t range_offset = 0, range_length = 0;
 
-	char split = 0;
-	uint8_t total_shares = 0, shares_required = 0;
-	char* files[P]; uint8_t files_count = 0;
-	char *in_file = (void*)0, *out_file_param = (void*)0;
+	enum { OPT_AUDIT_THREADS = 256, OPT_AUDIT_SHARES, OPT_RANGE, OPT_SEQUENTIAL_X };
+	static const struct option long_options[] = {
+		{ "audit-threads", required_argument, (void*)0, OPT_AUDIT_THREADS },
+		{ "audit-shares", no_argument, (void*)0, OPT_AUDIT_SHARES },
+		{ "range", required_argument, (void*)0, OPT_RANGE },
+		{ "sequential-x", no_argument, (void*)0, OPT_SEQUENTIAL_X },
+		{ (void*)0, 0, (void*)0, 0 }
+	};
+
+	atexit(remove_partial_output);
+	static const struct secret_allocator locked_allocator = { locked_alloc, locked_free, (void*)0 };
+	setSecretAllocator(&locked_allocator);
 
 	int i;
-	while((i = getopt(argc, argv, "scn:k:f:o:i:h?")) != -1)
+	while((i = getopt_long(argc, argv, "scrRd:amKV:n:k:l:w:f:o:i:j:h?", long_options, (void*)0)) != -1)
 		switch(i) {
 		case 's':
-			if ((split & 0x2) && !(split & 0x1))
-				ERROREXIT("-s (split) and -c (combine) are mutually exclusive\n")
-			else
-				split = (0x2 | 0x1);
-			break;
 		case 'c':
-			if ((split & 0x2) && (split & 0x1))
-				ERROREXIT("-s (split) and -c (combine) are mutually exclusive\n")
-			else
-				split = 0x2;
+		case 'r':
+		case 'R':
+		case 'd':
+			if (mode != MODE_NONE)
+				ERROREXIT("-s (split), -c (combine), -r (refresh), -R (re-share) and -d (serve) are mutually exclusive\n")
+			mode = i == 's' ? MODE_SPLIT : i == 'c' ? MODE_COMBINE : i == 'r' ? MODE_REFRESH : i == 'R' ? MODE_RESHARE : MODE_SERVE;
+			if (i == 'd')
+				socket_path = optarg;
+			break;
+		case 'a':
+			audit = true;
+			break;
+		case 'm':
+			use_mmap = true;
+			break;
+		case 'K':
+			disperse = true;
+			break;
+		case 'V':
+			commitments_file = optarg;
+			disperse = true;
 			break;
 		case 'n': {
 			int t = atoi(optarg);
-			if (t <= 0 || t >= P)
-				ERROREXIT("n must be > 0 and < %u\n", P)
+			if (t <= 0 || t > MAX_WIDE_SHARES)
+				ERROREXIT("n must be > 0 and <= %u\n", MAX_WIDE_SHARES)
 			else
 				total_shares = t;
 			break;
 		}
 		case 'k': {
 			int t = atoi(optarg);
-			if (t <= 0 || t >= P)
-				ERROREXIT("n must be > 0 and < %u\n", P)
+			if (t <= 0 || t > MAX_WIDE_SHARES)
+				ERROREXIT("k must be > 0 and <= %u\n", MAX_WIDE_SHARES)
 			else
 				shares_required = t;
 			break;
 		}
+		case 'l': {
+			int t = atoi(optarg);
+			if (t <= 0 || t >= P)
+				ERROREXIT("l must be > 0 and < %u\n", P)
+			else
+				packing = t;
+			break;
+		}
+		case 'w': {
+			int t = atoi(optarg);
+			if (t != 8 && t != 16 && t != 32)
+				ERROREXIT("w must be 8, 16 or 32\n")
+			else
+				field_bits = t;
+			break;
+		}
 		case 'i':
 			in_file = optarg;
 			break;
 		case 'o':
 			out_file_param = optarg;
 			break;
+		case 'j': {
+			int t = atoi(optarg);
+			if (t <= 0)
+				ERROREXIT("j must be > 0\n")
+			else
+				threads = t;
+			break;
+		}
+		case OPT_AUDIT_THREADS: {
+			int t = atoi(optarg);
+			if (t <= 0)
+				ERROREXIT("--audit-threads must be > 0\n")
+			else
+				audit_threads = t;
+			break;
+		}
+		case OPT_AUDIT_SHARES:
+			audit_shares = true;
+			break;
+		case OPT_RANGE: {
+			char* end;
+			errno = 0;
+			range_offset = strtoull(optarg, &end, 0);
+			if (*end == ':' && end != optarg)
+				range_length = strtoull(end + 1, &end, 0);
+			if (errno || *end || range_length == 0 || range_offset + range_length < range_offset)
+				ERROREXIT("--range must be <offset>:<length> with length > 0\n")
+			range = true;
+			break;
+		}
+		case OPT_SEQUENTIAL_X:
+			sequential_x = true;
+			break;
 		case 'f':
-			if (files_count >= P-1)
-				ERROREXIT("May only specify up to %u files\n", P-1)
+			if (files_count >= MAX_WIDE_SHARES)
+				ERROREXIT("May only specify up to %u files\n", MAX_WIDE_SHARES)
+			files = realloc(files, (files_count + 1) * sizeof(char*));
+			if (!files)
+				ERROREXIT("Could not allocate file list\n")
 			files[files_count++] = optarg;
 			break;
 		case 'h':
 		case '?':
-			printf("Split usage: -s -n <total shares> -k <shares required> -i <input file> -o <output file path base>\n");
-			printf("Combine usage: -c -k <shares provided == shares required> <-f <share>>*k -o <output file>\n");
+			printf("Split usage: -s -n <total shares> -k <shares required> -i <input file> -o <output file path base> [-j <threads>] [-m | -K | -V <commitments file>] [-a [--audit-threads <threads>] [--audit-shares]]\n");
+			printf("             [-w <field width> | -l <secrets per polynomial>] [--sequential-x]\n");
+			printf("  -w 16 or -w 32 splits over GF(2^16) or GF(2^32), allowing n and k up to %u (without -m, -K, -V or -a);\n", MAX_WIDE_SHARES);
+			printf("     combine picks the width up from the shares (and only takes exactly k of them)\n");
+			printf("  -l packs that many bytes of the secret into each polynomial, so shares are about 1/l the size of the secret;\n");
+			printf("     no k-1 shares still reveal anything, but combine needs k+l-1 of them (not with -w, -m, -K, -V or -a)\n");
+			printf("  --sequential-x gives the shares X coordinates 1 to n instead of random ones (also for -R)\n");
+			printf("  -a also checks that no k-1 shares reveal anything by trying every subset (slow, for audits)\n");
+			printf("  --audit-shares has -a also check it independently, by brute force over every byte of the shares written\n");
+			printf("     (far slower, and not with -m, -K, -V or -l)\n");
+			printf("Combine usage: -c -k <shares required> <-f <share>>*(k or more) -o <output file> [-j <threads>] [-m | -K | -V <commitments file>] [--range <offset>:<length>]\n");
+			printf("  -m maps the input and output files into memory instead of streaming them through buffers\n");
+			printf("  -K encrypts the secret under a random key which is split, and disperses the ciphertext so that shares\n");
+			printf("     are only about 1/k the size of the secret (only computationally secure, must be given to both -s and -c)\n");
+			printf("  -V is -K with the key shared so that each share can be checked against commitments which split writes\n");
+			printf("     to the given file; combine then takes k or more shares, and leaves out (and names) any which don't match\n");
+			printf("  Given more than k shares (without -K, -V, -l or -m), combine corrects up to half as many wrong shares as there\n");
+			printf("  are extra, and names them\n");
+			printf("  --range only recovers length bytes of the secret starting at offset, reading little more of each share\n");
+			printf("Refresh usage: -r <-f <share>>*(k or more) -o <output file path base> [-j <threads>]\n");
+			printf("  gives every share a new random polynomial with the same secret, without calculating the secret; shares\n");
+			printf("  which are not refreshed along with the rest can no longer be combined with them\n");
+			printf("Re-share usage: -R -n <total shares> -k <shares required> <-f <share>>*(old k) -o <output file path base> [-j <threads>] [--sequential-x]\n");
+			printf("  splits the secret behind k of the shares again for the new n and k, without calculating the secret\n");
+			printf("Serve usage: -d <socket path> [-j <workers>]\n");
+			printf("  serves split and combine requests from this user over a Unix socket (see server.h for the protocol),\n");
+			printf("  up to %u bytes of secret each, with each worker's memory and random number generator set up in advance\n", SERVER_MAX_LENGTH);
+			printf("Shares carry a header and per-chunk checksums; shares from before the header was added (just an x byte\n");
+			printf("followed by the share) can still be combined\n");
 			exit(0);
 			break;
 		default:
 			ERROREXIT("getopt failed?\n")
 		}
-	if (!(split & 0x2))
-		ERROREXIT("Must specify one of -c, -s or -?\n")
-	split &= 0x1;
+	if (mode == MODE_NONE)
+		ERROREXIT("Must specify one of -c, -s, -r, -R, -d or -?\n")
+	if (mode == MODE_SERVE) {
+		if (argc != optind || total_shares || shares_required || field_bits != 8 || packing != 1 || files || in_file || out_file_param ||
+				audit || use_mmap || disperse || range || sequential_x)
+			ERROREXIT("-d only takes -j, the rest come with each request\n")
+		// Every worker's DRBG is seeded from this one, so the seed source is only read once
+		struct drbg* drbg = seed_drbg();
+		const struct random_source seed_source = drbgSource(drbg);
+		printf("Serving on %s with %u workers\n", socket_path, threads);
+		fflush(stdout);
+		server_run(socket_path, threads, &seed_source);
+		ERROREXIT("Could not serve on %s (it must not exist yet, and the workers' memory must be lockable)\n", socket_path)
+	}
+	if (field_bits != 8 && mode != MODE_SPLIT)
+		ERROREXIT("-w is only valid in split mode, combine picks the width up from the shares\n")
+	if (field_bits != 8 && (use_mmap || disperse || audit))
+		ERROREXIT("-m, -K, -V and -a are only supported over GF(2^8)\n")
+	if (field_bits == 8 && mode == MODE_SPLIT && (total_shares >= P || shares_required >= P))
+		ERROREXIT("n and k must be < %u over GF(2^8), see -w\n", P)
+	if (packing > 1 && mode != MODE_SPLIT)
+		ERROREXIT("-l is only valid in split mode, combine picks it up from the shares\n")
+	if (packing > 1 && (field_bits != 8 || use_mmap || disperse || audit))
+		ERROREXIT("-l cannot be used with -w, -m, -K, -V or -a\n")
+
+	if (use_mmap && disperse)
+		ERROREXIT("-m and -K (or -V) are mutually exclusive\n")
+	if (mode != MODE_COMBINE && range)
+		ERROREXIT("--range is only valid in combine mode\n")
+	if (mode != MODE_SPLIT && mode != MODE_RESHARE && sequential_x)
+		ERROREXIT("--sequential-x is only valid in split and re-share modes\n")
+	if ((mode == MODE_REFRESH || mode == MODE_RESHARE) && (use_mmap || disperse || audit))
+		ERROREXIT("-m, -K, -V and -a are not valid when refreshing or re-sharing\n")
+
+	if (audit_shares && (!audit || use_mmap || disperse))
+		ERROREXIT("--audit-shares needs -a, and cannot be used with -m, -K or -V\n")
 
 	if (argc != optind)
 		ERROREXIT("Invalid argument\n")
 
-	if (split) {
+	// Each thread gets (at least) a block's worth of bytes to work on at a time
+	const size_t block_size = BLOCK_SIZE * threads;
+	const size_t window_size = block_size * MAP_WINDOW_BLOCKS;
+	struct pool* pool = (void*)0;
+	if (threads > 1) {
+		pool = poolCreate(threads);
+		if (!pool)
+			ERROREXIT("Could not start %u threads\n", threads)
+	}
+
+	if (mode == MODE_SPLIT && field_bits != 8) {
+		if (!total_shares || !shares_required)
+			ERROREXIT("n and k must be set.\n")
+		if (shares_required > total_shares)
+			ERROREXIT("k must be <= n\n")
+		if (files_count != 0 || !in_file || !out_file_param)
+			ERROREXIT("Must specify -i <input file> and -o <output file path base> but not -f in split mode.\n")
+
+		split_wide(pool, in_file, out_file_param, field_bits, total_shares, shares_required, sequential_x, block_size);
+		memset(in_file, 0, strlen(in_file));
+	} else if (mode == MODE_SPLIT) {
 		if (!total_shares || !shares_required)
 			ERROREXIT("n and k must be set.\n")
 
 		if (shares_required > total_shares)
 			ERROREXIT("k must be <= n\n")
+		if (shares_required + packing - 1 > total_shares)
+			ERROREXIT("k + l - 1 must be <= n, as that many shares are needed to combine\n")
+		if (total_shares > P - packing)
+			ERROREXIT("n must be <= %u with -l %u, as the secrets take up the other X coordinates\n", P - packing, packing)
 
 		if (files_count != 0 || !in_file || !out_file_param)
 			ERROREXIT("Must specify -i <input file> and -o <output file path base> but not -f in split mode.\n")
 
-		FILE* random = fopen(RAND_SOURCE, "r");
-		assert(random);
+		struct drbg* drbg = seed_drbg();
 		FILE* secret_file = fopen(in_file, "r");
 		if (!secret_file)
 			ERROREXIT("Could not open %s for reading.\n", in_file)
+		setvbuf(secret_file, (void*)0, _IONBF, 0);
 
-		uint8_t secret[MAX_LENGTH];
+		// The other modes bring their own buffers, so A and D are only needed when streaming
+		// A[0] holds a block of the secret, the rest hold the random coefficients for each byte in the block
+		const bool streaming = !disperse && packing == 1 && !use_mmap;
+		struct secmem* arena = secure_arena(secmem_size(total_shares * SHARE_MODE_DATA_SIZE) +
+				(streaming ? secmem_size(shares_required * block_size) + secmem_size(total_shares * block_size) : 0));
+		uint8_t (*mode_data)[SHARE_MODE_DATA_SIZE] = secure_alloc(arena, sizeof(uint8_t[total_shares][SHARE_MODE_DATA_SIZE]));
+		uint8_t x[total_shares];
+		uint8_t (*A)[block_size] = (void*)0;
+		uint8_t (*D)[block_size] = (void*)0;
+		uint8_t* shares[total_shares];
+		if (streaming) {
+			A = secure_alloc(arena, sizeof(uint8_t[shares_required][block_size]));
+			D = secure_alloc(arena, sizeof(uint8_t[total_shares][block_size]));
+			for (uint8_t i = 0; i < total_shares; i++)
+				shares[i] = D[i];
+		}
 
-		size_t secret_length = fread(secret, 1, MAX_LENGTH*sizeof(uint8_t), secret_file);
-		if (secret_length == 0)
-			ERROREXIT("Error reading secret\n")
-		if (fread(secret, 1, 1, secret_file) > 0)
-			ERROREXIT("Secret may not be longer than %u\n", MAX_LENGTH)
-		fclose(secret_file);
-		printf("Using secret of length %lu\n", secret_length);
+		pick_x(drbg, x, total_shares, packing, sequential_x);
 
-		uint8_t a[shares_required], x[total_shares], D[total_shares][secret_length];
+		// Now, for paranoia's sake, we ensure that no matter which piece we are missing, we can derive no information about the secret
+		if (packing > 1 ? !packedCheckX(x, total_shares, packing) : !checkNoInformationLeak(x, total_shares, shares_required))
+			ERROREXIT("X coordinates would leak information about the secret\n")
+		printf("Verified that no %u shares reveal any information about the secret\n", shares_required - 1);
+		if (packing > 1)
+			printf("Packing %u bytes per polynomial, so %u shares are needed to combine\n", packing, shares_required + packing - 1);
 
-		// TODO: The following loop may take a long time and eat lots of /dev/random if total_shares is high
-		for (uint32_t i = 0; i < total_shares; i++) {
-			int32_t j = -1;
-			do {
-				assert(fread(&x[i], sizeof(uint8_t), 1, random) == 1);
-				if (x[i] == 0)
-					continue;
-				for (j = 0; j < i; j++)
-					if (x[j] == x[i])
-						break;
-			} while (j < (int32_t)i); // Inner loop will get to j = i when x[j] != x[i] for all j
-			if (i % 32 == 31)
-				printf("Finished picking X coordinates for %u shares\n", i+1);
-		}
-		for (uint32_t i = 0; i < secret_length; i++) {
-			a[0] = secret[i];
-
-			for (uint8_t j = 1; j < shares_required; j++)
-				assert(fread(&a[j], sizeof(uint8_t), 1, random) == 1);
-			for (uint8_t j = 0; j < total_shares; j++)
-				D[j][i] = calculateQ(a, shares_required, x[j]);
-
-			// Now, for paranoia's sake, we ensure that no matter which piece we are missing, we can derive no information about the secret
-			check_possible_missing_part_derivations(total_shares, shares_required, &(D[0][0]), x, i, secret_length);
-
-			if (i % 32 == 31)
-				printf("Finished processing %u bytes.\n", i+1);
-		}
-
-		char out_file_name_buf[strlen(out_file_param) + 4];
-		strcpy(out_file_name_buf, out_file_param);
-		for (uint8_t i = 0; i < total_shares; i++) {
-			sprintf(((char*)out_file_name_buf) + strlen(out_file_param), "%u", i);
-			FILE* out_file = fopen(out_file_name_buf, "w+");
-			if (!out_file)
-				ERROREXIT("Could not open output file %s\n", out_file_name_buf)
+		// Auditors can ask for the same property to be checked by brute force over every subset
+		struct pool* audit_pool = pool;
+		uint64_t audited_subsets = 0;
+		if (audit) {
+			if (audit_threads && audit_threads != threads) {
+				audit_pool = audit_threads > 1 ? poolCreate(audit_threads) : (void*)0;
+				if (audit_threads > 1 && !audit_pool)
+					ERROREXIT("Could not start %u threads\n", audit_threads)
+			}
+
+			struct timespec start, end;
+			uint64_t subsets;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			if (!auditNoInformationLeak(audit_pool, x, total_shares, shares_required, &subsets))
+				ERROREXIT("Audit failed: some %u shares reveal information about the secret\n", shares_required - 1)
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			printf("Audited %lu subsets of %u shares in %.3f seconds (%.0f subsets/s)\n", subsets, shares_required - 1, seconds, subsets / seconds);
+		}
+
+		// Every share of this split carries the same random ID so that combine can tell splits apart
+		uint8_t split_id[16];
+		drbgGenerate(drbg, split_id, sizeof(split_id));
+
+		// Open every share up-front so that each block can be appended as soon as it is calculated
+		FILE* out_fps[total_shares];
+		struct share_writer writers[total_shares];
+		create_shares(out_file_param, out_fps, writers, total_shares);
 
-			if (fwrite(&x[i], sizeof(uint8_t), 1, out_file) != 1)
-				ERROREXIT("Could not write 1 byte to %s\n", out_file_name_buf)
+		// Every block is encoded with the same matrix, so it is only calculated once
+		struct encoder* encoder = packing > 1 ? packedEncoderCreate(x, total_shares, shares_required, packing) : encoderCreate(x, total_shares, shares_required);
+		if (!encoder)
+			ERROREXIT("Could not allocate encoder\n")
 
-			if (fwrite(D[i], 1, secret_length, out_file) != secret_length)
-				ERROREXIT("Could not write %lu bytes to %s\n", secret_length, out_file_name_buf)
+		uint8_t commitments[shares_required][VSS_POINT_SIZE];
+		size_t secret_length = 0, block_length;
+		if (disperse)
+			secret_length = split_dispersed(pool, drbg, encoder, secret_file, out_fps, writers, mode_data, commitments_file ? commitments : (void*)0,
+					x, total_shares, shares_required);
+		else if (packing > 1)
+			secret_length = split_packed(pool, drbg, encoder, secret_file, out_fps, writers, total_shares, shares_required, packing);
+		else if (use_mmap)
+			secret_length = split_mapped(pool, drbg, encoder, secret_file, out_fps, writers, total_shares, shares_required, window_size);
+		else while ((block_length = fread(A[0], 1, block_size, secret_file)) > 0) {
+			if (shares_required > 1)
+				drbgGenerate(drbg, A[1], (shares_required - 1) * block_length);
+			encoderBufferParallel(pool, encoder, shares, A[0], A[1], block_length);
+			// --audit-shares goes through every subset again for every byte, sharing nothing with -a's check
+			uint64_t subsets = 0;
+			if (audit_shares && !auditSharesNoInformationLeak(audit_pool, (const uint8_t* const*)shares, x, total_shares, shares_required, block_length, &subsets))
+				ERROREXIT("Audit failed: some %u shares reveal information about bytes %lu to %lu of the secret\n",
+						shares_required - 1, secret_length, secret_length + block_length - 1)
+			audited_subsets += subsets;
 
-			fclose(out_file);
+			for (uint8_t i = 0; i < total_shares; i++) {
+				if (fwrite(D[i], 1, block_length, out_fps[i]) != block_length)
+					ERROREXIT("Could not write %lu bytes to share %u\n", block_length, i)
+				if (!share_writer_update(&writers[i], D[i], block_length))
+					ERROREXIT("Could not allocate chunk index\n")
+			}
+
+			secret_length += block_length;
+			printf("Finished processing %lu bytes.\n", secret_length);
+		}
+		if (ferror(secret_file))
+			ERROREXIT("Error reading secret\n")
+		if (secret_length == 0)
+			ERROREXIT("Secret may not be empty\n")
+		fclose(secret_file);
+		printf("Split secret of length %lu\n", secret_length);
+		if (audit_shares)
+			printf("Audited %lu subsets of %u shares by brute force over every byte of the shares\n", audited_subsets, shares_required - 1);
+		if (audit_pool && audit_pool != pool)
+			poolFree(audit_pool);
+
+		for (uint8_t i = 0; i < total_shares; i++) {
+			struct share_header header = {
+				.version = SHARE_VERSION, .field_bits = 8,
+				.mode = commitments_file ? SHARE_MODE_VERIFIABLE : disperse ? SHARE_MODE_DISPERSED : packing > 1 ? SHARE_MODE_PACKED : SHARE_MODE_SHAMIR,
+				.packing = packing > 1 ? packing : 0, .x = x[i], .k = shares_required, .n = total_shares, .chunk_size = SHARE_CHUNK_SIZE, .secret_length = secret_length,
+			};
+			memcpy(header.split_id, split_id, sizeof(split_id));
+			memcpy(header.mode_data, mode_data[i], SHARE_MODE_DATA_SIZE);
+			finish_share(out_fps[i], &writers[i], &header, i);
+		}
+
+		if (commitments_file) {
+			FILE* fp = fopen(commitments_file, "w");
+			if (!fp || !share_commitments_write(fp, split_id, (const uint8_t (*)[VSS_POINT_SIZE])commitments, shares_required) || fclose(fp) != 0)
+				ERROREXIT("Could not write commitments to %s\n", commitments_file)
+			printf("Wrote commitments to %s\n", commitments_file);
 		}
+		finish_shares();
 
 		// Clear sensitive data (No, GCC 4.7.2 is currently not optimizing this out)
-		memset(secret, 0, sizeof(uint8_t)*secret_length);
-		memset(a, 0, sizeof(uint8_t)*shares_required);
+		secmem_destroy(arena);
 		memset(x, 0, sizeof(uint8_t)*total_shares);
 		memset(in_file, 0, strlen(in_file));
 
-		fclose(random);
+		encoderFree(encoder);
+		drbgFree(drbg);
+	} else if (mode == MODE_REFRESH || mode == MODE_RESHARE) {
+		if (files_count == 0 || in_file || !out_file_param)
+			ERROREXIT("Must not specify -i and must specify -o and the -f <input file>s when refreshing or re-sharing.\n")
+		if (files_count >= P || share_field_bits(files[0]) != 8 || total_shares >= P || shares_required >= P)
+			ERROREXIT("Only shares over GF(2^8) can be refreshed or re-shared, to at most %u shares\n", P - 1)
+		if (mode == MODE_REFRESH && (total_shares || shares_required))
+			ERROREXIT("-n and -k are taken from the shares when refreshing\n")
+		if (mode == MODE_RESHARE && (!total_shares || !shares_required))
+			ERROREXIT("n and k must be set.\n")
+		if (shares_required > total_shares)
+			ERROREXIT("k must be <= n\n")
+
+		reshare_files(pool, files, files_count, out_file_param, mode == MODE_REFRESH, total_shares, shares_required, sequential_x, block_size);
+
+		memset(out_file_param, 0, strlen(out_file_param));
+		for (uint8_t i = 0; i < files_count; i++)
+			memset(files[i], 0, strlen(files[i]));
+	} else if (files_count > 0 && share_field_bits(files[0]) != 8) {
+		if (!shares_required)
+			ERROREXIT("k must be set.\n")
+		if (in_file || !out_file_param)
+			ERROREXIT("Must not specify -i and must specify -o and at least k -f <input file>s in combine mode.\n")
+		if (disperse || use_mmap || range)
+			ERROREXIT("-m, -K, -V and --range are only supported over GF(2^8)\n")
+
+		combine_wide(pool, files, files_count, shares_required, out_file_param, block_size);
+		memset(out_file_param, 0, strlen(out_file_param));
+		for (uint32_t i = 0; i < files_count; i++)
+			memset(files[i], 0, strlen(files[i]));
 	} else {
 		if (!shares_required)
 			ERROREXIT("k must be set.\n")
+		if (files_count >= P || shares_required >= P)
+			ERROREXIT("Shares over GF(2^8) number at most %u\n", P - 1)
 
-		if (files_count != shares_required || in_file || !out_file_param)
-			ERROREXIT("Must not specify -i and must specify -o and exactly k -f <input file>s in combine mode.\n")
+		// Any shares beyond k stand in for ones which don't match the commitments with -V, and are used to correct wrong ones otherwise
+		if (files_count < shares_required || in_file || !out_file_param)
+			ERROREXIT("Must not specify -i and must specify -o and at least k -f <input file>s in combine mode.\n")
 
-		uint8_t x[shares_required], q[shares_required];
-		FILE* files_fps[shares_required];
+		uint8_t x[files_count];
+		FILE* files_fps[files_count];
+		struct share_reader readers[files_count];
 
-		for (uint8_t i = 0; i < shares_required; i++) {
-			files_fps[i] = fopen(files[i], "r");
-			if (!files_fps[i])
-				ERROREXIT("Couldn't open file %s for reading.\n", files[i])
-			if (fread(&x[i], sizeof(uint8_t), 1, files_fps[i]) != 1)
-				ERROREXIT("Couldn't read the x byte of %s\n", files[i])
+		for (uint8_t i = 0; i < files_count; i++) {
+			open_share(files[i], &files_fps[i], &readers[i]);
+			x[i] = readers[i].header.x;
 		}
+		// With -V a share with a bad header is left out rather than stopping the combine
+		if (commitments_file)
+			files_count = verify_commitments(commitments_file, files, files_fps, readers, x, files_count, shares_required);
+		check_same_split(readers, files, files_count);
+		const struct share_header* first = &readers[0].header;
+		if (!readers[0].legacy && first->k != shares_required)
+			ERROREXIT("Shares need %u shares to combine but -k is %u\n", first->k, shares_required)
+		if (readers[0].legacy && disperse)
+			ERROREXIT("Shares without a header cannot have been split with -K\n")
+		if (!readers[0].legacy && disperse != (first->mode == SHARE_MODE_DISPERSED || first->mode == SHARE_MODE_VERIFIABLE))
+			ERROREXIT("Shares were%s split with -K or -V\n", disperse ? " not" : "")
+		if (!readers[0].legacy && (commitments_file != (void*)0) != (first->mode == SHARE_MODE_VERIFIABLE))
+			ERROREXIT("Shares were%s split with -V\n", commitments_file ? " not" : "")
+		const bool packed = !readers[0].legacy && first->mode == SHARE_MODE_PACKED;
+		if (packed && (first->packing < 2 || shares_required + first->packing - 1 >= P))
+			ERROREXIT("Shares split with -l are not in a format this version understands\n")
+		if (packed && files_count < shares_required + first->packing - 1)
+			ERROREXIT("Shares split with -l %u need %u shares to combine but got %u\n", first->packing, shares_required + first->packing - 1, files_count)
+		if (packed && (use_mmap || range))
+			ERROREXIT("-m and --range cannot be used with shares split with -l\n")
+		// The tag covers the whole ciphertext, so no part of a -K secret can be trusted without reading all of it
+		if (range && disperse)
+			ERROREXIT("--range cannot be used with -K\n")
+		if (range && range_offset + range_length > first->payload_length)
+			ERROREXIT("--range ends past the end of the secret (%lu bytes)\n", first->payload_length)
 
-		uint8_t secret[MAX_LENGTH];
+		// With -V only the first k are needed
+		for (uint8_t i = shares_required; commitments_file && i < files_count; i++) {
+			fclose(files_fps[i]);
+			share_reader_free(&readers[i]);
+		}
+
+		// Packed shares are combined from the first k + l - 1
+		const uint8_t used_shares = commitments_file ? shares_required : packed ? shares_required + first->packing - 1 : files_count;
+		for (uint8_t i = used_shares; packed && i < files_count; i++) {
+			fclose(files_fps[i]);
+			share_reader_free(&readers[i]);
+		}
+		const bool robust = !packed && used_shares > shares_required;
+		if (robust && (disperse || use_mmap || range))
+			ERROREXIT("More than k shares can only be given to -K with -V, and not with -m or --range\n")
 
-		uint32_t i = 0;
-		while (fread(&q[0], sizeof(uint8_t), 1, files_fps[0]) == 1) {
-			for (uint8_t j = 1; j < shares_required; j++) {
-				if (fread(&q[j], sizeof(uint8_t), 1, files_fps[j]) != 1)
-					ERROREXIT("Couldn't read next byte from %s\n", files[j])
+		struct combiner* combiner = combinerCreate(x, shares_required);
+		if (!combiner)
+			ERROREXIT("Could not allocate combiner\n")
+		struct corrector* corrector = (void*)0;
+		if (robust) {
+			corrector = correctorCreate(x, used_shares, shares_required);
+			if (!corrector)
+				ERROREXIT("Could not allocate corrector\n")
+		}
+
+		FILE* out_file = open_output(out_file_param);
+
+		// As with split, the other modes bring their own buffers
+		struct secmem* arena = (void*)0;
+		uint8_t* secret = (void*)0;
+		uint8_t (*Q)[block_size] = (void*)0;
+		const uint8_t* shares[used_shares];
+		if (!range && !disperse && !packed && !use_mmap) {
+			arena = secure_arena(secmem_size(block_size) + secmem_size(used_shares * block_size));
+			secret = secure_alloc(arena, block_size);
+			Q = secure_alloc(arena, sizeof(uint8_t[used_shares][block_size]));
+			for (uint8_t i = 0; i < used_shares; i++)
+				shares[i] = Q[i];
+		}
+
+		size_t secret_length = 0;
+		if (range) {
+			combine_range(pool, combiner, files_fps, files, readers, shares_required, use_mmap, range_offset, range_length,
+					out_file, out_file_param, use_mmap ? window_size : block_size);
+			secret_length = range_length;
+		} else if (disperse)
+			secret_length = combine_dispersed(pool, combiner, files_fps, files, readers, x, shares_required, out_file, out_file_param);
+		else if (packed)
+			secret_length = combine_packed(pool, files_fps, files, readers, x, shares_required, first->packing, out_file, out_file_param);
+		else if (use_mmap)
+			secret_length = combine_mapped(pool, combiner, files_fps, files, readers, shares_required, out_file, out_file_param, window_size);
+		else while (secret_length < first->payload_length) {
+			const size_t block_length = first->payload_length - secret_length < block_size ? first->payload_length - secret_length : block_size;
+			for (uint8_t j = 0; j < used_shares; j++) {
+				if (fread(Q[j], 1, block_length, files_fps[j]) != block_length)
+					ERROREXIT("Couldn't read next %lu bytes from %s\n", block_length, files[j])
+				uint64_t bad_chunk;
+				if (!share_reader_update(&readers[j], Q[j], block_length, &bad_chunk)) {
+					if (!robust)
+						ERROREXIT("Share %s is corrupt (chunk %lu does not match its checksum)\n", files[j], bad_chunk)
+					fprintf(stderr, "Share %s is corrupt (chunk %lu does not match its checksum), correcting it from the others\n", files[j], bad_chunk);
+				}
 			}
-			secret[i++] = calculateSecret(x, q, shares_required);
+			if (!robust)
+				combinerBufferParallel(pool, combiner, secret, shares, block_length);
+			else if (!correctorBuffer(corrector, secret, shares, block_length))
+				ERROREXIT("Too many shares are wrong to correct (at most %u of %u can be) in bytes %lu to %lu\n",
+						(used_shares - shares_required) / 2, used_shares, secret_length, secret_length + block_length - 1)
+			if (fwrite(secret, 1, block_length, out_file) != block_length)
+				ERROREXIT("Could not write %lu bytes to %s\n", block_length, out_file_param)
+			secret_length += block_length;
+		}
+		printf("Got secret of length %lu\n", secret_length);
+		if (corrector) {
+			for (uint8_t i = 0; i < used_shares; i++)
+				if (correctorShareBad(corrector, i))
+					printf("Share %s (x = %u) was wrong and has been corrected for\n", files[i], x[i]);
+			correctorFree(corrector);
 		}
-		printf("Got secret of length %u\n", i);
 
-		FILE* out_file = fopen(out_file_param, "w+");
-		fwrite(secret, sizeof(uint8_t), i, out_file);
-		fclose(out_file);
+		finish_output(out_file);
+		combinerFree(combiner);
 
-		for (uint8_t i = 0; i < shares_required; i++)
+		for (uint8_t i = 0; i < used_shares; i++) {
 			fclose(files_fps[i]);
+			share_reader_free(&readers[i]);
+		}
 
 		// Clear sensitive data (No, GCC 4.7.2 is currently not optimizing this out)
-		memset(secret, 0, sizeof(uint8_t)*i);
-		memset(q, 0, sizeof(uint8_t)*shares_required);
+		if (arena)
+			secmem_destroy(arena);
 		memset(out_file_param, 0, strlen(out_file_param));
-		for (uint8_t i = 0; i < shares_required; i++)
+		for (uint8_t i = 0; i < used_shares; i++)
 			memset(files[i], 0, strlen(files[i]));
-		memset(x, 0, sizeof(uint8_t)*shares_required);
+		memset(x, 0, sizeof(uint8_t)*used_shares);
 	}
 
+	if (pool)
+		poolFree(pool);
+	free(files);
+
 	return 0;
 }
 #endif // !defined(TEST)
@@ -0,0 +1,164 @@
+/*
+ * Worker pool used to spread buffer calculations across threads
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "shamirssecret.h"
+#include "pool.h"
+
+// Workers only run the field kernels, so they do not need the default 8MiB of (locked) stack
+#define WORKER_STACK_SIZE (256 * 1024)
+
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	pthread_t* workers;
+	unsigned worker_count;
+
+	// The job currently being run, only written with lock held while no worker is busy
+	void (*fn)(void* arg, size_t task);
+	void* arg;
+	size_t tasks;
+	unsigned long generation;
+	unsigned busy;
+	int stopping;
+
+	// Tasks are claimed with an atomic increment, so the hot path never takes the lock
+	size_t next_task;
+};
+
+static void run_tasks(struct pool* pool) {
+	size_t task;
+	while ((task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED)) < pool->tasks)
+		pool->fn(pool->arg, task);
+}
+
+static void* worker_main(void* arg) {
+	struct pool* pool = arg;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (pool->generation == generation && !pool->stopping)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->stopping)
+			break;
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_tasks(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/**
+ * Creates a pool which spreads work across threads threads (including the calling one)
+ * Returns NULL if the threads could not be started
+ */
+struct pool* poolCreate(unsigned threads) {
+	struct pool* pool = calloc(1, sizeof(struct pool));
+	if (!pool)
+		return pool;
+	if (threads > 1) {
+		pool->workers = calloc(threads - 1, sizeof(pthread_t));
+		if (!pool->workers) {
+			free(pool);
+			return NULL;
+		}
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+	for (; pool->worker_count + 1 < threads; pool->worker_count++) {
+		if (pthread_create(&pool->workers[pool->worker_count], &attr, worker_main, pool) != 0) {
+			pthread_attr_destroy(&attr);
+			poolFree(pool);
+			return NULL;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	return pool;
+}
+
+void poolFree(struct pool* pool) {
+	unsigned i;
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->worker_count; i++)
+		pthread_join(pool->workers[i], NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+/**
+ * Calls fn(arg, task) once for every task < tasks, spread across the pool's
+ * threads and the calling thread, and returns once all of them have finished.
+ * A NULL pool runs every task in the calling thread.
+ */
+void pool_run(struct pool* pool, void (*fn)(void* arg, size_t task), void* arg, size_t tasks) {
+	size_t task;
+	if (!pool || pool->worker_count == 0 || tasks <= 1) {
+		for (task = 0; task < tasks; task++)
+			fn(arg, task);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->tasks = tasks;
+	pool->next_task = 0;
+	pool->busy = pool->worker_count;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_tasks(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+size_t pool_strided_tasks(const struct pool* pool, size_t length, size_t chunk) {
+	const size_t chunks = (length + chunk - 1) / chunk, threads = pool ? pool->worker_count + 1 : 1;
+	return chunks < threads ? chunks : threads;
+}
@@ -0,0 +1,44 @@
+/*
+ * Worker pool used to spread buffer calculations across threads
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+struct pool;
+
+/**
+ * Calls fn(arg, task) once for every task < tasks, spread across the pool's
+ * threads and the calling thread, and returns once all of them have finished.
+ * A NULL pool runs every task in the calling thread.
+ */
+void pool_run(struct pool* pool, void (*fn)(void* arg, size_t task), void* arg, size_t tasks);
+
+/**
+ * For jobs with per-task setup (such as scratch memory), how many tasks to cut length bytes
+ * of chunk byte chunks into: one per thread, unless there are fewer chunks than threads.
+ * Task t then takes chunks t, t + tasks, t + 2 * tasks, ...
+ */
+size_t pool_strided_tasks(const struct pool* pool, size_t length, size_t chunk);
+
+#endif // POOL_H
@@ -0,0 +1,215 @@
+/*
+ * Random number generation for coefficients and X coordinates
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "chacha20.h"
+#include "field.h"
+
+/*
+ * The DRBG is ChaCha20 with a zero nonce, keyed from the seed source once.
+ * Every drbgGenerate call outputs the keystream from block 1 on, then
+ * replaces the key with the first 32 bytes of block 0, so earlier output
+ * cannot be recovered from the state once a call returns.
+ */
+
+struct drbg {
+	uint32_t key[CHACHA20_KEY_SIZE / 4];
+};
+
+static int system_read(void* ctx, uint8_t buf[], size_t length) {
+	while (length) {
+		ssize_t res = getrandom(buf, length, 0);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		buf += res;
+		length -= res;
+	}
+	return 1;
+}
+
+/**
+ * The operating system's random number generator (getrandom())
+ */
+const struct random_source randomSystem = { system_read, (void*)0 };
+
+/**
+ * Creates a DRBG seeded with 32 bytes from seed_source
+ * Returns NULL if memory could not be allocated or seed_source failed
+ */
+struct drbg* drbgCreate(const struct random_source* seed_source) {
+	uint8_t seed[CHACHA20_KEY_SIZE];
+	struct drbg* drbg = SECRET_ALLOC(sizeof(struct drbg));
+	if (!drbg)
+		return drbg;
+	if (!seed_source->read(seed_source->ctx, seed, sizeof(seed))) {
+		SECRET_FREE(drbg, sizeof(struct drbg));
+		return (void*)0;
+	}
+	chacha20_key(drbg->key, seed);
+	memset(seed, 0, sizeof(seed));
+	return drbg;
+}
+
+/**
+ * Fills buf with length random bytes
+ */
+void drbgGenerate(struct drbg* drbg, uint8_t buf[], size_t length) {
+	uint8_t block[CHACHA20_BLOCK_SIZE];
+	uint64_t counter = 1;
+	for (; length >= CHACHA20_BLOCK_SIZE; length -= CHACHA20_BLOCK_SIZE, buf += CHACHA20_BLOCK_SIZE)
+		chacha20_block(buf, drbg->key, counter++, 0);
+	if (length) {
+		chacha20_block(block, drbg->key, counter, 0);
+		memcpy(buf, block, length);
+	}
+
+	// Fast key erasure
+	chacha20_block(block, drbg->key, 0, 0);
+	chacha20_key(drbg->key, block);
+	memset(block, 0, sizeof(block));
+}
+
+void drbgFree(struct drbg* drbg) {
+	SECRET_FREE(drbg, sizeof(struct drbg));
+}
+
+static int drbg_read(void* ctx, uint8_t buf[], size_t length) {
+	drbgGenerate(ctx, buf, length);
+	return 1;
+}
+
+/**
+ * A random source which reads from the DRBG, to hand to anything else taking a random_source
+ */
+struct random_source drbgSource(struct drbg* drbg) {
+	struct random_source source = { drbg_read, drbg };
+	return source;
+}
+
+// A uniform value below bound (> 0) from the 32-bit random value r, drawing replacements from drbg in the rare case it is biased (Lemire)
+static uint32_t uniform_below(struct drbg* drbg, uint32_t r, uint32_t bound) {
+	uint64_t m = (uint64_t)r * bound;
+	if ((uint32_t)m < bound) {
+		const uint32_t threshold = -bound % bound;
+		while ((uint32_t)m < threshold) {
+			uint8_t bytes[4];
+			drbgGenerate(drbg, bytes, sizeof(bytes));
+			m = (uint64_t)(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24)) * bound;
+		}
+	}
+	return m >> 32;
+}
+
+/*
+ * The first count values of a uniformly random permutation of values[0 .. total), by a Fisher-Yates
+ * shuffle which stops after count steps, with the random numbers for every step read in one go into
+ * random (4 * count bytes)
+ */
+static void partial_shuffle(struct drbg* drbg, uint32_t values[], uint32_t total, uint32_t count, uint8_t random[]) {
+	uint32_t i;
+	drbgGenerate(drbg, random, 4 * (size_t)count);
+	for (i = 0; i < count; i++) {
+		const uint8_t* r = &random[4 * (size_t)i];
+		const uint32_t j = i + uniform_below(drbg, r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24), total - i);
+		const uint32_t t = values[i];
+		values[i] = values[j];
+		values[j] = t;
+	}
+	memset(random, 0, 4 * (size_t)count);
+}
+
+/**
+ * Picks total_shares (at most P - secret_count) distinct X coordinates from 1 .. P - secret_count, uniformly at random
+ */
+void drbgPickPackedX(struct drbg* drbg, uint8_t x[], uint8_t total_shares, uint8_t secret_count) {
+	const uint32_t count = P - secret_count;
+	uint32_t values[P - 1];
+	uint8_t random[4 * (P - 1)];
+	uint32_t i;
+	for (i = 0; i < count; i++)
+		values[i] = i + 1;
+	partial_shuffle(drbg, values, count, total_shares, random);
+	for (i = 0; i < total_shares; i++)
+		x[i] = values[i];
+	memset(values, 0, sizeof(values));
+}
+
+/**
+ * Picks total_shares distinct nonzero X coordinates, uniformly at random
+ */
+void drbgPickX(struct drbg* drbg, uint8_t x[], uint8_t total_shares) {
+	drbgPickPackedX(drbg, x, total_shares, 1);
+}
+
+static int compare_x(const void* a, const void* b) {
+	const uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * As drbgPickX, over GF(2^field_bits) (16 or 32)
+ * Returns 0 if memory could not be allocated
+ */
+int drbgPickWideX(struct drbg* drbg, unsigned field_bits, uint32_t x[], uint32_t total_shares) {
+	uint32_t i;
+	if (field_bits == 16) {
+		uint32_t* values = malloc(65535 * sizeof(uint32_t) + 4 * (size_t)total_shares);
+		if (!values)
+			return 0;
+		for (i = 0; i < 65535; i++)
+			values[i] = i + 1;
+		partial_shuffle(drbg, values, 65535, total_shares, (uint8_t*)&values[65535]);
+		memcpy(x, values, total_shares * sizeof(uint32_t));
+		memset(values, 0, 65535 * sizeof(uint32_t));
+		free(values);
+		return 1;
+	}
+
+	// 2^32 - 1 values are too many to shuffle, but with so many a zero or a repeat is rare enough to just draw again
+	uint32_t* sorted = malloc(total_shares * sizeof(uint32_t) + 1);
+	if (!sorted)
+		return 0;
+	drbgGenerate(drbg, (uint8_t*)x, total_shares * sizeof(uint32_t));
+	for (;;) {
+		uint32_t j;
+		memcpy(sorted, x, total_shares * sizeof(uint32_t));
+		qsort(sorted, total_shares, sizeof(uint32_t), compare_x);
+		for (i = 0; i < total_shares && sorted[i] != 0 && !(i > 0 && sorted[i] == sorted[i - 1]); i++) {}
+		if (i == total_shares)
+			break;
+		for (j = 0; j < total_shares; j++)
+			if (x[j] == sorted[i])
+				drbgGenerate(drbg, (uint8_t*)&x[j], sizeof(uint32_t));
+	}
+	memset(sorted, 0, total_shares * sizeof(uint32_t));
+	free(sorted);
+	return 1;
+}
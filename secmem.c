@@ -0,0 +1,117 @@
+/*
+ * Locked memory for secrets
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "secmem.h"
+
+struct secmem {
+	uint8_t* mapping;	// guard page, data, guard page
+	size_t mapping_size;
+	uint8_t* data;
+	size_t capacity, used;
+};
+
+void secmem_wipe(void* ptr, size_t length) {
+	explicit_bzero(ptr, length);
+}
+
+struct secmem* secmem_create(size_t capacity) {
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t data_size = (capacity + page - 1) / page * page;
+	struct secmem* arena = malloc(sizeof(struct secmem));
+	if (!arena)
+		return arena;
+	arena->mapping_size = data_size + 2 * page;
+	arena->mapping = mmap((void*)0, arena->mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (arena->mapping == MAP_FAILED) {
+		free(arena);
+		return (void*)0;
+	}
+	arena->data = &arena->mapping[page];
+	arena->capacity = capacity;
+	arena->used = 0;
+	// mlock faults every page in, so nothing touching the arena later ever waits on the kernel
+	if (data_size && (mprotect(arena->data, data_size, PROT_READ | PROT_WRITE) != 0 || mlock(arena->data, data_size) != 0)) {
+		munmap(arena->mapping, arena->mapping_size);
+		free(arena);
+		return (void*)0;
+	}
+	madvise(arena->data, data_size, MADV_DONTDUMP);
+	return arena;
+}
+
+size_t secmem_size(size_t length) {
+	return (length + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+}
+
+void* secmem_alloc(struct secmem* arena, size_t length) {
+	// used is always a multiple of the alignment, and the data starts on a page
+	const size_t size = secmem_size(length);
+	if (size < length || size > arena->capacity - arena->used)
+		return (void*)0;
+	void* ptr = &arena->data[arena->used];
+	arena->used += size;
+	return ptr;
+}
+
+size_t secmem_mark(const struct secmem* arena) {
+	return arena->used;
+}
+
+void secmem_release(struct secmem* arena, size_t mark) {
+	assert(mark <= arena->used);
+	secmem_wipe(&arena->data[mark], arena->used - mark);
+	arena->used = mark;
+}
+
+void* secmem_malloc(size_t length) {
+	// The arena goes just in front of the buffer, so that secmem_free can find it
+	const size_t header = secmem_size(sizeof(struct secmem*));
+	if (secmem_size(length) < length || header + secmem_size(length) < header)
+		return (void*)0;
+	struct secmem* arena = secmem_create(header + secmem_size(length));
+	if (!arena)
+		return arena;
+	*(struct secmem**)secmem_alloc(arena, sizeof(struct secmem*)) = arena;
+	return secmem_alloc(arena, length);
+}
+
+void secmem_free(void* ptr) {
+	if (ptr)
+		secmem_destroy(*(struct secmem**)((uint8_t*)ptr - secmem_size(sizeof(struct secmem*))));
+}
+
+void secmem_destroy(struct secmem* arena) {
+	secmem_release(arena, 0);
+	munlock(arena->data, arena->mapping_size - 2 * (arena->data - arena->mapping));
+	munmap(arena->mapping, arena->mapping_size);
+	free(arena);
+}
@@ -0,0 +1,90 @@
+/*
+ * Locked memory for secrets
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECMEM_H
+#define SECMEM_H
+
+#include <stddef.h>
+
+/*
+ * An arena is a fixed-size mapping which is locked (so it is never swapped out), left out
+ * of core dumps and faulted in up-front, with an inaccessible guard page on either side so
+ * that running off either end of it faults instead of reading or writing its neighbours.
+ * Buffers are handed out from it in order (a bump allocator) and given back all at once,
+ * either everything after a mark (secmem_release) or the whole arena (secmem_destroy), and
+ * whatever is given back is always wiped with explicit_bzero.
+ *
+ * Only the arenas are locked rather than the whole process, so the memory which is locked is
+ * just what holds secrets and is bounded by the sizes the arenas are created with.
+ */
+struct secmem;
+
+/**
+ * Creates an arena with room for capacity bytes of buffers
+ * Returns NULL if it could not be mapped or locked (eg RLIMIT_MEMLOCK is too low)
+ */
+struct secmem* secmem_create(size_t capacity);
+
+/**
+ * How much of an arena's capacity a buffer of length bytes takes up: every buffer is aligned
+ * for any type (alignof(max_align_t)), so lengths are rounded up to a multiple of that.
+ * Capacities should be the sum of this over the buffers which will be allocated.
+ */
+size_t secmem_size(size_t length);
+
+/**
+ * Returns length bytes of zeroed memory from the arena, aligned for any type
+ * Returns NULL if that is more than the arena has left
+ */
+void* secmem_alloc(struct secmem* arena, size_t length);
+
+// How much of the arena is in use, for secmem_release
+size_t secmem_mark(const struct secmem* arena);
+
+/**
+ * Wipes and gives back everything allocated since mark was taken
+ */
+void secmem_release(struct secmem* arena, size_t mark);
+
+/**
+ * Wipes, unlocks and unmaps the whole arena
+ */
+void secmem_destroy(struct secmem* arena);
+
+/**
+ * A buffer of length bytes in an arena of its own, for memory which is not given back in the
+ * order it was allocated (eg behind setSecretAllocator). Each one costs a locked mapping.
+ * Returns NULL if it could not be mapped or locked
+ */
+void* secmem_malloc(size_t length);
+
+/**
+ * Wipes, unlocks and unmaps a buffer from secmem_malloc (and does nothing if ptr is NULL)
+ */
+void secmem_free(void* ptr);
+
+/**
+ * Wipes length bytes at ptr in a way the compiler may not optimise out
+ */
+void secmem_wipe(void* ptr, size_t length);
+
+#endif // SECMEM_H
@@ -0,0 +1,245 @@
+/*
+ * Split/combine server over a Unix domain socket
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "shamirssecret.h"
+#include "secmem.h"
+#include "server.h"
+
+static void put32(uint8_t out[4], uint32_t v) {
+	out[0] = v;
+	out[1] = v >> 8;
+	out[2] = v >> 16;
+	out[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t in[4]) {
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+void server_header_encode(uint8_t out[SERVER_HEADER_SIZE], const struct server_header* header) {
+	memset(out, 0, SERVER_HEADER_SIZE);
+	out[0] = header->op;
+	out[1] = header->n;
+	out[2] = header->k;
+	put32(&out[4], header->id);
+	put32(&out[8], header->length);
+}
+
+void server_header_decode(struct server_header* header, const uint8_t in[SERVER_HEADER_SIZE]) {
+	header->op = in[0];
+	header->n = in[1];
+	header->k = in[2];
+	header->id = get32(&in[4]);
+	header->length = get32(&in[8]);
+}
+
+int server_read_full(int fd, uint8_t buf[], size_t length) {
+	while (length) {
+		ssize_t got = read(fd, buf, length);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return 0;
+		buf += got;
+		length -= got;
+	}
+	return 1;
+}
+
+int server_write_full(int fd, const uint8_t buf[], size_t length) {
+	while (length) {
+		// A client which hangs up early must not take the whole server down with SIGPIPE
+		ssize_t sent = send(fd, buf, length, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return 0;
+		buf += sent;
+		length -= sent;
+	}
+	return 1;
+}
+
+/*
+ * Each worker serves one connection at a time, so no more than workers requests are ever
+ * in flight and everything a request needs lives in the worker's arena:
+ *   in      the request body, at most (P - 1) shares
+ *   out     the response header and body, likewise
+ *   random  the random coefficients of a split
+ * The arena is created (and so faulted in and locked) once at startup, so requests never
+ * page-fault or allocate, and what each request used of it is wiped after it.
+ */
+#define SHARE_SPAN (1 + (size_t)SERVER_MAX_LENGTH)
+#define IN_SIZE ((P - 1) * SHARE_SPAN)
+#define OUT_SIZE (SERVER_HEADER_SIZE + (P - 1) * SHARE_SPAN)
+#define RANDOM_SIZE ((P - 2) * (size_t)SERVER_MAX_LENGTH)
+#define ARENA_SIZE (secmem_size(IN_SIZE) + secmem_size(OUT_SIZE) + secmem_size(RANDOM_SIZE))
+
+// How long a worker waits before accepting again after accept() fails for lack of resources (EMFILE, ENOMEM, ...)
+#define ACCEPT_BACKOFF_MS 100
+
+struct worker {
+	int listen_fd;
+	struct drbg* drbg;
+	struct secmem* arena;
+	uint8_t *in, *out, *random;
+	pthread_t thread;
+};
+
+// Fills in the response body, returns its status
+static enum server_status handle_split(struct worker* worker, const struct server_header* request, uint8_t body[]) {
+	const uint8_t* secret = worker->in;
+	uint8_t* random = worker->random;
+	uint8_t x[P - 1];
+	uint8_t* shares[P - 1];
+	// drbgPickX only gives distinct nonzero X coordinates, which is all checkNoInformationLeak checks
+	drbgPickX(worker->drbg, x, request->n);
+	for (uint8_t i = 0; i < request->n; i++) {
+		body[i * (1 + request->length)] = x[i];
+		shares[i] = &body[i * (1 + request->length) + 1];
+	}
+	if (request->k > 1)
+		drbgGenerate(worker->drbg, random, (request->k - 1) * request->length);
+	splitBuffer(shares, x, request->n, secret, random, request->k, request->length);
+	secmem_wipe(random, (request->k - 1) * request->length);
+	return SERVER_OK;
+}
+
+static enum server_status handle_combine(struct worker* worker, const struct server_header* request, uint8_t body[]) {
+	uint8_t x[P - 1];
+	const uint8_t* shares[P - 1];
+	for (uint8_t i = 0; i < request->k; i++) {
+		x[i] = worker->in[i * (1 + request->length)];
+		shares[i] = &worker->in[i * (1 + request->length) + 1];
+		if (x[i] == 0)
+			return SERVER_BAD_SHARES;
+		for (uint8_t j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return SERVER_BAD_SHARES;
+	}
+	combineBuffer(body, x, shares, request->k, request->length);
+	return SERVER_OK;
+}
+
+// Serves requests until the client hangs up or sends something malformed
+static void serve_connection(struct worker* worker, int fd) {
+	uint8_t* in = worker->in;
+	uint8_t* out = worker->out;
+	uint8_t encoded[SERVER_HEADER_SIZE];
+	struct server_header request;
+	while (server_read_full(fd, encoded, SERVER_HEADER_SIZE)) {
+		server_header_decode(&request, encoded);
+		struct server_header response = { SERVER_BAD_REQUEST, 0, 0, request.id, 0 };
+		const int valid = (request.op == SERVER_OP_SPLIT || request.op == SERVER_OP_COMBINE) && request.n > 0 &&
+				request.k > 0 && request.k <= request.n && request.length > 0 && request.length <= SERVER_MAX_LENGTH;
+		if (!valid) {
+			server_header_encode(out, &response);
+			server_write_full(fd, out, SERVER_HEADER_SIZE);
+			break;
+		}
+
+		const size_t in_length = request.op == SERVER_OP_SPLIT ? request.length : request.n * (1 + (size_t)request.length);
+		const size_t out_length = request.op == SERVER_OP_SPLIT ? request.n * (1 + (size_t)request.length) : request.length;
+		if (!server_read_full(fd, in, in_length))
+			break;
+		response.op = request.op == SERVER_OP_SPLIT ? handle_split(worker, &request, &out[SERVER_HEADER_SIZE]) :
+				handle_combine(worker, &request, &out[SERVER_HEADER_SIZE]);
+		if (response.op == SERVER_OK) {
+			response.n = request.n;
+			response.k = request.k;
+			response.length = request.length;
+		}
+		server_header_encode(out, &response);
+		const int sent = server_write_full(fd, out, SERVER_HEADER_SIZE + (response.op == SERVER_OK ? out_length : 0));
+
+		secmem_wipe(in, in_length);
+		secmem_wipe(out, SERVER_HEADER_SIZE + out_length);
+		if (!sent)
+			break;
+	}
+	close(fd);
+}
+
+static void* worker_main(void* arg) {
+	struct worker* worker = arg;
+	for (;;) {
+		int fd = accept(worker->listen_fd, (void*)0, (void*)0);
+		if (fd < 0) {
+			// Out of descriptors or memory will not clear up by asking again straight away
+			if (errno != EINTR && errno != ECONNABORTED)
+				poll((void*)0, 0, ACCEPT_BACKOFF_MS);
+			continue;
+		}
+		serve_connection(worker, fd);
+	}
+	return (void*)0;
+}
+
+int server_run(const char* path, unsigned workers, const struct random_source* seed_source) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 0;
+	// Anyone who can connect can split and combine, so only this user may
+	const mode_t old_umask = umask(0077);
+	const int bound = bind(fd, (const struct sockaddr*)&addr, sizeof(addr));
+	umask(old_umask);
+	if (bound != 0 || listen(fd, 64) != 0) {
+		close(fd);
+		return 0;
+	}
+
+	struct worker worker_list[workers];
+	for (unsigned i = 0; i < workers; i++) {
+		worker_list[i].listen_fd = fd;
+		worker_list[i].arena = secmem_create(ARENA_SIZE);
+		if (!worker_list[i].arena)
+			return 0;
+		worker_list[i].in = secmem_alloc(worker_list[i].arena, IN_SIZE);
+		worker_list[i].out = secmem_alloc(worker_list[i].arena, OUT_SIZE);
+		worker_list[i].random = secmem_alloc(worker_list[i].arena, RANDOM_SIZE);
+		worker_list[i].drbg = drbgCreate(seed_source);
+		if (!worker_list[i].in || !worker_list[i].out || !worker_list[i].random || !worker_list[i].drbg)
+			return 0;
+	}
+	// The calling thread is the first worker
+	for (unsigned i = 1; i < workers; i++)
+		if (pthread_create(&worker_list[i].thread, (void*)0, worker_main, &worker_list[i]) != 0)
+			return 0;
+	worker_main(&worker_list[0]);
+	return 0;
+}
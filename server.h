@@ -0,0 +1,86 @@
+/*
+ * Split/combine server over a Unix domain socket
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Every request and response is a SERVER_HEADER_SIZE byte header followed by a body:
+ *   0   op (enum server_op) in a request, status (enum server_status) in a response
+ *   1   n: the number of shares to split into, or given to combine
+ *   2   k
+ *   3   reserved (0)
+ *   4   request ID, chosen by the client and echoed back (4 bytes)
+ *   8   length of the secret, which is also the length of each share (4 bytes)
+ *   12  reserved (0, 4 bytes)
+ * with every integer little endian. Shares travel as their x byte followed by length bytes,
+ * as in legacy share files. The bodies are
+ *   split request      secret
+ *   split response     n shares
+ *   combine request    n shares (n >= k, the first k of which are used)
+ *   combine response   secret
+ * and every error response has an empty body (its n, k and length being 0).
+ *
+ * A client may send any number of requests without waiting (pipelining); the responses to
+ * the requests on one connection come back in the order the requests were sent.
+ */
+
+#define SERVER_HEADER_SIZE 16
+#define SERVER_MAX_LENGTH 4096
+
+enum server_op {
+	SERVER_OP_SPLIT = 1,
+	SERVER_OP_COMBINE = 2,
+};
+
+enum server_status {
+	SERVER_OK = 0,
+	SERVER_BAD_REQUEST = 1,		// unknown op, or n, k or length out of range (the connection is then closed)
+	SERVER_BAD_SHARES = 2,		// X coordinates zero or repeated
+};
+
+struct server_header {
+	uint8_t op, n, k;
+	uint32_t id, length;
+};
+
+void server_header_encode(uint8_t out[SERVER_HEADER_SIZE], const struct server_header* header);
+void server_header_decode(struct server_header* header, const uint8_t in[SERVER_HEADER_SIZE]);
+
+// Read or write exactly length bytes, retrying short transfers, and return 0 on failure or hang-up
+int server_read_full(int fd, uint8_t buf[], size_t length);
+int server_write_full(int fd, const uint8_t buf[], size_t length);
+
+struct random_source;
+
+/**
+ * Serves requests on a socket at path (which must not exist, and is created readable and writable
+ * only by this user) with workers threads, each owning a locked, pre-faulted arena big enough for
+ * the largest request and a DRBG seeded from seed_source before any request is taken
+ * Only returns (0) if the socket, arenas or threads could not be set up
+ */
+int server_run(const char* path, unsigned workers, const struct random_source* seed_source);
+
+#endif // SERVER_H
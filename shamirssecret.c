@@ -20,112 +20,341 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#include "field.h"
+#include "erasure.h"
 #ifndef IN_KERNEL
-#include <assert.h>
-#define CHECKSTATE(x) assert(x)
-#else
-#include <linux/bug.h>
-#define CHECKSTATE(x) BUG_ON(!(x))
+#include "fft.h"
+#include "pool.h"
 #endif
 
-#include "shamirssecret.h"
+/*
+ * Calculations across the polynomial q
+ */
+/**
+ * Calculates the Y coordinate that the point with the given X
+ * coefficients[0] == secret, the rest are random values
+ */
+uint8_t calculateQ(uint8_t coefficients[], uint8_t shares_required, uint8_t x) {
+	// Horner's rule, from the highest coefficient down
+	uint8_t ret = 0, i;
+	CHECKSTATE(x != 0); // q(0) == secret, though so does a[0]
+	if (shares_required == 0)
+		return ret; // no coefficients at all
+	ret = coefficients[shares_required - 1];
+	for (i = shares_required - 1; i > 0; i--)
+		ret = field_add(field_mul(ret, x), coefficients[i - 1]);
+	return ret;
+}
 
-#ifndef noinline
-#define noinline __attribute__((noinline))
-#endif
+/**
+ * Derives the secret given a set of shares_required points (x and q coordinates)
+ */
+uint8_t calculateSecret(uint8_t x[], uint8_t q[], uint8_t shares_required) {
+	// Calculate the x^0 term using a derivation of the formula at
+	// http://en.wikipedia.org/wiki/Lagrange_polynomial#Example_2
+	uint8_t ret = 0, i, j;
+	for (i = 0; i < shares_required; i++) {
+		uint8_t temp = q[i];
+		for (j = 0; j < shares_required; j++) {
+			if (i == j)
+				continue;
+			temp = field_mul(temp, field_neg(x[j]));
+			temp = field_mul(temp, field_invert(field_sub(x[i], x[j])));
+		}
+		ret = field_add(ret, temp);
+	}
+	return ret;
+}
+
+uint8_t packedSecretX(uint8_t j) {
+	return packed_secret_x(j);
+}
+
+// The Lagrange basis polynomial of points[i] (over all count points) at x
+static uint8_t lagrange_basis(const uint8_t points[], uint8_t count, uint8_t i, uint8_t x) {
+	uint8_t ret = 1, j;
+	for (j = 0; j < count; j++) {
+		if (j == i)
+			continue;
+		ret = field_mul(ret, field_sub(x, points[j]));
+		ret = field_mul(ret, field_invert(field_sub(points[i], points[j])));
+	}
+	return ret;
+}
+
+/**
+ * Calculates the Y coordinate of the point with the given X, which must not be a secret point
+ * random holds the shares_required - 1 coefficients of R, lowest first
+ */
+uint8_t calculatePackedQ(uint8_t secrets[], uint8_t secret_count, uint8_t random[], uint8_t shares_required, uint8_t x) {
+	uint8_t points[secret_count];
+	uint8_t ret = 0, z = 1, i;
+	CHECKSTATE(!packed_is_secret_x(x, secret_count));
+	for (i = 0; i < secret_count; i++)
+		points[i] = packedSecretX(i);
+	// S(x), then Z(x) * R(x)
+	for (i = 0; i < secret_count; i++) {
+		ret = field_add(ret, field_mul(secrets[i], lagrange_basis(points, secret_count, i, x)));
+		z = field_mul(z, field_sub(x, points[i]));
+	}
+	if (shares_required > 1)
+		ret = field_add(ret, field_mul(z, calculateQ(random, shares_required - 1, x)));
+	return ret;
+}
+
+/**
+ * Derives the secret_count secrets given shares_required + secret_count - 1 points (x and q coordinates)
+ */
+void calculatePackedSecrets(uint8_t secrets[], uint8_t secret_count, uint8_t x[], uint8_t q[], uint8_t shares_required) {
+	const uint8_t count = shares_required + secret_count - 1;
+	uint8_t i, j;
+	for (j = 0; j < secret_count; j++) {
+		secrets[j] = 0;
+		for (i = 0; i < count; i++)
+			secrets[j] = field_add(secrets[j], field_mul(q[i], lagrange_basis(x, count, i, packedSecretX(j))));
+	}
+}
+
+int packedCheckX(const uint8_t x[], uint8_t total_shares, uint8_t secret_count) {
+	uint8_t i, j;
+	for (i = 0; i < total_shares; i++) {
+		if (packed_is_secret_x(x[i], secret_count))
+			return 0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return 0;
+	}
+	return 1;
+}
+
+/**
+ * Checks that no shares_required - 1 of the shares with the given X coordinates, together with a
+ * share at any other X coordinate, can rule out any possible secret (ie that such a share always
+ * has a nonzero Lagrange weight, so every value of it gives a different secret)
+ * Returns 1 if so, 0 if the X coordinates are not distinct and nonzero
+ */
+int checkNoInformationLeak(const uint8_t x[], uint8_t total_shares, uint8_t shares_required) {
+	// The secret derived from a set S of shares_required - 1 shares plus one at final_x is
+	//   secret = (terms only depending on S) + q(final_x) * weight
+	// where weight = product over j in S of x[j] / (x[j] - final_x). If weight is nonzero,
+	// multiplying by it is a bijection on the field, so each of the P possible values of
+	// q(final_x) gives a different one of the P possible secrets, ie S tells us nothing.
+	// The field has no zero divisors, so weight is nonzero exactly when every factor is: when
+	// every x[j] is nonzero and differs from final_x, which is any other X coordinate. So
+	// distinct nonzero X coordinates are the whole proof, for every S (an empty S has weight 1).
+	uint8_t i, j;
+	CHECKSTATE(shares_required <= total_shares);
+	for (i = 0; i < total_shares; i++) {
+		if (x[i] == 0)
+			return 0;
+		for (j = 0; j < i; j++)
+			if (x[j] == x[i])
+				return 0;
+	}
+	return 1;
+}
 
 /*
- * Calculations across the finite field GF(2^8)
+ * Calculations across whole buffers, one byte of the secret per polynomial
  */
 
-static uint8_t field_add(uint8_t a, uint8_t b) {
-	return a ^ b;
-}
-
-static uint8_t field_sub(uint8_t a, uint8_t b) {
-	return a ^ b;
-}
-
-static uint8_t field_neg(uint8_t a) {
-	return field_sub(0, a);
-}
-
-//TODO: Using static tables will very likely create side-channel attacks when measuring cache hits
-//      Because these are fairly small tables, we can probably get them loaded mostly/fully into
-//      cache before use to break such attacks.
-static const uint8_t exp[P] = {
-	0x01, 0x03, 0x05, 0x0f, 0x11, 0x33, 0x55, 0xff, 0x1a, 0x2e, 0x72, 0x96, 0xa1, 0xf8, 0x13, 0x35,
-	0x5f, 0xe1, 0x38, 0x48, 0xd8, 0x73, 0x95, 0xa4, 0xf7, 0x02, 0x06, 0x0a, 0x1e, 0x22, 0x66, 0xaa,
-	0xe5, 0x34, 0x5c, 0xe4, 0x37, 0x59, 0xeb, 0x26, 0x6a, 0xbe, 0xd9, 0x70, 0x90, 0xab, 0xe6, 0x31,
-	0x53, 0xf5, 0x04, 0x0c, 0x14, 0x3c, 0x44, 0xcc, 0x4f, 0xd1, 0x68, 0xb8, 0xd3, 0x6e, 0xb2, 0xcd,
-	0x4c, 0xd4, 0x67, 0xa9, 0xe0, 0x3b, 0x4d, 0xd7, 0x62, 0xa6, 0xf1, 0x08, 0x18, 0x28, 0x78, 0x88,
-	0x83, 0x9e, 0xb9, 0xd0, 0x6b, 0xbd, 0xdc, 0x7f, 0x81, 0x98, 0xb3, 0xce, 0x49, 0xdb, 0x76, 0x9a,
-	0xb5, 0xc4, 0x57, 0xf9, 0x10, 0x30, 0x50, 0xf0, 0x0b, 0x1d, 0x27, 0x69, 0xbb, 0xd6, 0x61, 0xa3,
-	0xfe, 0x19, 0x2b, 0x7d, 0x87, 0x92, 0xad, 0xec, 0x2f, 0x71, 0x93, 0xae, 0xe9, 0x20, 0x60, 0xa0,
-	0xfb, 0x16, 0x3a, 0x4e, 0xd2, 0x6d, 0xb7, 0xc2, 0x5d, 0xe7, 0x32, 0x56, 0xfa, 0x15, 0x3f, 0x41,
-	0xc3, 0x5e, 0xe2, 0x3d, 0x47, 0xc9, 0x40, 0xc0, 0x5b, 0xed, 0x2c, 0x74, 0x9c, 0xbf, 0xda, 0x75,
-	0x9f, 0xba, 0xd5, 0x64, 0xac, 0xef, 0x2a, 0x7e, 0x82, 0x9d, 0xbc, 0xdf, 0x7a, 0x8e, 0x89, 0x80,
-	0x9b, 0xb6, 0xc1, 0x58, 0xe8, 0x23, 0x65, 0xaf, 0xea, 0x25, 0x6f, 0xb1, 0xc8, 0x43, 0xc5, 0x54,
-	0xfc, 0x1f, 0x21, 0x63, 0xa5, 0xf4, 0x07, 0x09, 0x1b, 0x2d, 0x77, 0x99, 0xb0, 0xcb, 0x46, 0xca,
-	0x45, 0xcf, 0x4a, 0xde, 0x79, 0x8b, 0x86, 0x91, 0xa8, 0xe3, 0x3e, 0x42, 0xc6, 0x51, 0xf3, 0x0e,
-	0x12, 0x36, 0x5a, 0xee, 0x29, 0x7b, 0x8d, 0x8c, 0x8f, 0x8a, 0x85, 0x94, 0xa7, 0xf2, 0x0d, 0x17,
-	0x39, 0x4b, 0xdd, 0x7c, 0x84, 0x97, 0xa2, 0xfd, 0x1c, 0x24, 0x6c, 0xb4, 0xc7, 0x52, 0xf6, 0x01};
-static const uint8_t log[P] = {
-	0x00, // log(0) is not defined
-	0xff, 0x19, 0x01, 0x32, 0x02, 0x1a, 0xc6, 0x4b, 0xc7, 0x1b, 0x68, 0x33, 0xee, 0xdf, 0x03, 0x64,
-	0x04, 0xe0, 0x0e, 0x34, 0x8d, 0x81, 0xef, 0x4c, 0x71, 0x08, 0xc8, 0xf8, 0x69, 0x1c, 0xc1, 0x7d,
-	0xc2, 0x1d, 0xb5, 0xf9, 0xb9, 0x27, 0x6a, 0x4d, 0xe4, 0xa6, 0x72, 0x9a, 0xc9, 0x09, 0x78, 0x65,
-	0x2f, 0x8a, 0x05, 0x21, 0x0f, 0xe1, 0x24, 0x12, 0xf0, 0x82, 0x45, 0x35, 0x93, 0xda, 0x8e, 0x96,
-	0x8f, 0xdb, 0xbd, 0x36, 0xd0, 0xce, 0x94, 0x13, 0x5c, 0xd2, 0xf1, 0x40, 0x46, 0x83, 0x38, 0x66,
-	0xdd, 0xfd, 0x30, 0xbf, 0x06, 0x8b, 0x62, 0xb3, 0x25, 0xe2, 0x98, 0x22, 0x88, 0x91, 0x10, 0x7e,
-	0x6e, 0x48, 0xc3, 0xa3, 0xb6, 0x1e, 0x42, 0x3a, 0x6b, 0x28, 0x54, 0xfa, 0x85, 0x3d, 0xba, 0x2b,
-	0x79, 0x0a, 0x15, 0x9b, 0x9f, 0x5e, 0xca, 0x4e, 0xd4, 0xac, 0xe5, 0xf3, 0x73, 0xa7, 0x57, 0xaf,
-	0x58, 0xa8, 0x50, 0xf4, 0xea, 0xd6, 0x74, 0x4f, 0xae, 0xe9, 0xd5, 0xe7, 0xe6, 0xad, 0xe8, 0x2c,
-	0xd7, 0x75, 0x7a, 0xeb, 0x16, 0x0b, 0xf5, 0x59, 0xcb, 0x5f, 0xb0, 0x9c, 0xa9, 0x51, 0xa0, 0x7f,
-	0x0c, 0xf6, 0x6f, 0x17, 0xc4, 0x49, 0xec, 0xd8, 0x43, 0x1f, 0x2d, 0xa4, 0x76, 0x7b, 0xb7, 0xcc,
-	0xbb, 0x3e, 0x5a, 0xfb, 0x60, 0xb1, 0x86, 0x3b, 0x52, 0xa1, 0x6c, 0xaa, 0x55, 0x29, 0x9d, 0x97,
-	0xb2, 0x87, 0x90, 0x61, 0xbe, 0xdc, 0xfc, 0xbc, 0x95, 0xcf, 0xcd, 0x37, 0x3f, 0x5b, 0xd1, 0x53,
-	0x39, 0x84, 0x3c, 0x41, 0xa2, 0x6d, 0x47, 0x14, 0x2a, 0x9e, 0x5d, 0x56, 0xf2, 0xd3, 0xab, 0x44,
-	0x11, 0x92, 0xd9, 0x23, 0x20, 0x2e, 0x89, 0xb4, 0x7c, 0xb8, 0x26, 0x77, 0x99, 0xe3, 0xa5, 0x67,
-	0x4a, 0xed, 0xde, 0xc5, 0x31, 0xfe, 0x18, 0x0d, 0x63, 0x8c, 0x80, 0xc0, 0xf7, 0x70, 0x07};
-
-// We disable lots of optimizations that result in non-constant runtime (+/- branch delays)
-static uint8_t field_mul_ret(uint8_t calc, uint8_t a, uint8_t b) __attribute__((optimize("-O0"))) noinline;
-static uint8_t field_mul_ret(uint8_t calc, uint8_t a, uint8_t b) {
-	uint8_t ret, ret2;
-	if (a == 0)
-		ret2 = 0;
+// Calculates bytes [offset, offset + count) of every share, where each random row is length bytes long
+// With transform scratch (see split_chunks) the transform is used, otherwise the Vandermonde rows
+static void split_range(uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, uint8_t scratch[], size_t length, size_t offset, size_t count) {
+	const uint8_t* coefficients[shares_required];
+	uint8_t x_pows[shares_required], i, j;
+	coefficients[0] = secret;
+	for (j = 1; j < shares_required; j++)
+		coefficients[j] = &random[(j - 1) * length];
+#ifndef IN_KERNEL
+	if (scratch) {
+		fft_encode_range(shares, x, total_shares, coefficients, shares_required, scratch, offset, count);
+		return;
+	}
+#endif
+	for (i = 0; i < total_shares; i++) {
+		CHECKSTATE(x[i] != 0); // q(0) == secret
+		matrix_vandermonde(x_pows, &x[i], 1, shares_required);
+		field_dot_buf(shares[i], coefficients, x_pows, shares_required, offset, count);
+	}
+}
+
+// split_range on the chunks at first, first + stride, ... sharing one scratch allocation
+static void split_chunks(uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, size_t length, size_t chunk, size_t first, size_t stride) {
+	size_t scratch_size = 0, offset;
+	uint8_t* scratch;
+	if (first >= length)
+		return;
+#ifndef IN_KERNEL
+	if (fft_encode_cheaper(total_shares, shares_required))
+		scratch_size = fft_encode_scratch(shares_required, length < chunk ? length : chunk);
+#endif
+	scratch = scratch_size ? SECRET_ALLOC(scratch_size) : (void*)0;
+	for (offset = first; offset < length; offset += stride)
+		split_range(shares, x, total_shares, secret, random, shares_required, scratch, length, offset, length - offset < chunk ? length - offset : chunk);
+	if (scratch)
+		SECRET_FREE(scratch, scratch_size);
+}
+
+/**
+ * Calculates length bytes of every share at once
+ * shares[i] receives the Y coordinates of the points with X coordinate x[i]
+ * random holds (shares_required - 1) rows of length secure random bytes, one
+ * row per non-constant coefficient
+ */
+void splitBuffer(uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, size_t length) {
+	const size_t chunk = chunk_size(total_shares + shares_required);
+	split_chunks(shares, x, total_shares, secret, random, shares_required, length, chunk, 0, chunk);
+}
+
+// Calculates the x^0 term of each Lagrange basis polynomial, which only depends on the X coordinates
+static void lagrange_weights(uint8_t weights[], const uint8_t x[], uint8_t shares_required) {
+	uint8_t i, j;
+	for (i = 0; i < shares_required; i++) {
+		uint8_t weight = 1;
+		for (j = 0; j < shares_required; j++) {
+			if (i == j)
+				continue;
+			weight = field_mul(weight, field_neg(x[j]));
+			weight = field_mul(weight, field_invert(field_sub(x[i], x[j])));
+		}
+		weights[i] = weight;
+	}
+}
+
+static void combine_weighted(uint8_t secret[], const uint8_t weights[], const uint8_t* const shares[], uint8_t shares_required, size_t offset, size_t count) {
+	field_dot_buf(secret, shares, weights, shares_required, offset, count);
+}
+
+/**
+ * Derives length bytes of the secret given shares_required share buffers and their X coordinates
+ */
+void combineBuffer(uint8_t secret[], const uint8_t x[], const uint8_t* const shares[], uint8_t shares_required, size_t length) {
+	uint8_t weights[shares_required];
+	lagrange_weights(weights, x, shares_required);
+	combine_weighted(secret, weights, shares, shares_required, 0, length);
+}
+
+struct combiner {
+	uint8_t shares_required;
+	uint8_t weights[];
+};
+
+/**
+ * Calculates the weights for the given shares_required X coordinates
+ * Returns NULL if memory could not be allocated
+ */
+struct combiner* combinerCreate(const uint8_t x[], uint8_t shares_required) {
+	struct combiner* combiner = ALLOC(sizeof(struct combiner) + shares_required);
+	if (!combiner)
+		return combiner;
+	combiner->shares_required = shares_required;
+	lagrange_weights(combiner->weights, x, shares_required);
+	return combiner;
+}
+
+/**
+ * Derives the secret given the q coordinates of the points the combiner was created with
+ */
+uint8_t combinerSecret(const struct combiner* combiner, const uint8_t q[]) {
+	uint8_t ret = 0, i;
+	for (i = 0; i < combiner->shares_required; i++)
+		ret = field_add(ret, field_mul(combiner->weights[i], q[i]));
+	return ret;
+}
+
+void combinerBuffer(const struct combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length) {
+	combine_weighted(secret, combiner->weights, shares, combiner->shares_required, 0, length);
+}
+
+void combinerFree(struct combiner* combiner) {
+	FREE(combiner);
+}
+
+#ifndef IN_KERNEL
+static struct secret_allocator secret_allocator;
+// Called through a volatile pointer so that wiping memory which is about to be freed (or go out of scope) is not optimised out
+static void* (*volatile wipe_memset)(void*, int, size_t) = memset;
+
+void setSecretAllocator(const struct secret_allocator* allocator) {
+	if (allocator)
+		secret_allocator = *allocator;
 	else
-		ret2 = calc;
-	if (b == 0)
-		ret = 0;
+		memset(&secret_allocator, 0, sizeof(secret_allocator));
+}
+
+void* secret_alloc(size_t length) {
+	return secret_allocator.alloc ? secret_allocator.alloc(secret_allocator.ctx, length) : malloc(length);
+}
+
+void secret_wipe(void* ptr, size_t length) {
+	wipe_memset(ptr, 0, length);
+}
+
+void secret_free(void* ptr, size_t length) {
+	if (!ptr)
+		return;
+	secret_wipe(ptr, length);
+	if (secret_allocator.free)
+		secret_allocator.free(secret_allocator.ctx, ptr);
 	else
-		ret = ret2;
-	return ret;
+		free(ptr);
 }
-static uint8_t field_mul(uint8_t a, uint8_t b)  {
-	return field_mul_ret(exp[(log[a] + log[b]) % 255], a, b);
+
+struct split_job {
+	uint8_t** shares;
+	const uint8_t* x;
+	uint8_t total_shares;
+	const uint8_t* secret;
+	const uint8_t* random;
+	uint8_t shares_required;
+	size_t length, chunk, tasks;
+};
+
+static void split_task(void* arg, size_t task) {
+	const struct split_job* job = arg;
+	split_chunks(job->shares, job->x, job->total_shares, job->secret, job->random, job->shares_required, job->length, job->chunk, task * job->chunk, job->tasks * job->chunk);
 }
 
-static uint8_t field_invert(uint8_t a) {
-	CHECKSTATE(a != 0);
-	return exp[0xff - log[a]]; // log[1] == 0xff
+/**
+ * splitBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ * Each chunk only writes its own slice of every share, so the results are identical to splitBuffer
+ * Each thread takes every tasks'th chunk, so that it only allocates the transform's scratch once
+ */
+void splitBufferParallel(struct pool* pool, uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, size_t length) {
+	const size_t chunk = chunk_size(total_shares + shares_required);
+	struct split_job job = { shares, x, total_shares, secret, random, shares_required, length, chunk, pool_strided_tasks(pool, length, chunk) };
+	pool_run(pool, split_task, &job, job.tasks);
 }
 
-static uint8_t field_pow(uint8_t a, uint8_t e) {
-	uint8_t ret = exp[(log[a] * e) % 255];
-#ifndef TEST
-	// We only work for a == 0 by branching (below), but since we
-	// never call with a==0, we just assert a != 0 (except when testing)
-	CHECKSTATE(a != 0);
-#else
-	if (a == 0 && e != 0)
-		ret = 0;
-#endif
-	return ret;
+struct combine_job {
+	const struct combiner* combiner;
+	uint8_t* secret;
+	const uint8_t* const* shares;
+	size_t length, chunk;
+};
+
+static void combine_task(void* arg, size_t task) {
+	const struct combine_job* job = arg;
+	size_t offset = task * job->chunk;
+	size_t count = job->length - offset < job->chunk ? job->length - offset : job->chunk;
+	combine_weighted(job->secret, job->combiner->weights, job->shares, job->combiner->shares_required, offset, count);
+}
+
+/**
+ * combinerBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ */
+void combinerBufferParallel(struct pool* pool, const struct combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length) {
+	struct combine_job job = { combiner, secret, shares, length, chunk_size(combiner->shares_required + 1) };
+	pool_run(pool, combine_task, &job, (length + job.chunk - 1) / job.chunk);
 }
+#endif // !defined(IN_KERNEL)
 
 #ifdef TEST
+#include "chacha20.h"
+#include "share.h"
+#include "ed25519.h"
+
 static uint8_t field_mul_calc(uint8_t a, uint8_t b) {
 	// side-channel attacks here
 	uint8_t ret = 0;
@@ -142,6 +371,24 @@ static uint8_t field_mul_calc(uint8_t a, uint8_t b) {
 	}
 	return ret;
 }
+static uint8_t test_rand(uint32_t* state) {
+	*state = *state * 1103515245 + 12345;
+	return *state >> 16;
+}
+static int counting_read(void* ctx, uint8_t buf[], size_t length) {
+	for (size_t i = 0; i < length; i++)
+		buf[i] = i;
+	return 1;
+}
+// ctx counts how many buffers are live
+static void* counting_alloc(void* ctx, size_t length) {
+	(*(int*)ctx)++;
+	return calloc(1, length + 1);
+}
+static void counting_free(void* ctx, void* ptr) {
+	(*(int*)ctx)--;
+	free(ptr);
+}
 static uint8_t field_pow_calc(uint8_t a, uint8_t e) {
 	uint8_t ret = 1;
 	for (uint8_t i = 0; i < e; i++)
@@ -165,6 +412,16 @@ int main() {
 			CHECKSTATE(field_pow(i, j) == field_pow_calc(i, j));
 	}
 
+	// Test the table-free versions against the table ones
+	for (uint16_t i = 0; i < P; i++) {
+		if (i != 0)
+			CHECKSTATE(field_invert_ct(i) == field_invert_table(i));
+		for (uint16_t j = 0; j < P; j++) {
+			CHECKSTATE(field_mul_ct(i, j) == field_mul_table(i, j));
+			CHECKSTATE(field_pow_ct(i, j) == field_pow_table(i, j));
+		}
+	}
+
 	// Test invertibility of add/negate/subtract
 	for (uint16_t i = 0; i < P; i++) {
 		CHECKSTATE(field_neg(field_neg(i)) == i);
@@ -175,45 +432,908 @@ int main() {
 			CHECKSTATE(field_add(field_neg(j), i) == field_sub(i, j));
 		}
 	}
-}
-#endif // defined(TEST)
 
+	// Test every supported buffer kernel against the per-byte multiply
+	enum field_kernel best_kernel = field_kernel_selected();
+	for (enum field_kernel kernel = 0; kernel < FIELD_KERNEL_COUNT; kernel++) {
+		if (!field_kernel_supported(kernel))
+			continue;
+#ifdef FIELD_CONSTANT_TIME
+		if (!field_kernel_constant_time(kernel))
+			continue;
+#endif
+		field_kernel_select(kernel);
+		uint8_t src[200], dst[200], expected[200];
+		for (uint16_t i = 0; i < sizeof(src); i++)
+			src[i] = i * 37 + 11;
+		for (uint16_t c = 0; c < P; c++) {
+			for (uint16_t length = 0; length <= sizeof(src); length += 1 + length / 8) {
+				for (uint16_t i = 0; i < sizeof(dst); i++)
+					dst[i] = expected[i] = i + c;
+				field_mul_add_buf(dst, src, c, length);
+				for (uint16_t i = 0; i < length; i++)
+					expected[i] = field_add(expected[i], field_mul(c, src[i]));
+				CHECKSTATE(memcmp(dst, expected, sizeof(dst)) == 0);
 
+				field_mul_buf(dst, src, c, length);
+				for (uint16_t i = 0; i < length; i++)
+					expected[i] = field_mul(c, src[i]);
+				CHECKSTATE(memcmp(dst, expected, sizeof(dst)) == 0);
+			}
+		}
 
-/*
- * Calculations across the polynomial q
- */
-#ifndef TEST
-/**
- * Calculates the Y coordinate that the point with the given X
- * coefficients[0] == secret, the rest are random values
- */
-uint8_t calculateQ(uint8_t coefficients[], uint8_t shares_required, uint8_t x) {
-	uint8_t ret = coefficients[0], i;
-	CHECKSTATE(x != 0); // q(0) == secret, though so does a[0]
-	for (i = 1; i < shares_required; i++) {
-		ret = field_add(ret, field_mul(coefficients[i], field_pow(x, i)));
+		// Sums of up to 9 rows, starting part way into the buffers and long enough for the unrolled loops
+		uint8_t rows_src[9][600], c[9], dot[600], dot_expected[600];
+		const uint8_t* rows[9];
+		for (uint8_t j = 0; j < 9; j++) {
+			for (uint16_t i = 0; i < sizeof(rows_src[j]); i++)
+				rows_src[j][i] = i * 13 + j * 101 + 7;
+			rows[j] = rows_src[j];
+			c[j] = j * 59 + 1;
+		}
+		for (uint8_t count = 0; count <= 9; count++) {
+			for (uint16_t length = 0; length + 3 <= sizeof(dot); length += 1 + length / 8) {
+				for (uint16_t i = 0; i < sizeof(dot); i++)
+					dot[i] = dot_expected[i] = i;
+				for (uint16_t i = 0; i < length; i++) {
+					dot_expected[3 + i] = 0;
+					for (uint8_t j = 0; j < count; j++)
+						dot_expected[3 + i] = field_add(dot_expected[3 + i], field_mul(c[j], rows_src[j][3 + i]));
+				}
+				field_dot_buf(dot, rows, c, count, 3, length);
+				CHECKSTATE(memcmp(dot, dot_expected, sizeof(dot)) == 0);
+			}
+		}
 	}
-	return ret;
-}
+	field_kernel_select(best_kernel);
 
-/**
- * Derives the secret given a set of shares_required points (x and q coordinates)
- */
-uint8_t calculateSecret(uint8_t x[], uint8_t q[], uint8_t shares_required) {
-	// Calculate the x^0 term using a derivation of the formula at
-	// http://en.wikipedia.org/wiki/Lagrange_polynomial#Example_2
-	uint8_t ret = 0, i, j;
-	for (i = 0; i < shares_required; i++) {
-		uint8_t temp = q[i];
-		for (j = 0; j < shares_required; j++) {
-			if (i == j)
-				continue;
-			temp = field_mul(temp, field_neg(x[j]));
-			temp = field_mul(temp, field_invert(field_sub(x[i], x[j])));
+	// Test the information leak check accepts distinct nonzero X coordinates only
+	{
+		uint8_t x[P - 1];
+		for (uint16_t i = 0; i < P - 1; i++)
+			x[i] = P - 1 - i;
+		CHECKSTATE(checkNoInformationLeak(x, P - 1, 1));
+		CHECKSTATE(checkNoInformationLeak(x, P - 1, 128));
+		CHECKSTATE(checkNoInformationLeak(x, 3, 3));
+		x[2] = x[0];
+		CHECKSTATE(!checkNoInformationLeak(x, 3, 2));
+		x[2] = 0;
+		CHECKSTATE(!checkNoInformationLeak(x, 3, 2));
+
+		// And that the exhaustive audit agrees, visiting every subset once
+		struct pool* pool = poolCreate(3);
+		uint64_t subsets;
+		CHECKSTATE(pool);
+		for (uint16_t i = 0; i < P - 1; i++)
+			x[i] = 1 + (i * 7) % (P - 1);
+		CHECKSTATE(auditNoInformationLeak(pool, x, 12, 1, &subsets) && subsets == 1);
+		CHECKSTATE(auditNoInformationLeak(pool, x, 12, 2, &subsets) && subsets == 12);
+		CHECKSTATE(auditNoInformationLeak((void*)0, x, 12, 5, &subsets) && subsets == 495);
+		CHECKSTATE(auditNoInformationLeak(pool, x, 12, 5, &subsets) && subsets == 495);
+		CHECKSTATE(auditNoInformationLeak(pool, x, 12, 12, &subsets) && subsets == 12);
+		// The brute-force audit goes over the bytes of real shares instead, subset by subset
+		uint8_t audit_secret[4] = { 0x00, 0x5a, 0xff, 0x13 }, audit_random[2 * 4], audit_shares[8][4];
+		uint8_t* audit_pointers[8];
+		for (uint8_t i = 0; i < 8; i++)
+			audit_pointers[i] = audit_shares[i];
+		for (uint8_t i = 0; i < sizeof(audit_random); i++)
+			audit_random[i] = i * 37 + 11;
+		splitBuffer(audit_pointers, x, 8, audit_secret, audit_random, 3, 4);
+		CHECKSTATE(auditSharesNoInformationLeak(pool, (const uint8_t* const*)audit_pointers, x, 8, 3, 4, &subsets) && subsets == 4 * 28);
+		CHECKSTATE(auditSharesNoInformationLeak((void*)0, (const uint8_t* const*)audit_pointers, x, 8, 1, 4, &subsets) && subsets == 4);
+		x[3] = x[1];
+		CHECKSTATE(!auditNoInformationLeak(pool, x, 12, 5, &subsets));
+		CHECKSTATE(!auditSharesNoInformationLeak(pool, (const uint8_t* const*)audit_pointers, x, 8, 3, 4, &subsets));
+		poolFree(pool);
+	}
+
+	// Test the buffer functions against the per-byte ones
+	uint32_t rand_state = 42;
+	for (uint8_t k = 1; k < 8; k++) {
+		const size_t length = 67;
+		uint8_t x[8], secret[length], random[7 * length], shares[8][length], derived[length];
+		uint8_t* share_ptrs[8];
+		for (uint8_t i = 0; i < 8; i++) {
+			x[i] = 3 + 29 * i;
+			share_ptrs[i] = shares[i];
 		}
-		ret = field_add(ret, temp);
+		for (size_t i = 0; i < length; i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+
+		splitBuffer(share_ptrs, x, 8, secret, random, k, length);
+		for (size_t i = 0; i < length; i++) {
+			uint8_t a[8], q[8];
+			a[0] = secret[i];
+			for (uint8_t j = 1; j < k; j++)
+				a[j] = random[(j - 1) * length + i];
+			for (uint8_t j = 0; j < 8; j++)
+				CHECKSTATE(shares[j][i] == calculateQ(a, k, x[j]));
+			for (uint8_t j = 0; j < k; j++)
+				q[j] = shares[8 - k + j][i];
+			CHECKSTATE(calculateSecret(&x[8 - k], q, k) == secret[i]);
+			CHECKSTATE(calculateQ(a, 0, x[0]) == 0);
+		}
+
+		combineBuffer(derived, &x[8 - k], (const uint8_t* const*)&share_ptrs[8 - k], k, length);
+		CHECKSTATE(memcmp(derived, secret, length) == 0);
+
+		struct combiner* combiner = combinerCreate(x, k);
+		CHECKSTATE(combiner);
+		memset(derived, 0, length);
+		combinerBuffer(combiner, derived, (const uint8_t* const*)share_ptrs, length);
+		CHECKSTATE(memcmp(derived, secret, length) == 0);
+		for (size_t i = 0; i < length; i++) {
+			uint8_t q[8];
+			for (uint8_t j = 0; j < k; j++)
+				q[j] = shares[j][i];
+			CHECKSTATE(combinerSecret(combiner, q) == secret[i]);
+		}
+		combinerFree(combiner);
+	}
+
+	// Test the parallel buffer functions against the serial ones
+	struct pool* pool = poolCreate(4);
+	CHECKSTATE(pool);
+	for (uint8_t k = 1; k < 6; k++) {
+		const size_t length = 300 * 1024 + 17;
+		uint8_t x[5] = {1, 2, 77, 200, 255};
+		uint8_t *secret = malloc(length), *random = malloc(4 * length), *derived = malloc(length);
+		uint8_t *shares[5], *parallel_shares[5];
+		CHECKSTATE(secret && random && derived);
+		for (uint8_t i = 0; i < 5; i++) {
+			shares[i] = malloc(length);
+			parallel_shares[i] = malloc(length);
+			CHECKSTATE(shares[i] && parallel_shares[i]);
+		}
+		for (size_t i = 0; i < length; i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < 4 * length; i++)
+			random[i] = test_rand(&rand_state);
+
+		splitBuffer(shares, x, 5, secret, random, k, length);
+		splitBufferParallel(pool, parallel_shares, x, 5, secret, random, k, length);
+		for (uint8_t i = 0; i < 5; i++)
+			CHECKSTATE(memcmp(shares[i], parallel_shares[i], length) == 0);
+
+		struct combiner* combiner = combinerCreate(&x[5 - k], k);
+		CHECKSTATE(combiner);
+		combinerBufferParallel(pool, combiner, derived, (const uint8_t* const*)&parallel_shares[5 - k], length);
+		CHECKSTATE(memcmp(derived, secret, length) == 0);
+		combinerFree(combiner);
+
+		for (uint8_t i = 0; i < 5; i++) {
+			free(shares[i]);
+			free(parallel_shares[i]);
+		}
+		free(secret);
+		free(random);
+		free(derived);
+	}
+
+	// Test that the encoding matrix gives the same shares as splitBuffer
+	for (uint8_t k = 1; k <= 9; k++) {
+		const size_t length = 3000;
+		uint8_t x[12], secret[length], random[8 * length], split[12][length], encoded[12][length];
+		uint8_t* split_shares[12];
+		uint8_t* encoded_shares[12];
+		for (uint8_t i = 0; i < 12; i++) {
+			x[i] = 1 + (i * 37) % 255;
+			split_shares[i] = split[i];
+			encoded_shares[i] = encoded[i];
+		}
+		for (size_t i = 0; i < length; i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < (k - 1) * length; i++)
+			random[i] = test_rand(&rand_state);
+		splitBuffer(split_shares, x, 12, secret, random, k, length);
+		struct encoder* encoder = encoderCreate(x, 12, k);
+		CHECKSTATE(encoder);
+		encoderBuffer(encoder, encoded_shares, secret, random, length);
+		CHECKSTATE(memcmp(split, encoded, sizeof(split)) == 0);
+		memset(encoded, 0, sizeof(encoded));
+		encoderBufferParallel(pool, encoder, encoded_shares, secret, random, length);
+		CHECKSTATE(memcmp(split, encoded, sizeof(split)) == 0);
+		encoderFree(encoder);
+
+		// The first row of the inverted Vandermonde matrix is the Lagrange weights
+		uint8_t matrix[k * k];
+		matrix_vandermonde(matrix, &x[12 - k], k, k);
+		CHECKSTATE(matrix_invert(matrix, k));
+		struct combiner* combiner = combinerCreate(&x[12 - k], k);
+		CHECKSTATE(combiner);
+		CHECKSTATE(memcmp(matrix, combiner->weights, k) == 0);
+		combinerFree(combiner);
+	}
+
+	// Test that square Cauchy matrices invert correctly
+	uint8_t cauchy_x[16], cauchy_y[16];
+	for (uint8_t i = 0; i < 16; i++) {
+		cauchy_x[i] = i * 3 + 1;
+		cauchy_y[i] = 200 + i;
+	}
+	for (uint8_t size = 1; size <= 16; size++) {
+		uint8_t matrix[size * size], inverse[size * size];
+		CHECKSTATE(matrix_cauchy(matrix, cauchy_x, size, cauchy_y, size));
+		memcpy(inverse, matrix, sizeof(matrix));
+		CHECKSTATE(matrix_invert(inverse, size));
+		for (uint8_t i = 0; i < size; i++) {
+			for (uint8_t j = 0; j < size; j++) {
+				uint8_t product = 0;
+				for (uint8_t l = 0; l < size; l++)
+					product = field_add(product, field_mul(matrix[i * size + l], inverse[l * size + j]));
+				CHECKSTATE(product == (i == j));
+			}
+		}
+	}
+	CHECKSTATE(!matrix_cauchy(cauchy_y, cauchy_x, 2, cauchy_x, 2));
+	uint8_t singular[4] = { 1, 2, 2, 4 }, singular_copy[4];
+	memcpy(singular_copy, singular, 4);
+	CHECKSTATE(!matrix_invert(singular, 2));
+	CHECKSTATE(memcmp(singular, singular_copy, 4) == 0);
+	poolFree(pool);
+
+	// Test the DRBG against ChaCha20 keyed with 00 01 .. 1f (as in RFC 8439), including fast key erasure
+	const struct random_source counting_source = { counting_read, (void*)0 };
+	struct drbg* drbg = drbgCreate(&counting_source);
+	CHECKSTATE(drbg);
+	uint8_t stream[100];
+	const uint8_t stream_start[8] = { 0x18, 0xb8, 0x42, 0x31, 0xad, 0xe6, 0xa6, 0xd1 };
+	const uint8_t stream_end[4] = { 0x84, 0xa8, 0x02, 0x1b };
+	const uint8_t rekeyed[10] = { 0xba, 0x3d, 0x01, 0x21, 0x89, 0x30, 0xe5, 0x5e, 0x8a, 0xc9 };
+	drbgGenerate(drbg, stream, 100);
+	CHECKSTATE(memcmp(stream, stream_start, 8) == 0);
+	CHECKSTATE(memcmp(&stream[96], stream_end, 4) == 0);
+	drbgGenerate(drbg, stream, 10);
+	CHECKSTATE(memcmp(stream, rekeyed, 10) == 0);
+
+	// Test that X coordinates are distinct and nonzero, that all 255 are a permutation and that every one turns up first
+	uint16_t first_counts[P] = { 0 };
+	for (uint16_t round = 0; round < 5000; round++) {
+		uint8_t x[P - 1], seen[P] = { 0 };
+		const uint8_t total_shares = round == 0 ? P - 1 : 1 + round % (P - 1);
+		drbgPickX(drbg, x, total_shares);
+		for (uint8_t i = 0; i < total_shares; i++) {
+			CHECKSTATE(x[i] != 0 && !seen[x[i]]);
+			seen[x[i]] = 1;
+		}
+		first_counts[x[0]]++;
+	}
+	for (uint16_t i = 1; i < P; i++)
+		CHECKSTATE(first_counts[i] > 0);
+	for (unsigned field_bits = 16; field_bits <= 32; field_bits += 16) {
+		uint32_t* x = malloc(5000 * sizeof(uint32_t));
+		CHECKSTATE(x && drbgPickWideX(drbg, field_bits, x, 5000) && wideCheckX(field_bits, x, 5000));
+		free(x);
+	}
+	drbgFree(drbg);
+
+	// Test Poly1305 against RFC 8439 section 2.5.2
+	const uint8_t poly_key[POLY1305_KEY_SIZE] = {
+		0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+		0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+	};
+	const uint8_t poly_tag[POLY1305_TAG_SIZE] = {
+		0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+	};
+	const char* poly_message = "Cryptographic Forum Research Group";
+	for (size_t split_at = 0; split_at <= strlen(poly_message); split_at++) {
+		struct poly1305 poly;
+		uint8_t tag[POLY1305_TAG_SIZE];
+		poly1305_init(&poly, poly_key);
+		poly1305_update(&poly, (const uint8_t*)poly_message, split_at);
+		poly1305_update(&poly, (const uint8_t*)poly_message + split_at, strlen(poly_message) - split_at);
+		poly1305_finish(&poly, tag);
+		CHECKSTATE(memcmp(tag, poly_tag, POLY1305_TAG_SIZE) == 0);
+	}
+
+	// Test the AEAD against the RFC 8439 construction with a zero nonce and no associated data
+	uint8_t aead_key[AEAD_KEY_SIZE], aead_tag[AEAD_TAG_SIZE], message[1000];
+	const uint8_t message_tag[AEAD_TAG_SIZE] = {
+		0x7a, 0x72, 0xe9, 0xc9, 0xdd, 0x43, 0x4d, 0x76, 0x93, 0x7d, 0x11, 0x03, 0xee, 0xc6, 0x48, 0xa6
+	};
+	const uint8_t message_end[8] = { 0x35, 0xfa, 0x00, 0x12, 0x27, 0xd9, 0x9a, 0xb3 };
+	for (uint8_t i = 0; i < AEAD_KEY_SIZE; i++)
+		aead_key[i] = 0x80 + i;
+	for (size_t i = 0; i < sizeof(message); i++)
+		message[i] = i * 7 + 3;
+	struct aead* aead = aeadCreate(aead_key);
+	CHECKSTATE(aead);
+	aeadEncrypt(aead, message, 64);
+	aeadEncrypt(aead, &message[64], 128);
+	aeadEncrypt(aead, &message[192], sizeof(message) - 192);
+	aeadFinish(aead, aead_tag);
+	CHECKSTATE(memcmp(aead_tag, message_tag, AEAD_TAG_SIZE) == 0);
+	CHECKSTATE(memcmp(&message[sizeof(message) - 8], message_end, 8) == 0);
+
+	aead = aeadCreate(aead_key);
+	CHECKSTATE(aead);
+	aeadDecrypt(aead, message, 512);
+	aeadDecrypt(aead, &message[512], sizeof(message) - 512);
+	CHECKSTATE(aeadVerify(aead, message_tag));
+	for (size_t i = 0; i < sizeof(message); i++)
+		CHECKSTATE(message[i] == (uint8_t)(i * 7 + 3));
+	aead = aeadCreate(aead_key);
+	CHECKSTATE(aead);
+	aeadDecrypt(aead, message, sizeof(message));
+	aead_tag[0] ^= 1;
+	CHECKSTATE(!aeadVerify(aead, aead_tag));
+
+	// Test that any k fragments of dispersed data rebuild it
+	for (uint8_t k = 1; k <= 6; k++) {
+		for (size_t length = 1; length < 2000; length += 1 + length / 3) {
+			uint8_t x[8], data[2000 + 6], rebuilt[2000 + 6], fragment_buffers[8][2000];
+			uint8_t* fragments[8];
+			const size_t fragment_length = disperseLength(length, k);
+			for (uint8_t i = 0; i < 8; i++) {
+				x[i] = 255 - i * 11;
+				fragments[i] = fragment_buffers[i];
+			}
+			for (size_t i = 0; i < length; i++)
+				data[i] = test_rand(&rand_state);
+			struct encoder* encoder = encoderCreate(x, 8, k);
+			CHECKSTATE(encoder);
+			disperseBuffer(encoder, fragments, data, length);
+			encoderFree(encoder);
+			struct decoder* decoder = decoderCreate(&x[8 - k], k);
+			CHECKSTATE(decoder);
+			decoderBuffer(decoder, rebuilt, (const uint8_t* const*)&fragments[8 - k], fragment_length);
+			CHECKSTATE(memcmp(rebuilt, data, length) == 0);
+			for (size_t i = length; i < k * fragment_length; i++)
+				CHECKSTATE(rebuilt[i] == 0);
+			decoderFree(decoder);
+		}
+	}
+	uint8_t duplicate_x[2] = { 3, 3 };
+	CHECKSTATE(!decoderCreate(duplicate_x, 2));
+
+	// Test the additive FFT: the novel basis round trips, evaluates to calculateQ at every point and
+	// differentiates like the monomial basis (x^i' = x^(i-1) for odd i, else 0)
+	for (unsigned log_size = 0; log_size <= FFT_BITS; log_size++) {
+		const unsigned size = 1u << log_size;
+		uint8_t coefficients[P], poly[P][2], derived[P];
+		uint8_t* rows[P];
+		uint8_t* derived_rows[P];
+		for (unsigned i = 0; i < size; i++) {
+			coefficients[i] = poly[i][0] = derived[i] = test_rand(&rand_state);
+			poly[i][1] = test_rand(&rand_state);
+			rows[i] = poly[i];
+			derived_rows[i] = &derived[i];
+		}
+		fft_from_monomial(derived_rows, log_size, 0, 1);
+		fft_derivative(derived_rows, log_size, 0, 1);
+		fft_to_monomial(derived_rows, log_size, 0, 1);
+		for (unsigned i = 0; i < size; i++)
+			CHECKSTATE(derived[i] == (i + 1 < size && (i & 1) == 0 ? coefficients[i + 1] : 0));
+		fft_from_monomial(rows, log_size, 0, 2);
+		fft_to_monomial(rows, log_size, 0, 2);
+		for (unsigned i = 0; i < size; i++)
+			CHECKSTATE(poly[i][0] == coefficients[i]);
+		fft_from_monomial(rows, log_size, 0, 2);
+		for (unsigned shift = 0; shift < P; shift += size) {
+			uint8_t evaluated[P][2];
+			uint8_t* evaluated_rows[P];
+			for (unsigned i = 0; i < size; i++) {
+				memcpy(evaluated[i], poly[i], 2);
+				evaluated_rows[i] = evaluated[i];
+			}
+			fft_evaluate(evaluated_rows, log_size, shift, 0, 2);
+			for (unsigned i = 0; i < size; i++) {
+				const uint8_t x = shift + i;
+				// calculateQ takes fewer than P coefficients, so the constant term is split off for size == P
+				if (x != 0)
+					CHECKSTATE(evaluated[i][0] == (size < P ? calculateQ(coefficients, size, x) :
+							field_add(coefficients[0], field_mul(x, calculateQ(&coefficients[1], P - 1, x)))));
+			}
+			fft_interpolate(evaluated_rows, log_size, shift, 0, 2);
+			CHECKSTATE(memcmp(evaluated, poly, size * 2) == 0);
+		}
+	}
+
+	// Test that the FFT encoder and decoder give exactly what the matrices do, however the shares are spread
+	struct pool* fft_pool = poolCreate(3);
+	CHECKSTATE(fft_pool);
+	for (unsigned k = 1; k < P - 1; k += 1 + k / 2) {
+		const size_t length = 700;
+		const uint8_t n = k < P / 2 ? 2 * k : P - 1;
+		uint8_t x[P - 1];
+		uint8_t* matrix_shares[P - 1];
+		uint8_t* fft_shares[P - 1];
+		uint8_t* secret = malloc(length);
+		uint8_t* random = malloc((k - 1) * length + 1);
+		uint8_t* rebuilt = malloc(k * length);
+		CHECKSTATE(secret && random && rebuilt);
+		for (uint8_t i = 0; i < n; i++)
+			x[i] = 1 + (i * 37 + k) % 255;
+		for (size_t i = 0; i < length; i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < (k - 1) * length; i++)
+			random[i] = test_rand(&rand_state);
+		for (uint8_t i = 0; i < n; i++) {
+			matrix_shares[i] = malloc(length);
+			fft_shares[i] = malloc(length);
+			CHECKSTATE(matrix_shares[i] && fft_shares[i]);
+		}
+		fft_select(FFT_NEVER);
+		struct encoder* encoder = encoderCreate(x, n, k);
+		CHECKSTATE(encoder);
+		encoderBuffer(encoder, matrix_shares, secret, random, length);
+		encoderFree(encoder);
+		fft_select(FFT_ALWAYS);
+		encoder = encoderCreate(x, n, k);
+		CHECKSTATE(encoder);
+		encoderBufferParallel(fft_pool, encoder, fft_shares, secret, random, length);
+		encoderFree(encoder);
+		for (uint8_t i = 0; i < n; i++)
+			CHECKSTATE(memcmp(matrix_shares[i], fft_shares[i], length) == 0);
+		splitBuffer(fft_shares, x, n, secret, random, k, length);
+		for (uint8_t i = 0; i < n; i++)
+			CHECKSTATE(memcmp(matrix_shares[i], fft_shares[i], length) == 0);
+
+		// Shares are fragments of the secret and random rows, so decoding the last k gives all of them back
+		struct decoder* decoder = decoderCreate(&x[n - k], k);
+		CHECKSTATE(decoder);
+		decoderBufferParallel(fft_pool, decoder, rebuilt, (const uint8_t* const*)&fft_shares[n - k], length);
+		CHECKSTATE(memcmp(rebuilt, secret, length) == 0);
+		CHECKSTATE(memcmp(&rebuilt[length], random, (k - 1) * length) == 0);
+		decoderFree(decoder);
+		fft_select(FFT_AUTO);
+
+		for (uint8_t i = 0; i < n; i++) {
+			free(matrix_shares[i]);
+			free(fft_shares[i]);
+		}
+		free(secret);
+		free(random);
+		free(rebuilt);
+	}
+	poolFree(fft_pool);
+	CHECKSTATE(!fft_encode_cheaper(5, 3) && fft_encode_cheaper(P - 1, 128));
+	CHECKSTATE(!fft_decode_cheaper(3) && fft_decode_cheaper(P - 1));
+
+	// Test packed sharing: the encoder matches calculatePackedQ (and with one secret, calculateQ), and any
+	// k + l - 1 shares give back every secret, both byte by byte and through the decoder
+	for (uint8_t l = 1; l <= 9; l += 2 + l / 2) {
+		for (uint8_t k = 1; k <= 6; k += 2) {
+			const size_t length = 150;
+			const uint8_t n = k + l + 2, needed = k + l - 1;
+			uint8_t x[16], secrets[9 * 150], random[5 * 150 + 1], rebuilt[9 * 150], share_buffers[16][150];
+			uint8_t* shares[16];
+			for (uint8_t i = 0; i < n; i++) {
+				x[i] = 1 + (i * 29 + l) % (P - l);
+				shares[i] = share_buffers[i];
+			}
+			CHECKSTATE(packedCheckX(x, n, l));
+			for (size_t i = 0; i < l * length; i++)
+				secrets[i] = test_rand(&rand_state);
+			for (size_t i = 0; i < (k - 1) * length; i++)
+				random[i] = test_rand(&rand_state);
+			struct encoder* encoder = packedEncoderCreate(x, n, k, l);
+			CHECKSTATE(encoder);
+			encoderBuffer(encoder, shares, secrets, random, length);
+			encoderFree(encoder);
+			for (size_t b = 0; b < length; b++) {
+				uint8_t byte_secrets[9], byte_random[5], q[16], derived[9];
+				for (uint8_t j = 0; j < l; j++)
+					byte_secrets[j] = secrets[j * length + b];
+				for (uint8_t j = 0; j + 1 < k; j++)
+					byte_random[j] = random[j * length + b];
+				for (uint8_t i = 0; i < n; i++) {
+					q[i] = shares[i][b];
+					CHECKSTATE(q[i] == calculatePackedQ(byte_secrets, l, byte_random, k, x[i]));
+					if (l == 1) {
+						uint8_t coefficients[6] = { byte_secrets[0] };
+						memcpy(&coefficients[1], byte_random, k - 1);
+						CHECKSTATE(q[i] == calculateQ(coefficients, k, x[i]));
+					}
+				}
+				calculatePackedSecrets(derived, l, &x[n - needed], &q[n - needed], k);
+				CHECKSTATE(memcmp(derived, byte_secrets, l) == 0);
+			}
+			struct decoder* decoder = packedDecoderCreate(&x[n - needed], k, l);
+			CHECKSTATE(decoder);
+			decoderBuffer(decoder, rebuilt, (const uint8_t* const*)&shares[n - needed], length);
+			CHECKSTATE(memcmp(rebuilt, secrets, l * length) == 0);
+			decoderFree(decoder);
+		}
+	}
+	uint8_t secret_point_x[2] = { 3, P - 1 };
+	CHECKSTATE(packedCheckX(secret_point_x, 2, 1) && !packedCheckX(secret_point_x, 2, 2) && !packedCheckX(duplicate_x, 2, 1));
+	CHECKSTATE(!packedDecoderCreate(duplicate_x, 1, 2));
+
+	// Test that robust combining corrects up to (m - k) / 2 wrong shares, whether wrong throughout or at scattered bytes
+	for (uint8_t k = 1; k <= 5; k++) {
+		for (uint8_t m = k; m <= k + 6; m++) {
+			uint8_t x[11], secret[3000], random[4 * 3000 + 1], combined[3000], share_buffers[11][3000];
+			uint8_t* shares[11];
+			for (uint8_t i = 0; i < m; i++) {
+				x[i] = 7 + i * 19;
+				shares[i] = share_buffers[i];
+			}
+			for (size_t i = 0; i < sizeof(secret); i++)
+				secret[i] = test_rand(&rand_state);
+			for (size_t i = 0; i < (k - 1) * sizeof(secret); i++)
+				random[i] = test_rand(&rand_state);
+			splitBuffer(shares, x, m, secret, random, k, sizeof(secret));
+
+			// The first wrong share is wrong throughout, the rest only at some bytes
+			const uint8_t wrong = (m - k) / 2;
+			for (uint8_t w = 0; w < wrong; w++) {
+				uint8_t* share = shares[(3 * w + 1) % m];
+				for (size_t i = 0; i < sizeof(secret); i++)
+					if (w == 0 || test_rand(&rand_state) < 8)
+						share[i] ^= 1 + test_rand(&rand_state) % 255;
+			}
+			struct corrector* corrector = correctorCreate(x, m, k);
+			CHECKSTATE(corrector);
+			CHECKSTATE(correctorBuffer(corrector, combined, (const uint8_t* const*)shares, sizeof(secret)));
+			CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+			for (uint8_t i = 0; i < m; i++) {
+				int was_wrong = 0;
+				for (uint8_t w = 0; w < wrong; w++)
+					was_wrong |= i == (3 * w + 1) % m;
+				CHECKSTATE(correctorShareBad(corrector, i) == was_wrong);
+			}
+			correctorFree(corrector);
+		}
+	}
+	CHECKSTATE(!correctorCreate(duplicate_x, 2, 1));
+
+	// Test that faults in more than m - k different shares are corrected as long as no byte has more than
+	// (m - k) / 2 of them, both buffer by buffer (as combine streams them) and in one buffer
+	for (int streamed = 0; streamed < 2; streamed++) {
+		static uint8_t secret[300000], random[2 * 300000], combined[300000], share_buffers[5][300000];
+		uint8_t x[5] = { 3, 91, 17, 200, 45 };
+		uint8_t* shares[5];
+		for (uint8_t i = 0; i < 5; i++)
+			shares[i] = share_buffers[i];
+		for (size_t i = 0; i < sizeof(secret); i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+		splitBuffer(shares, x, 5, secret, random, 3, sizeof(secret));
+		const size_t fault_offsets[3] = { 1000, 100000, 200000 };
+		for (uint8_t w = 0; w < 3; w++)
+			for (size_t i = 0; i < 50; i++)
+				shares[w][fault_offsets[w] + i] ^= 1 + test_rand(&rand_state) % 255;
+
+		struct corrector* corrector = correctorCreate(x, 5, 3);
+		CHECKSTATE(corrector);
+		const size_t step = streamed ? 4096 : sizeof(secret);
+		for (size_t offset = 0; offset < sizeof(secret); offset += step) {
+			const size_t length = sizeof(secret) - offset < step ? sizeof(secret) - offset : step;
+			const uint8_t* block[5];
+			for (uint8_t i = 0; i < 5; i++)
+				block[i] = &shares[i][offset];
+			CHECKSTATE(correctorBuffer(corrector, &combined[offset], block, length));
+		}
+		CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+		for (uint8_t i = 0; i < 5; i++)
+			CHECKSTATE(correctorShareBad(corrector, i) == (i < 3));
+		correctorFree(corrector);
+	}
+
+	// Test that once faults have left some shares out of the bulk pass, e = (n - k) / 2 wrong shares which
+	// are still in it get caught, whatever they are wrong by
+	for (uint16_t error = 1; error < P; error++) {
+		uint8_t secret[64], random[2 * 64], combined[64], share_buffers[7][64];
+		const uint8_t x[7] = { 1, 2, 3, 4, 5, 6, 7 };
+		uint8_t* shares[7];
+		for (uint8_t i = 0; i < 7; i++)
+			shares[i] = share_buffers[i];
+		for (size_t i = 0; i < sizeof(secret); i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+		splitBuffer(shares, x, 7, secret, random, 3, sizeof(secret));
+		shares[0][10] ^= 1;
+		shares[1][20] ^= 1;
+		shares[2][30] ^= 1;
+		shares[3][40] ^= 1;
+		shares[4][40] ^= error;
+
+		struct corrector* corrector = correctorCreate(x, 7, 3);
+		CHECKSTATE(corrector);
+		CHECKSTATE(correctorBuffer(corrector, combined, (const uint8_t* const*)shares, sizeof(secret)));
+		CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+		for (uint8_t i = 0; i < 7; i++)
+			CHECKSTATE(correctorShareBad(corrector, i) == (i < 5));
+		correctorFree(corrector);
+	}
+
+	// Test that the library's secrets come from (and go back to) the secret allocator
+	{
+		int live = 0;
+		const struct secret_allocator counting = { counting_alloc, counting_free, &live };
+		const uint8_t x[5] = { 3, 91, 17, 200, 45 }, key[AEAD_KEY_SIZE] = { 1 };
+		setSecretAllocator(&counting);
+		struct drbg* drbg = drbgCreate(&randomSystem);
+		struct aead* aead = aeadCreate(key);
+		struct corrector* corrector = correctorCreate(x, 5, 3);
+		CHECKSTATE(drbg && aead && corrector && live == 3);
+		uint8_t tag[AEAD_TAG_SIZE];
+		aeadFinish(aead, tag);
+		correctorFree(corrector);
+		drbgFree(drbg);
+		CHECKSTATE(live == 0);
+		setSecretAllocator((void*)0);
+	}
+
+	// Test that refreshing and re-sharing keep the secret, and that refreshed shares don't mix with old ones
+	for (uint8_t k = 1; k <= 5; k++) {
+		uint8_t x[8], new_x[7] = { 9, 250, 31, 4, 77, 128, 200 }, secret[3000], random[6 * 3000 + 1], combined[3000];
+		uint8_t old_buffers[8][3000], new_buffers[8][3000];
+		uint8_t *old_shares[8], *new_shares[8];
+		for (uint8_t i = 0; i < 8; i++) {
+			x[i] = 3 + i * 29;
+			old_shares[i] = old_buffers[i];
+			new_shares[i] = new_buffers[i];
+		}
+		for (size_t i = 0; i < sizeof(secret); i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+		splitBuffer(old_shares, x, 8, secret, random, k, sizeof(secret));
+
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+		struct encoder* encoder = encoderCreate(x, 8, k);
+		CHECKSTATE(encoder);
+		encoderRefresh(encoder, new_shares, (const uint8_t* const*)old_shares, random, sizeof(secret));
+		encoderFree(encoder);
+		combineBuffer(combined, &x[8 - k], (const uint8_t* const*)&new_shares[8 - k], k, sizeof(secret));
+		CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+		if (k > 1) {
+			const uint8_t* mixed[5] = { old_shares[0] };
+			for (uint8_t i = 1; i < k; i++)
+				mixed[i] = new_shares[i];
+			combineBuffer(combined, x, mixed, k, sizeof(secret));
+			CHECKSTATE(memcmp(combined, secret, sizeof(secret)) != 0);
+		}
+
+		for (uint8_t new_k = 1; new_k <= 7; new_k++) {
+			for (size_t i = 0; i < sizeof(random); i++)
+				random[i] = test_rand(&rand_state);
+			struct resharer* resharer = resharerCreate(&x[1], k, new_x, 7, new_k);
+			CHECKSTATE(resharer);
+			resharerBuffer(resharer, new_shares, (const uint8_t* const*)&old_shares[1], random, sizeof(secret));
+			resharerFree(resharer);
+			combineBuffer(combined, &new_x[7 - new_k], (const uint8_t* const*)&new_shares[7 - new_k], new_k, sizeof(secret));
+			CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+		}
+	}
+	CHECKSTATE(!resharerCreate(duplicate_x, 2, duplicate_x, 1, 1));
+
+	// Test re-sharing right up to the widest matrix there is (k + new k - 1 == P - 1), and that wider is refused
+	{
+		static uint8_t secret[64], random[199 * 64], old_buffers[200][64], new_buffers[60][64], combined[64];
+		uint8_t x[200], new_x[60];
+		uint8_t *old_shares[200], *new_shares[60];
+		for (uint8_t i = 0; i < 200; i++) {
+			x[i] = i + 1;
+			old_shares[i] = old_buffers[i];
+		}
+		for (uint8_t i = 0; i < 60; i++) {
+			new_x[i] = 255 - i;
+			new_shares[i] = new_buffers[i];
+		}
+		for (size_t i = 0; i < sizeof(secret); i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < sizeof(random); i++)
+			random[i] = test_rand(&rand_state);
+		splitBuffer(old_shares, x, 200, secret, random, 200, sizeof(secret));
+		CHECKSTATE(!resharerCreate(x, 200, new_x, 60, 57));
+		struct resharer* resharer = resharerCreate(x, 200, new_x, 60, 56);
+		CHECKSTATE(resharer);
+		resharerBuffer(resharer, new_shares, (const uint8_t* const*)old_shares, random, sizeof(secret));
+		resharerFree(resharer);
+		combineBuffer(combined, &new_x[4], (const uint8_t* const*)&new_shares[4], 56, sizeof(secret));
+		CHECKSTATE(memcmp(combined, secret, sizeof(secret)) == 0);
+	}
+
+	// Test the wider fields: the scalar functions against each other and the buffer functions against them, past 255 shares
+	for (uint32_t k = 1; k <= 300; k += 37) {
+		uint16_t coefficients16[300], x16[300], q16[300];
+		uint32_t coefficients32[300], x32[300], q32[300];
+		for (uint32_t i = 0; i < k; i++) {
+			coefficients16[i] = test_rand(&rand_state) | (test_rand(&rand_state) << 8);
+			coefficients32[i] = coefficients16[i] | ((uint32_t)test_rand(&rand_state) << 16) | ((uint32_t)test_rand(&rand_state) << 24);
+			x16[i] = 1000 + 211 * i;
+			x32[i] = 0x80000000u + 7919 * i;
+		}
+		for (uint32_t i = 0; i < k; i++) {
+			q16[i] = calculateQ16(coefficients16, k, x16[i]);
+			q32[i] = calculateQ32(coefficients32, k, x32[i]);
+		}
+		CHECKSTATE(calculateSecret16(x16, q16, k) == coefficients16[0]);
+		CHECKSTATE(calculateSecret32(x32, q32, k) == coefficients32[0]);
+		// A polynomial with no coefficients (R for packed sharing with k = 1) is 0 everywhere
+		CHECKSTATE(calculateQ16(coefficients16, 0, x16[0]) == 0 && calculateQ32(coefficients32, 0, x32[0]) == 0);
+	}
+	for (unsigned field_bits = 16; field_bits <= 32; field_bits += 16) {
+		const uint32_t n = 300, k = 260;
+		const size_t length = 2 * 4096 + 12;
+		uint32_t x[300];
+		uint8_t *secret = malloc(length), *random = malloc((k - 1) * length), *derived = malloc(length), *share_buffers = malloc(n * length);
+		uint8_t* shares[300];
+		CHECKSTATE(secret && random && derived && share_buffers);
+		for (uint32_t i = 0; i < n; i++) {
+			x[i] = field_bits == 16 ? 65535 - 3 * i : 0xdeadbeefu + 1000003 * i;
+			shares[i] = &share_buffers[i * length];
+		}
+		CHECKSTATE(wideCheckX(field_bits, x, n));
+		for (size_t i = 0; i < length; i++)
+			secret[i] = test_rand(&rand_state);
+		for (size_t i = 0; i < (k - 1) * length; i++)
+			random[i] = test_rand(&rand_state);
+		struct wide_encoder* encoder = wideEncoderCreate(field_bits, x, n, k);
+		CHECKSTATE(encoder);
+		wideEncoderBuffer(encoder, shares, secret, random, length);
+		wideEncoderFree(encoder);
+
+		// Element 5 of share 299 by hand
+		const size_t element = 5 * (field_bits / 8);
+		if (field_bits == 16) {
+			uint16_t coefficients[260];
+			for (uint32_t j = 0; j < k; j++) {
+				const uint8_t* row = j == 0 ? secret : &random[(j - 1) * length];
+				coefficients[j] = row[element] | (row[element + 1] << 8);
+			}
+			CHECKSTATE(calculateQ16(coefficients, k, x[299]) == (shares[299][element] | (shares[299][element + 1] << 8)));
+		} else {
+			uint32_t coefficients[260], q = 0;
+			for (uint32_t j = 0; j < k; j++) {
+				const uint8_t* row = j == 0 ? secret : &random[(j - 1) * length];
+				coefficients[j] = 0;
+				for (uint8_t b = 0; b < 4; b++)
+					coefficients[j] |= (uint32_t)row[element + b] << (8 * b);
+			}
+			for (uint8_t b = 0; b < 4; b++)
+				q |= (uint32_t)shares[299][element + b] << (8 * b);
+			CHECKSTATE(calculateQ32(coefficients, k, x[299]) == q);
+		}
+
+		struct wide_combiner* combiner = wideCombinerCreate(field_bits, &x[n - k], k);
+		CHECKSTATE(combiner);
+		wideCombinerBuffer(combiner, derived, (const uint8_t* const*)&shares[n - k], length);
+		CHECKSTATE(memcmp(derived, secret, length) == 0);
+		wideCombinerFree(combiner);
+		free(secret);
+		free(random);
+		free(derived);
+		free(share_buffers);
+	}
+	uint32_t wide_x[3] = { 7, 70000, 7 };
+	CHECKSTATE(!wideCheckX(16, &wide_x[1], 1));
+	CHECKSTATE(!wideCheckX(32, wide_x, 3));
+	CHECKSTATE(wideCheckX(32, wide_x, 2));
+
+	// Test CRC32C against the standard check value, and that it can be continued
+	CHECKSTATE(crc32c(0, (const uint8_t*)"123456789", 9) == 0xe3069283);
+	CHECKSTATE(crc32c(crc32c(0, (const uint8_t*)"1234", 4), (const uint8_t*)"56789", 5) == 0xe3069283);
+
+	// Test that share headers round trip and that any corruption is noticed
+	struct share_header header = { SHARE_VERSION, 8, SHARE_MODE_DISPERSED, 42, 3, 5, SHARE_CHUNK_SIZE };
+	for (uint8_t i = 0; i < 16; i++)
+		header.split_id[i] = test_rand(&rand_state);
+	for (uint8_t i = 0; i < SHARE_MODE_DATA_SIZE; i++)
+		header.mode_data[i] = test_rand(&rand_state);
+	header.secret_length = 0x123456789aULL;
+	header.payload_length = 0x6789abcdULL;
+	header.packing = 4;
+	uint8_t encoded_header[SHARE_HEADER_SIZE];
+	share_header_encode(encoded_header, &header);
+	struct share_header decoded_header;
+	CHECKSTATE(share_header_decode(&decoded_header, encoded_header));
+	CHECKSTATE(decoded_header.x == 42 && decoded_header.k == 3 && decoded_header.n == 5 && decoded_header.mode == SHARE_MODE_DISPERSED);
+	CHECKSTATE(decoded_header.chunk_size == SHARE_CHUNK_SIZE && decoded_header.field_bits == 8 && decoded_header.packing == 4);
+	CHECKSTATE(decoded_header.secret_length == header.secret_length && decoded_header.payload_length == header.payload_length);
+	CHECKSTATE(memcmp(decoded_header.split_id, header.split_id, 16) == 0);
+	CHECKSTATE(memcmp(decoded_header.mode_data, header.mode_data, SHARE_MODE_DATA_SIZE) == 0);
+	for (size_t i = 0; i < SHARE_HEADER_SIZE; i++) {
+		encoded_header[i] ^= 0x10;
+		CHECKSTATE(!share_header_decode(&decoded_header, encoded_header));
+		encoded_header[i] ^= 0x10;
+	}
+
+	// Test that the chunk index written for a payload checks out when read back, and catches a flipped bit
+	FILE* share_file = tmpfile();
+	CHECKSTATE(share_file);
+	static uint8_t payload[3 * SHARE_CHUNK_SIZE / 2];
+	for (size_t i = 0; i < sizeof(payload); i++)
+		payload[i] = i * 7 + 3;
+	header.mode = SHARE_MODE_SHAMIR;
+	header.packing = 0;
+	header.secret_length = header.payload_length = sizeof(payload);
+	share_header_encode(encoded_header, &header);
+	struct share_writer writer;
+	share_writer_init(&writer);
+	CHECKSTATE(share_writer_update(&writer, payload, 1000) && share_writer_update(&writer, &payload[1000], sizeof(payload) - 1000));
+	CHECKSTATE(fwrite(encoded_header, 1, SHARE_HEADER_SIZE, share_file) == SHARE_HEADER_SIZE);
+	CHECKSTATE(fwrite(payload, 1, sizeof(payload), share_file) == sizeof(payload));
+	CHECKSTATE(share_writer_finish(&writer, share_file));
+	for (int corrupt = 0; corrupt < 2; corrupt++) {
+		struct share_reader reader;
+		uint64_t bad_chunk = 0;
+		CHECKSTATE(share_reader_open(&reader, share_file) == SHARE_OPEN_OK);
+		CHECKSTATE(!reader.legacy && reader.payload_offset == SHARE_HEADER_SIZE);
+		payload[SHARE_CHUNK_SIZE + 5] ^= corrupt;
+		CHECKSTATE(share_reader_update(&reader, payload, sizeof(payload), &bad_chunk) == !corrupt);
+		CHECKSTATE(!corrupt || bad_chunk == 1);
+		payload[SHARE_CHUNK_SIZE + 5] ^= corrupt;
+		share_reader_free(&reader);
+	}
+	// Test that checking can start from the chunk holding any offset
+	struct share_reader reader;
+	uint64_t start, bad_chunk;
+	CHECKSTATE(share_reader_open(&reader, share_file) == SHARE_OPEN_OK);
+	CHECKSTATE(share_reader_seek(&reader, share_file, SHARE_CHUNK_SIZE + 10, &start) && start == SHARE_CHUNK_SIZE);
+	CHECKSTATE(ftell(share_file) == SHARE_HEADER_SIZE + SHARE_CHUNK_SIZE);
+	CHECKSTATE(share_reader_update(&reader, &payload[start], sizeof(payload) - start, &bad_chunk));
+	share_reader_free(&reader);
+	// Test that a header which fails its CRC is reported as such, rather than read as a legacy share
+	CHECKSTATE(fseek(share_file, 20, SEEK_SET) == 0 && fputc(encoded_header[20] ^ 1, share_file) != EOF);
+	CHECKSTATE(share_reader_open(&reader, share_file) == SHARE_OPEN_CORRUPT);
+	share_reader_free(&reader);
+	CHECKSTATE(fseek(share_file, 0, SEEK_SET) == 0 && fputc('B', share_file) != EOF);
+	CHECKSTATE(share_reader_open(&reader, share_file) == SHARE_OPEN_OK);
+	CHECKSTATE(reader.legacy && reader.header.x == 'B' && reader.payload_offset == 1);
+	share_reader_free(&reader);
+	fclose(share_file);
+
+	// Test scalar reduction and multiplying the base point against a reference implementation
+	uint8_t wide[64], scalar[SC25519_SIZE], inverse[SC25519_SIZE], packed[GE25519_SIZE];
+	const uint8_t reduced_scalar[SC25519_SIZE] = {
+		0x4a, 0xa7, 0x0a, 0x61, 0x5c, 0x25, 0x7b, 0x2a, 0x6f, 0x0e, 0x1d, 0x41, 0x8c, 0x6d, 0x29, 0x4e,
+		0x5b, 0xea, 0xd6, 0xae, 0x68, 0x91, 0x5f, 0x33, 0xe8, 0x83, 0x5f, 0x53, 0x8b, 0x5a, 0x3d, 0x0e
+	};
+	const uint8_t scalar_point[GE25519_SIZE] = {
+		0x46, 0x3b, 0x91, 0xb3, 0x67, 0x50, 0x43, 0xb9, 0xc8, 0x0d, 0x70, 0xcc, 0x56, 0x8a, 0xce, 0x37,
+		0x9f, 0x7b, 0x19, 0x10, 0xa5, 0xb0, 0x1b, 0xbb, 0xa9, 0xfb, 0xe1, 0x32, 0x30, 0x50, 0x44, 0x8d
+	};
+	for (uint8_t i = 0; i < 64; i++)
+		wide[i] = i * 7 + 3;
+	sc25519_reduce(scalar, wide);
+	CHECKSTATE(memcmp(scalar, reduced_scalar, SC25519_SIZE) == 0 && sc25519_is_canonical(scalar));
+	struct ge25519 point, unpacked;
+	ge25519_scalarmult_base(&point, scalar);
+	ge25519_pack(packed, &point);
+	CHECKSTATE(memcmp(packed, scalar_point, GE25519_SIZE) == 0);
+	CHECKSTATE(ge25519_unpack(&unpacked, packed) && !ge25519_is_small_order(&unpacked));
+	ge25519_pack(packed, &unpacked);
+	CHECKSTATE(memcmp(packed, scalar_point, GE25519_SIZE) == 0);
+	sc25519_invert(inverse, scalar);
+	sc25519_mul(inverse, inverse, scalar);
+	CHECKSTATE(inverse[0] == 1);
+	for (uint8_t i = 1; i < SC25519_SIZE; i++)
+		CHECKSTATE(inverse[i] == 0);
+
+	// Test that VSS shares verify alone and in batches, that a bad share is caught and pinned down, and that any k combine
+	for (uint8_t k = 1; k <= 6; k++) {
+		uint8_t x[10], coefficients[6][VSS_SCALAR_SIZE], shares[10][VSS_SCALAR_SIZE], commitments[6][VSS_POINT_SIZE];
+		uint8_t secret[VSS_SCALAR_SIZE];
+		for (uint8_t i = 0; i < k; i++) {
+			for (uint8_t j = 0; j < 64; j++)
+				wide[j] = test_rand(&rand_state);
+			vssScalarFromRandom(coefficients[i], wide);
+		}
+		for (uint8_t i = 0; i < 10; i++)
+			x[i] = 250 - i * 13;
+		vssSplit(shares, commitments, x, 10, (const uint8_t (*)[VSS_SCALAR_SIZE])coefficients, k);
+		for (uint8_t i = 0; i < 10; i++)
+			CHECKSTATE(vssVerify((const uint8_t (*)[VSS_POINT_SIZE])commitments, k, x[i], shares[i]));
+		CHECKSTATE(vssVerifyBatch((const uint8_t (*)[VSS_POINT_SIZE])commitments, k, x, (const uint8_t (*)[VSS_SCALAR_SIZE])shares, 10, &randomSystem));
+		vssCombine(secret, &x[10 - k], (const uint8_t (*)[VSS_SCALAR_SIZE])&shares[10 - k], k);
+		CHECKSTATE(memcmp(secret, coefficients[0], VSS_SCALAR_SIZE) == 0);
+
+		shares[k][0] ^= 1;
+		CHECKSTATE(!vssVerifyBatch((const uint8_t (*)[VSS_POINT_SIZE])commitments, k, x, (const uint8_t (*)[VSS_SCALAR_SIZE])shares, 10, &randomSystem));
+		for (uint8_t i = 0; i < 10; i++)
+			CHECKSTATE(vssVerify((const uint8_t (*)[VSS_POINT_SIZE])commitments, k, x[i], shares[i]) == (i != k));
+		shares[k][0] ^= 1;
+		commitments[k - 1][0] ^= 1;
+		CHECKSTATE(!vssVerify((const uint8_t (*)[VSS_POINT_SIZE])commitments, k, x[0], shares[0]));
 	}
-	return ret;
 }
-#endif // !defined(TEST)
+#endif // defined(TEST)
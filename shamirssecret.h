@@ -22,6 +22,7 @@
 
 #ifndef IN_KERNEL
 #include <stdint.h>
+#include <stddef.h>
 #else
 #include <linux/types.h>
 #endif
@@ -38,3 +39,460 @@ uint8_t calculateQ(uint8_t coefficients[], uint8_t shares_required, uint8_t x);
  * Derives the secret given a set of shares_required points (x and q coordinates)
  */
 uint8_t calculateSecret(uint8_t x[], uint8_t q[], uint8_t shares_required);
+
+/**
+ * Packed (Franklin-Yung) sharing: secret_count secrets share one polynomial
+ *   q = S + Z * R
+ * where S goes through secret j at packedSecretX(j), Z is the product of (x - packedSecretX(j))
+ * and R has shares_required - 1 random coefficients. q has degree shares_required + secret_count - 2,
+ * so any shares_required - 1 shares still reveal nothing (Z being nonzero at every share, R alone
+ * makes them uniform) but shares_required + secret_count - 1 of them are needed to recover the
+ * secrets. Each share then carries secret_count secret bytes for the randomness and field work
+ * of one. With one secret this is exactly calculateQ and calculateSecret.
+ */
+uint8_t packedSecretX(uint8_t j);
+
+/**
+ * Calculates the Y coordinate of the point with the given X, which must not be a secret point
+ * random holds the shares_required - 1 coefficients of R, lowest first
+ */
+uint8_t calculatePackedQ(uint8_t secrets[], uint8_t secret_count, uint8_t random[], uint8_t shares_required, uint8_t x);
+
+/**
+ * Derives the secret_count secrets given shares_required + secret_count - 1 points (x and q coordinates)
+ */
+void calculatePackedSecrets(uint8_t secrets[], uint8_t secret_count, uint8_t x[], uint8_t q[], uint8_t shares_required);
+
+/**
+ * Checks that the X coordinates are distinct and none of them is a secret point, which is all
+ * the privacy of any shares_required - 1 packed shares comes down to
+ */
+int packedCheckX(const uint8_t x[], uint8_t total_shares, uint8_t secret_count);
+
+/**
+ * Checks that no shares_required - 1 of the shares with the given X coordinates, together with a
+ * share at any other X coordinate, can rule out any possible secret (ie that such a share always
+ * has a nonzero Lagrange weight, so every value of it gives a different secret)
+ * Returns 1 if so, 0 if the X coordinates are not distinct and nonzero
+ */
+int checkNoInformationLeak(const uint8_t x[], uint8_t total_shares, uint8_t shares_required);
+
+/**
+ * Calculates length bytes of every share at once
+ * shares[i] receives the Y coordinates of the points with X coordinate x[i]
+ * random holds (shares_required - 1) rows of length secure random bytes, one
+ * row per non-constant coefficient
+ */
+void splitBuffer(uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, size_t length);
+
+/**
+ * Derives length bytes of the secret given shares_required share buffers and their X coordinates
+ */
+void combineBuffer(uint8_t secret[], const uint8_t x[], const uint8_t* const shares[], uint8_t shares_required, size_t length);
+
+/**
+ * Precomputed Lagrange weights for a fixed set of X coordinates, so that
+ * deriving each byte of the secret only costs shares_required multiplies
+ */
+struct combiner;
+
+/**
+ * Calculates the weights for the given shares_required X coordinates
+ * Returns NULL if memory could not be allocated
+ */
+struct combiner* combinerCreate(const uint8_t x[], uint8_t shares_required);
+
+/**
+ * Derives the secret given the q coordinates of the points the combiner was created with
+ */
+uint8_t combinerSecret(const struct combiner* combiner, const uint8_t q[]);
+
+/**
+ * Derives length bytes of the secret given one share buffer per X coordinate the combiner was created with
+ */
+void combinerBuffer(const struct combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length);
+
+void combinerFree(struct combiner* combiner);
+
+/**
+ * A precomputed total_shares * shares_required encoding matrix (row i holding the powers of
+ * x[i]), so splitting is one matrix-times-buffer pass over the secret and random rows.
+ * The shares are exactly those splitBuffer calculates. Where it is cheaper (large n and k),
+ * both calculate them with an additive FFT instead (see fft.h).
+ */
+struct encoder;
+
+/**
+ * Calculates the encoding matrix for the given total_shares X coordinates
+ * Returns NULL if memory could not be allocated
+ */
+struct encoder* encoderCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required);
+
+/**
+ * splitBuffer with the X coordinates and shares_required the encoder was created with
+ */
+void encoderBuffer(const struct encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length);
+
+/**
+ * An encoder for packed sharing (see calculatePackedQ), whose X coordinates must not be secret
+ * points. encoderBuffer's secret then holds secret_count rows of length bytes, one secret per row
+ * at each byte, which are cut from the data as disperseBuffer cuts it (see disperseLength).
+ * Packed encoders never use the FFT and cannot refresh.
+ * Returns NULL if memory could not be allocated
+ */
+struct encoder* packedEncoderCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required, uint8_t secret_count);
+
+void encoderFree(struct encoder* encoder);
+
+/**
+ * Information dispersal: length bytes of data are cut into shares_required rows of
+ * disperseLength(length, shares_required) bytes (the last zero-padded), and fragment i
+ * is the encoder's share i of them, so any shares_required fragments rebuild the data.
+ * Fragments are 1/shares_required the size of shares but reveal information about the
+ * data, so data must be ciphertext.
+ */
+size_t disperseLength(size_t length, uint8_t shares_required);
+
+/**
+ * Calculates every fragment of data, which must have room for shares_required *
+ * disperseLength(length, shares_required) bytes (the padding is zeroed)
+ */
+void disperseBuffer(const struct encoder* encoder, uint8_t* fragments[], uint8_t data[], size_t length);
+
+/**
+ * The inverse of the encoding matrix rows for a fixed set of shares_required X coordinates
+ * (or, for large shares_required, an FFT erasure decoding plan giving the same results)
+ */
+struct decoder;
+
+/**
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct and nonzero
+ */
+struct decoder* decoderCreate(const uint8_t x[], uint8_t shares_required);
+
+/**
+ * A decoder for packed shares, from shares_required + secret_count - 1 X coordinates, whose
+ * decoderBuffer rebuilds the secret_count rows a packedEncoderCreate encoder took
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct
+ */
+struct decoder* packedDecoderCreate(const uint8_t x[], uint8_t shares_required, uint8_t secret_count);
+
+/**
+ * Rebuilds shares_required * fragment_length bytes of data (or with a packed decoder, secret_count
+ * rows of them) from one fragment per X coordinate
+ */
+void decoderBuffer(const struct decoder* decoder, uint8_t data[], const uint8_t* const fragments[], size_t fragment_length);
+
+void decoderFree(struct decoder* decoder);
+
+/**
+ * Proactive refresh: shares[i] = old_shares[i] + q(x[i]) for a random q with q(0) = 0, ie the
+ * calculateQ of a polynomial with a zero secret and the rows of random (as in encoderBuffer) as its
+ * other coefficients. The new shares give the same secret but cannot be combined with any of the
+ * old ones, and the secret is never calculated.
+ * old_shares holds one buffer per X coordinate the encoder was created with; any share which is not
+ * refreshed along with the rest keeps the old polynomial and is no longer usable.
+ */
+void encoderRefresh(const struct encoder* encoder, uint8_t* shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length);
+
+/**
+ * Re-sharing shares_required shares of one split into new_total_shares shares needing
+ * new_shares_required, without calculating the secret: each old share is split again and
+ * every new share is the Lagrange-weighted sum of the pieces at its X coordinate, all as a
+ * single matrix-times-buffer pass.
+ */
+struct resharer;
+
+/**
+ * Returns NULL if memory could not be allocated, either set of X coordinates is not distinct and nonzero
+ * or shares_required + new_shares_required - 1 >= P (the width of the matrix)
+ */
+struct resharer* resharerCreate(const uint8_t x[], uint8_t shares_required, const uint8_t new_x[], uint8_t new_total_shares, uint8_t new_shares_required);
+
+/**
+ * Calculates length bytes of every new share from one buffer per old X coordinate and
+ * (new_shares_required - 1) rows of length secure random bytes
+ */
+void resharerBuffer(const struct resharer* resharer, uint8_t* new_shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length);
+
+void resharerFree(struct resharer* resharer);
+
+/**
+ * Robust combining from total_shares >= shares_required shares: each byte of the secret is
+ * recovered as long as at most (total_shares - shares_required) / 2 of the shares are wrong
+ * at that byte. Bytes are checked in bulk against the parity checks of the Reed-Solomon code
+ * the shares form and only those which fail are decoded on their own (Berlekamp-Welch), after
+ * which any share found to be wrong is left out of the bulk pass.
+ */
+struct corrector;
+
+/**
+ * Returns NULL if memory could not be allocated or the X coordinates are not distinct and nonzero
+ */
+struct corrector* correctorCreate(const uint8_t x[], uint8_t total_shares, uint8_t shares_required);
+
+/**
+ * Derives length bytes of the secret from one buffer per X coordinate the corrector was created with
+ * Returns 0 if some byte had too many wrong shares to correct
+ */
+int correctorBuffer(struct corrector* corrector, uint8_t secret[], const uint8_t* const shares[], size_t length);
+
+/**
+ * Whether share i has been wrong anywhere so far
+ */
+int correctorShareBad(const struct corrector* corrector, uint8_t i);
+
+void correctorFree(struct corrector* corrector);
+
+#ifndef IN_KERNEL
+/**
+ * Where the library allocates memory which holds secrets: the state of a DRBG or an AEAD, and
+ * the scratch buffers shares pass through in the FFT, matrix inversion and the corrector.
+ * Whatever is allocated from it is wiped before it is given back. malloc and free by default.
+ */
+struct secret_allocator {
+	// Returns length bytes, or NULL on failure
+	void* (*alloc)(void* ctx, size_t length);
+	void (*free)(void* ctx, void* ptr);
+	void* ctx;
+};
+
+/**
+ * Replaces the secret allocator (eg with one which hands out locked memory), or goes back to malloc
+ * and free if allocator is NULL. Must not be called while anything from the old one is in use.
+ */
+void setSecretAllocator(const struct secret_allocator* allocator);
+
+/**
+ * Anything which can provide random bytes (eg to inject deterministic streams when testing)
+ */
+struct random_source {
+	// Fills buf with length random bytes, returns 0 on failure
+	int (*read)(void* ctx, uint8_t buf[], size_t length);
+	void* ctx;
+};
+
+/**
+ * The operating system's random number generator (getrandom())
+ */
+extern const struct random_source randomSystem;
+
+/**
+ * A ChaCha20-based DRBG which is seeded once and then streams random bytes in bulk
+ */
+struct drbg;
+
+/**
+ * Creates a DRBG seeded with 32 bytes from seed_source
+ * Returns NULL if memory could not be allocated or seed_source failed
+ */
+struct drbg* drbgCreate(const struct random_source* seed_source);
+
+/**
+ * Fills buf with length random bytes
+ */
+void drbgGenerate(struct drbg* drbg, uint8_t buf[], size_t length);
+
+void drbgFree(struct drbg* drbg);
+
+/**
+ * A random source which reads from the DRBG, to hand to anything else taking a random_source
+ */
+struct random_source drbgSource(struct drbg* drbg);
+
+/**
+ * Picks total_shares distinct nonzero X coordinates, uniformly at random: the start of a random
+ * permutation of 1 .. P - 1, by a Fisher-Yates shuffle with all its random numbers read at once
+ */
+void drbgPickX(struct drbg* drbg, uint8_t x[], uint8_t total_shares);
+
+/**
+ * drbgPickX for packed sharing, from 1 .. P - secret_count so that no share is at a secret point
+ */
+void drbgPickPackedX(struct drbg* drbg, uint8_t x[], uint8_t total_shares, uint8_t secret_count);
+
+/**
+ * ChaCha20-Poly1305 (RFC 8439) for keys which only ever encrypt one message, so the
+ * nonce is always zero, streamed across any number of calls
+ */
+#define AEAD_KEY_SIZE 32
+#define AEAD_TAG_SIZE 16
+struct aead;
+
+/**
+ * Starts encrypting or decrypting a message under key
+ * Returns NULL if memory could not be allocated
+ */
+struct aead* aeadCreate(const uint8_t key[AEAD_KEY_SIZE]);
+
+/**
+ * Encrypts length bytes in place, continuing the message from the last call
+ * Every call but the last must be a multiple of 64 bytes long
+ */
+void aeadEncrypt(struct aead* aead, uint8_t buf[], size_t length);
+
+/**
+ * Decrypts length bytes in place, continuing the message from the last call
+ * Every call but the last must be a multiple of 64 bytes long, and nothing decrypted
+ * may be trusted until aeadVerify has succeeded
+ */
+void aeadDecrypt(struct aead* aead, uint8_t buf[], size_t length);
+
+/**
+ * Calculates the tag over the whole message and frees the aead
+ */
+void aeadFinish(struct aead* aead, uint8_t tag[AEAD_TAG_SIZE]);
+
+/**
+ * Checks the message decrypted so far against tag (in constant time) and frees the aead
+ * Returns 1 if the message is authentic, 0 otherwise
+ */
+int aeadVerify(struct aead* aead, const uint8_t tag[AEAD_TAG_SIZE]);
+
+/**
+ * Feldman verifiable secret sharing of a key over the ed25519 group, for when shares must be
+ * checkable on their own: the shares are the values at x of a polynomial over the integers
+ * modulo the group order l, and its coefficients are published as commitments (each times the
+ * base point), so anyone holding the commitments can check any share without learning the
+ * secret. Scalars are 32 bytes little endian and less than l, commitments are compressed points.
+ * Only computationally hiding, so it is meant for a key wrapping the real secret.
+ */
+#define VSS_SCALAR_SIZE 32
+#define VSS_POINT_SIZE 32
+
+/**
+ * Reduces 64 random bytes to a uniformly distributed scalar
+ */
+void vssScalarFromRandom(uint8_t scalar[VSS_SCALAR_SIZE], const uint8_t random[64]);
+
+/**
+ * shares[i] receives the share at x[i] (which must be nonzero) and commitments the shares_required commitments
+ * coefficients[0] is the secret, the rest are random scalars
+ */
+void vssSplit(uint8_t shares[][VSS_SCALAR_SIZE], uint8_t commitments[][VSS_POINT_SIZE], const uint8_t x[], uint8_t total_shares,
+		const uint8_t coefficients[][VSS_SCALAR_SIZE], uint8_t shares_required);
+
+/**
+ * Returns 1 if share is the value at x of the polynomial committed to, 0 if not or the commitments are not valid points
+ */
+int vssVerify(const uint8_t commitments[][VSS_POINT_SIZE], uint8_t shares_required, uint8_t x, const uint8_t share[VSS_SCALAR_SIZE]);
+
+/**
+ * Checks count shares at once: a random linear combination of them (weighted from random) is checked
+ * with one multi-exponentiation over the commitments, so the cost barely grows with count
+ * Returns 1 if all are valid, 0 if any is not (or random failed or memory could not be allocated),
+ * in which case vssVerify tells which
+ */
+int vssVerifyBatch(const uint8_t commitments[][VSS_POINT_SIZE], uint8_t shares_required, const uint8_t x[],
+		const uint8_t shares[][VSS_SCALAR_SIZE], size_t count, const struct random_source* random);
+
+/**
+ * Derives the secret from shares_required shares at distinct nonzero X coordinates
+ */
+void vssCombine(uint8_t secret[VSS_SCALAR_SIZE], const uint8_t x[], const uint8_t shares[][VSS_SCALAR_SIZE], uint8_t shares_required);
+
+/**
+ * Derives an AEAD key from a VSS secret
+ */
+void vssDeriveKey(uint8_t key[AEAD_KEY_SIZE], const uint8_t secret[VSS_SCALAR_SIZE]);
+
+/**
+ * A set of worker threads which the *Parallel functions spread their work across
+ */
+struct pool;
+
+/**
+ * Creates a pool which spreads work across threads threads (including the calling one)
+ * Returns NULL if the threads could not be started
+ */
+struct pool* poolCreate(unsigned threads);
+
+void poolFree(struct pool* pool);
+
+/**
+ * splitBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ * Each chunk only writes its own slice of every share, so the results are identical to splitBuffer
+ */
+void splitBufferParallel(struct pool* pool, uint8_t* shares[], const uint8_t x[], uint8_t total_shares, const uint8_t secret[], const uint8_t random[], uint8_t shares_required, size_t length);
+
+/**
+ * combinerBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ */
+void combinerBufferParallel(struct pool* pool, const struct combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length);
+
+/**
+ * encoderBuffer with the buffers cut into cache-sized chunks which are spread across the pool
+ */
+void encoderBufferParallel(struct pool* pool, const struct encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length);
+
+void encoderRefreshParallel(struct pool* pool, const struct encoder* encoder, uint8_t* shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length);
+void resharerBufferParallel(struct pool* pool, const struct resharer* resharer, uint8_t* new_shares[], const uint8_t* const old_shares[], const uint8_t random[], size_t length);
+void disperseBufferParallel(struct pool* pool, const struct encoder* encoder, uint8_t* fragments[], uint8_t data[], size_t length);
+void decoderBufferParallel(struct pool* pool, const struct decoder* decoder, uint8_t data[], const uint8_t* const fragments[], size_t fragment_length);
+
+/**
+ * Exhaustively checks what checkNoInformationLeak proves: for every set of shares_required - 1 of the
+ * shares and every X coordinate not in it, each of the P values a share there could take derives a
+ * different secret
+ * Returns 1 if so (0 if not or out of memory), and the number of subsets enumerated in subsets_checked
+ */
+int auditNoInformationLeak(struct pool* pool, const uint8_t x[], uint8_t total_shares, uint8_t shares_required, uint64_t* subsets_checked);
+
+/**
+ * Checks the same property independently of auditNoInformationLeak and checkNoInformationLeak, by
+ * brute force through calculateSecret over each of the length bytes of the shares themselves (for
+ * auditors who want a second opinion, it is far slower)
+ * Returns 1 if so (0 if not), and the number of subsets enumerated over all bytes in subsets_checked
+ */
+int auditSharesNoInformationLeak(struct pool* pool, const uint8_t* const shares[], const uint8_t x[], uint8_t total_shares, uint8_t shares_required,
+		size_t length, uint64_t* subsets_checked);
+
+/*
+ * Wider fields, GF(2^16) and GF(2^32), for more than P - 1 shares: calculateQ16, calculateSecret16,
+ * calculateQ32 and calculateSecret32 are calculateQ and calculateSecret over them
+ */
+#define WIDE_BITS 16
+#include "shamirssecret_wide.h"
+#define WIDE_BITS 32
+#include "shamirssecret_wide.h"
+
+/**
+ * Splitting and combining whole buffers over GF(2^field_bits), field_bits being 16 or 32
+ * Buffers hold little-endian field elements, so lengths (in bytes) must be multiples of
+ * field_bits / 8. X coordinates are given as uint32_t whatever the width.
+ */
+struct wide_encoder;
+struct wide_combiner;
+
+/**
+ * Checks that the X coordinates are distinct, nonzero and fit in the field, which over a
+ * field this large is all checkNoInformationLeak comes down to
+ */
+int wideCheckX(unsigned field_bits, const uint32_t x[], uint32_t total_shares);
+
+/**
+ * drbgPickX over GF(2^field_bits)
+ * Returns 0 if memory could not be allocated
+ */
+int drbgPickWideX(struct drbg* drbg, unsigned field_bits, uint32_t x[], uint32_t total_shares);
+
+/**
+ * Returns NULL if memory could not be allocated
+ */
+struct wide_encoder* wideEncoderCreate(unsigned field_bits, const uint32_t x[], uint32_t total_shares, uint32_t shares_required);
+
+/**
+ * encoderBuffer over the wider field: random holds (shares_required - 1) rows of length bytes
+ */
+void wideEncoderBuffer(const struct wide_encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length);
+void wideEncoderBufferParallel(struct pool* pool, const struct wide_encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length);
+void wideEncoderFree(struct wide_encoder* encoder);
+
+/**
+ * Returns NULL if memory could not be allocated
+ */
+struct wide_combiner* wideCombinerCreate(unsigned field_bits, const uint32_t x[], uint32_t shares_required);
+void wideCombinerBuffer(const struct wide_combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length);
+void wideCombinerBufferParallel(struct pool* pool, const struct wide_combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length);
+void wideCombinerFree(struct wide_combiner* combiner);
+#endif // !defined(IN_KERNEL)
@@ -0,0 +1,319 @@
+/*
+ * Shamir's secret sharing C++ interface, with the threshold k fixed at compile time
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHAMIRSSECRET_HPP
+#define SHAMIRSSECRET_HPP
+
+/*
+ * Header-only, needs C++20 (std::span) and links against the same objects as the C interface.
+ *
+ * Splitter<K> and Combiner<K> take shares_required as the template parameter K. For K from 2 to
+ * 16 the per-point calculations (calculateQ and calculateSecret, and the Lagrange weights behind
+ * them) are fully unrolled and constexpr, so with X coordinates known at compile time (eg
+ * --sequential-x) the weights are constants. Any other K goes through the C functions instead.
+ * Whole buffers always go through the C buffer functions, whose kernels are already vectorised
+ * (see field.h) and beat anything unrolled over K one byte at a time.
+ *
+ * The per-point field arithmetic here is the table-free arithmetic of -DFIELD_CONSTANT_TIME.
+ *
+ * SecretBuffer and Shares own their bytes, wipe them when destroyed and can only be moved,
+ * so share data is never copied behind the caller's back.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string.h>
+#include <utility>
+
+extern "C" {
+#include "shamirssecret.h"
+}
+
+namespace asss {
+
+namespace field {
+
+constexpr uint8_t add(uint8_t a, uint8_t b) {
+	return a ^ b;
+}
+
+// field_mul_ct: never branches on or indexes memory with its arguments
+constexpr uint8_t mul(uint8_t a, uint8_t b) {
+	uint8_t ret = 0;
+	for (int i = 0; i < 8; i++) {
+		ret ^= a & -(b & 1);
+		a = (a << 1) ^ (0x1b & -(a >> 7)); // x^8 == x^4 + x^3 + x + 1
+		b >>= 1;
+	}
+	return ret;
+}
+
+constexpr uint8_t invert(uint8_t a) {
+	assert(a != 0);
+	uint8_t ret = 1;
+	for (uint8_t e = 254; e; e >>= 1) { // a^255 == 1
+		if (e & 1)
+			ret = mul(ret, a);
+		a = mul(a, a);
+	}
+	return ret;
+}
+
+} // namespace field
+
+// Whether K gets the unrolled kernels rather than the C functions
+template <std::size_t K>
+inline constexpr bool unrolled = K >= 2 && K <= 16;
+
+/**
+ * A heap buffer which is wiped (with explicit_bzero) before it is freed
+ */
+class SecretBuffer {
+public:
+	SecretBuffer() = default;
+	// size zeroed bytes, throws std::bad_alloc
+	explicit SecretBuffer(std::size_t size) : data_(new uint8_t[size]()), size_(size) {}
+	SecretBuffer(SecretBuffer&& other) noexcept : data_(std::move(other.data_)), size_(std::exchange(other.size_, 0)) {}
+	SecretBuffer& operator=(SecretBuffer&& other) noexcept {
+		if (this != &other) {
+			wipe();
+			data_ = std::move(other.data_);
+			size_ = std::exchange(other.size_, 0);
+		}
+		return *this;
+	}
+	SecretBuffer(const SecretBuffer&) = delete;
+	SecretBuffer& operator=(const SecretBuffer&) = delete;
+	~SecretBuffer() { wipe(); }
+
+	uint8_t* data() { return data_.get(); }
+	const uint8_t* data() const { return data_.get(); }
+	std::size_t size() const { return size_; }
+	std::span<uint8_t> span() { return { data_.get(), size_ }; }
+	std::span<const uint8_t> span() const { return { data_.get(), size_ }; }
+
+private:
+	void wipe() {
+		if (data_)
+			explicit_bzero(data_.get(), size_);
+	}
+
+	std::unique_ptr<uint8_t[]> data_;
+	std::size_t size_ = 0;
+};
+
+/**
+ * count shares of length bytes each, with their X coordinates, in one SecretBuffer
+ */
+class Shares {
+public:
+	// Throws std::bad_alloc
+	Shares(std::span<const uint8_t> x, std::size_t length) : count_(x.size()), length_(length), data_(x.size() * length) {
+		assert(x.size() < P);
+		std::copy(x.begin(), x.end(), x_.begin());
+		for (std::size_t i = 0; i < count_; i++)
+			pointers_[i] = &data_.data()[i * length_];
+	}
+	Shares(Shares&& other) noexcept = default;
+	Shares& operator=(Shares&& other) noexcept = default;
+	Shares(const Shares&) = delete;
+	Shares& operator=(const Shares&) = delete;
+
+	std::size_t count() const { return count_; }
+	std::size_t length() const { return length_; }
+	uint8_t x(std::size_t i) const { return x_[i]; }
+	std::span<const uint8_t> xs() const { return { x_.data(), count_ }; }
+	std::span<uint8_t> operator[](std::size_t i) { return { pointers_[i], length_ }; }
+	std::span<const uint8_t> operator[](std::size_t i) const { return { pointers_[i], length_ }; }
+	// One pointer per share, as the C buffer functions take them
+	uint8_t** pointers() { return pointers_.data(); }
+	const uint8_t* const* pointers() const { return pointers_.data(); }
+
+private:
+	std::size_t count_, length_;
+	std::array<uint8_t, P - 1> x_ {};
+	SecretBuffer data_;
+	// Into data_, whose storage does not move when data_ does
+	std::array<uint8_t*, P - 1> pointers_ {};
+};
+
+/**
+ * Splitting with shares_required fixed at K, over the encoding matrix of a fixed set of X
+ * coordinates (see encoderCreate)
+ */
+template <std::size_t K>
+	requires(K >= 1 && K < P)
+class Splitter {
+public:
+	/**
+	 * calculateQ: the Y coordinate of the point with the given (nonzero) X
+	 * coefficients[0] == secret, the rest are secure random values
+	 */
+	static constexpr uint8_t q(std::span<const uint8_t, K> coefficients, uint8_t x) {
+		assert(x != 0); // q(0) == secret
+		if constexpr (unrolled<K>) {
+			return horner(coefficients, x, std::make_index_sequence<K - 1>());
+		} else {
+			std::array<uint8_t, K> copy;
+			std::copy(coefficients.begin(), coefficients.end(), copy.begin());
+			const uint8_t ret = calculateQ(copy.data(), K, x);
+			explicit_bzero(copy.data(), K);
+			return ret;
+		}
+	}
+
+	// Throws std::bad_alloc
+	explicit Splitter(std::span<const uint8_t> x) : encoder_(encoderCreate(x.data(), x.size(), K)), total_shares_(x.size()) {
+		assert(x.size() >= K && x.size() < P);
+		if (!encoder_)
+			throw std::bad_alloc();
+		std::copy(x.begin(), x.end(), x_.begin());
+	}
+
+	std::size_t total_shares() const { return total_shares_; }
+	std::span<const uint8_t> xs() const { return { x_.data(), total_shares_ }; }
+
+	/**
+	 * encoderBuffer: calculates every share of secret, given K - 1 rows of secret.size() secure
+	 * random bytes, spread across pool if it is not NULL
+	 */
+	void split(Shares& shares, std::span<const uint8_t> secret, std::span<const uint8_t> random, struct pool* pool = nullptr) const {
+		assert(shares.count() == total_shares_ && shares.length() == secret.size());
+		assert(random.size() == (K - 1) * secret.size());
+		encoderBufferParallel(pool, encoder_.get(), shares.pointers(), secret.data(), random.data(), secret.size());
+	}
+
+	/**
+	 * Splits secret with random coefficients from drbg (which are wiped afterwards)
+	 * Throws std::bad_alloc
+	 */
+	Shares split(std::span<const uint8_t> secret, struct drbg* drbg, struct pool* pool = nullptr) const {
+		Shares shares(xs(), secret.size());
+		SecretBuffer random((K - 1) * secret.size());
+		drbgGenerate(drbg, random.data(), random.size());
+		split(shares, secret, random.span(), pool);
+		return shares;
+	}
+
+private:
+	// Horner's rule, from the highest coefficient down
+	template <std::size_t... I>
+	static constexpr uint8_t horner(std::span<const uint8_t, K> coefficients, uint8_t x, std::index_sequence<I...>) {
+		uint8_t ret = coefficients[K - 1];
+		((ret = field::add(field::mul(ret, x), coefficients[K - 2 - I])), ...);
+		return ret;
+	}
+
+	struct EncoderFree {
+		void operator()(struct encoder* encoder) const { encoderFree(encoder); }
+	};
+	std::unique_ptr<struct encoder, EncoderFree> encoder_;
+	std::size_t total_shares_;
+	std::array<uint8_t, P - 1> x_ {};
+};
+
+/**
+ * Combining with shares_required fixed at K, from a fixed set of K X coordinates
+ * (see combinerCreate). Holds no secrets, so it is an ordinary constexpr value.
+ */
+template <std::size_t K>
+	requires(K >= 1 && K < P)
+class Combiner {
+public:
+	constexpr explicit Combiner(std::span<const uint8_t, K> x) {
+		std::copy(x.begin(), x.end(), x_.begin());
+		if constexpr (unrolled<K>)
+			weights_ = weights(std::make_index_sequence<K>());
+	}
+
+	/**
+	 * calculateSecret: derives the secret from the Y coordinates of the points
+	 */
+	constexpr uint8_t secret(std::span<const uint8_t, K> q) const {
+		if constexpr (unrolled<K>) {
+			return dot(q, std::make_index_sequence<K>());
+		} else {
+			std::array<uint8_t, K> x = x_, copy;
+			std::copy(q.begin(), q.end(), copy.begin());
+			const uint8_t ret = calculateSecret(x.data(), copy.data(), K);
+			explicit_bzero(copy.data(), K);
+			return ret;
+		}
+	}
+
+	/**
+	 * combineBuffer: derives secret.size() bytes of the secret from one buffer per X coordinate
+	 */
+	void combine(std::span<uint8_t> secret, std::span<const uint8_t* const, K> shares) const {
+		combineBuffer(secret.data(), x_.data(), shares.data(), K, secret.size());
+	}
+
+	/**
+	 * Derives the secret from the shares at the X coordinates given, which must
+	 * be the ones the combiner was created with, in order
+	 * Throws std::bad_alloc
+	 */
+	SecretBuffer combine(const Shares& shares, std::span<const std::size_t, K> which) const {
+		std::array<const uint8_t*, K> pointers;
+		for (std::size_t j = 0; j < K; j++) {
+			assert(which[j] < shares.count() && shares.x(which[j]) == x_[j]);
+			pointers[j] = shares.pointers()[which[j]];
+		}
+		SecretBuffer secret(shares.length());
+		combine(secret.span(), pointers);
+		return secret;
+	}
+
+	// The Lagrange weight of each X coordinate (only calculated when unrolled)
+	constexpr const std::array<uint8_t, K>& weights() const { return weights_; }
+
+private:
+	// The x^0 term of each Lagrange basis polynomial: the product of x[j] / (x[i] - x[j]) over j != i
+	template <std::size_t... J>
+	constexpr uint8_t weight(std::size_t i, std::index_sequence<J...>) const {
+		uint8_t numerator = 1, denominator = 1;
+		((J != i ? (numerator = field::mul(numerator, x_[J]), denominator = field::mul(denominator, field::add(x_[i], x_[J]))) : 0), ...);
+		return field::mul(numerator, field::invert(denominator));
+	}
+
+	template <std::size_t... I>
+	constexpr std::array<uint8_t, K> weights(std::index_sequence<I...> seq) const {
+		return { weight(I, seq)... };
+	}
+
+	template <std::size_t... I>
+	constexpr uint8_t dot(std::span<const uint8_t, K> q, std::index_sequence<I...>) const {
+		return (field::mul(weights_[I], q[I]) ^ ...);
+	}
+
+	std::array<uint8_t, K> x_ {}, weights_ {};
+};
+
+} // namespace asss
+
+#endif // SHAMIRSSECRET_HPP
@@ -0,0 +1,103 @@
+/*
+ * Tests for the C++ interface (shamirssecret.hpp) against the C one
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <type_traits>
+
+#include "shamirssecret.hpp"
+
+#define CHECKSTATE(x) assert(x)
+
+// With --sequential-x style X coordinates the whole round trip happens at compile time
+constexpr std::array<uint8_t, 3> sequential_x = { 1, 2, 3 };
+constexpr std::array<uint8_t, 3> coefficients = { 0x42, 0x9a, 0x17 };
+constexpr std::array<uint8_t, 3> sequential_q = {
+	asss::Splitter<3>::q(coefficients, 1), asss::Splitter<3>::q(coefficients, 2), asss::Splitter<3>::q(coefficients, 3),
+};
+static_assert(asss::Combiner<3>(sequential_x).secret(sequential_q) == 0x42);
+static_assert(asss::field::mul(asss::field::invert(0x53), 0x53) == 1);
+
+static_assert(!std::is_copy_constructible_v<asss::SecretBuffer> && std::is_nothrow_move_constructible_v<asss::SecretBuffer>);
+static_assert(!std::is_copy_constructible_v<asss::Shares> && std::is_nothrow_move_constructible_v<asss::Shares>);
+static_assert(!std::is_copy_constructible_v<asss::Splitter<3>> && std::is_move_constructible_v<asss::Splitter<3>>);
+
+// Checks Splitter<K> and Combiner<K> against calculateQ, calculateSecret and the buffer functions
+template <std::size_t K>
+static void test_k(struct drbg* drbg) {
+	constexpr uint8_t total_shares = K + 3;
+	uint8_t x[total_shares];
+	drbgPickX(drbg, x, total_shares);
+
+	for (int iteration = 0; iteration < 64; iteration++) {
+		std::array<uint8_t, K> c, q;
+		drbgGenerate(drbg, c.data(), K);
+		for (std::size_t i = 0; i < K; i++) {
+			q[i] = asss::Splitter<K>::q(c, x[i]);
+			CHECKSTATE(q[i] == calculateQ(c.data(), K, x[i]));
+		}
+		const asss::Combiner<K> combiner(std::span<const uint8_t, K>(x, K));
+		CHECKSTATE(combiner.secret(q) == c[0]);
+		CHECKSTATE(calculateSecret(x, q.data(), K) == c[0]);
+	}
+
+	// Buffers: split, move the shares around and combine from the last K of them
+	uint8_t secret[1000];
+	drbgGenerate(drbg, secret, sizeof(secret));
+	asss::Splitter<K> splitter(std::span<const uint8_t>(x, total_shares));
+	asss::Shares shares = splitter.split(secret, drbg);
+	asss::Shares moved = std::move(shares);
+	const std::array<uint8_t, K> last_x = [&] {
+		std::array<uint8_t, K> ret;
+		std::memcpy(ret.data(), &x[total_shares - K], K);
+		return ret;
+	}();
+	std::array<std::size_t, K> which;
+	for (std::size_t j = 0; j < K; j++)
+		which[j] = total_shares - K + j;
+	asss::SecretBuffer combined = asss::Combiner<K>(last_x).combine(moved, which);
+	CHECKSTATE(combined.size() == sizeof(secret) && std::memcmp(combined.data(), secret, sizeof(secret)) == 0);
+
+	// Every byte of every share is that of splitBuffer
+	{
+		asss::SecretBuffer random((K - 1) * sizeof(secret));
+		drbgGenerate(drbg, random.data(), random.size());
+		asss::Shares expected(std::span<const uint8_t>(x, total_shares), sizeof(secret));
+		splitBuffer(expected.pointers(), x, total_shares, secret, random.data(), K, sizeof(secret));
+		splitter.split(moved, secret, random.span());
+		for (uint8_t i = 0; i < total_shares; i++)
+			CHECKSTATE(std::memcmp(expected[i].data(), moved[i].data(), sizeof(secret)) == 0);
+	}
+}
+
+template <std::size_t... K>
+static void test_all(struct drbg* drbg, std::index_sequence<K...>) {
+	(test_k<K + 1>(drbg), ...);
+}
+
+int main() {
+	struct drbg* drbg = drbgCreate(&randomSystem);
+	CHECKSTATE(drbg);
+	// 1 and 17 through 20 take the C path, 2 to 16 the unrolled one
+	test_all(drbg, std::make_index_sequence<20>());
+	drbgFree(drbg);
+	return 0;
+}
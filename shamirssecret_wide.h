@@ -0,0 +1,56 @@
+/*
+ * Shamir's scheme over GF(2^WIDE_BITS), a template included by shamirssecret.h once per width
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * No include guard: define WIDE_BITS (16 or 32) and include this to declare
+ * calculateQ<WIDE_BITS> and friends, which are calculateQ and friends with field
+ * elements of WIDE_BITS bits and room for up to 2^WIDE_BITS - 1 shares.
+ * WIDE_BITS is undefined again at the end.
+ */
+
+#if WIDE_BITS == 16
+#define WIDE_T uint16_t
+#elif WIDE_BITS == 32
+#define WIDE_T uint32_t
+#else
+#error "WIDE_BITS must be 16 or 32"
+#endif
+#define WIDE_PASTE(name, bits) name##bits
+#define WIDE_NAME(name, bits) WIDE_PASTE(name, bits)
+#define WIDE(name) WIDE_NAME(name, WIDE_BITS)
+
+/**
+ * Calculates the Y coordinate that the point with the given X
+ * coefficients[0] == secret, the rest are secure random values
+ */
+WIDE_T WIDE(calculateQ)(const WIDE_T coefficients[], uint32_t shares_required, WIDE_T x);
+
+/**
+ * Derives the secret given a set of shares_required points (x and q coordinates)
+ */
+WIDE_T WIDE(calculateSecret)(const WIDE_T x[], const WIDE_T q[], uint32_t shares_required);
+
+#undef WIDE
+#undef WIDE_NAME
+#undef WIDE_PASTE
+#undef WIDE_T
+#undef WIDE_BITS
@@ -0,0 +1,327 @@
+/*
+ * Share file format
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "share.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRC32C_SSE42
+#include <immintrin.h>
+#endif
+
+static const uint8_t magic[4] = { 'A', 'S', 'S', 'S' };
+
+/*
+ * CRC32C, with the SSE4.2 CRC32 instruction where there is one and a table otherwise
+ */
+static uint32_t crc32c_table[256];
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t data[], size_t length) {
+	size_t i;
+	for (i = 0; i < length; i++)
+		crc = crc32c_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t data[], size_t length) {
+	size_t i = 0;
+#ifdef __x86_64__
+	uint64_t crc64 = crc;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, &data[i], 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = crc64;
+#endif
+	for (; i < length; i++)
+		crc = _mm_crc32_u8(crc, data[i]);
+	return crc;
+}
+#endif
+
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t data[], size_t length) = crc32c_software;
+
+__attribute__((constructor))
+static void crc32c_init(void) {
+	uint32_t i, j;
+	for (i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0x82f63b78 & -(crc & 1));
+		crc32c_table[i] = crc;
+	}
+#ifdef CRC32C_SSE42
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		crc32c_impl = crc32c_sse42;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const uint8_t data[], size_t length) {
+	return ~crc32c_impl(~crc, data, length);
+}
+
+static void put32(uint8_t out[4], uint32_t v) {
+	int i;
+	for (i = 0; i < 4; i++)
+		out[i] = v >> (8 * i);
+}
+
+static void put64(uint8_t out[8], uint64_t v) {
+	int i;
+	for (i = 0; i < 8; i++)
+		out[i] = v >> (8 * i);
+}
+
+static uint32_t get32(const uint8_t in[4]) {
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static uint64_t get64(const uint8_t in[8]) {
+	return get32(in) | ((uint64_t)get32(&in[4]) << 32);
+}
+
+void share_header_encode(uint8_t out[SHARE_HEADER_SIZE], const struct share_header* header) {
+	memset(out, 0, SHARE_HEADER_SIZE);
+	memcpy(out, magic, sizeof(magic));
+	out[4] = header->version;
+	out[5] = header->field_bits;
+	out[6] = header->mode;
+	out[10] = header->packing;
+	if (header->field_bits == 8) {
+		out[7] = header->x;
+		out[8] = header->k;
+		out[9] = header->n;
+	} else {
+		put32(&out[96], header->x);
+		put32(&out[100], header->k);
+		put32(&out[104], header->n);
+	}
+	put32(&out[12], header->chunk_size);
+	memcpy(&out[16], header->split_id, sizeof(header->split_id));
+	put64(&out[32], header->secret_length);
+	put64(&out[40], header->payload_length);
+	memcpy(&out[48], header->mode_data, SHARE_MODE_DATA_SIZE);
+	put32(&out[SHARE_HEADER_SIZE - 4], crc32c(0, out, SHARE_HEADER_SIZE - 4));
+}
+
+int share_header_is_valid(const uint8_t in[SHARE_HEADER_SIZE]) {
+	return memcmp(in, magic, sizeof(magic)) == 0 && get32(&in[SHARE_HEADER_SIZE - 4]) == crc32c(0, in, SHARE_HEADER_SIZE - 4);
+}
+
+int share_header_decode(struct share_header* header, const uint8_t in[SHARE_HEADER_SIZE]) {
+	if (!share_header_is_valid(in))
+		return 0;
+	header->version = in[4];
+	if (header->version != SHARE_VERSION)
+		return 0;
+	header->field_bits = in[5];
+	header->mode = in[6];
+	header->packing = in[10];
+	if (header->field_bits == 8) {
+		header->x = in[7];
+		header->k = in[8];
+		header->n = in[9];
+	} else {
+		header->x = get32(&in[96]);
+		header->k = get32(&in[100]);
+		header->n = get32(&in[104]);
+	}
+	header->chunk_size = get32(&in[12]);
+	memcpy(header->split_id, &in[16], sizeof(header->split_id));
+	header->secret_length = get64(&in[32]);
+	header->payload_length = get64(&in[40]);
+	memcpy(header->mode_data, &in[48], SHARE_MODE_DATA_SIZE);
+	return header->chunk_size != 0 && (header->field_bits == 8 || header->field_bits == 16 || header->field_bits == 32);
+}
+
+void share_writer_init(struct share_writer* writer) {
+	memset(writer, 0, sizeof(struct share_writer));
+}
+
+static int writer_push(struct share_writer* writer) {
+	if (writer->chunks == writer->capacity) {
+		size_t capacity = writer->capacity ? 2 * writer->capacity : 64;
+		uint32_t* index = realloc(writer->index, capacity * sizeof(uint32_t));
+		if (!index)
+			return 0;
+		writer->index = index;
+		writer->capacity = capacity;
+	}
+	writer->index[writer->chunks++] = writer->crc;
+	writer->crc = 0;
+	writer->filled = 0;
+	return 1;
+}
+
+int share_writer_update(struct share_writer* writer, const uint8_t data[], size_t length) {
+	writer->length += length;
+	while (length) {
+		size_t count = SHARE_CHUNK_SIZE - writer->filled < length ? SHARE_CHUNK_SIZE - writer->filled : length;
+		writer->crc = crc32c(writer->crc, data, count);
+		writer->filled += count;
+		data += count;
+		length -= count;
+		if (writer->filled == SHARE_CHUNK_SIZE && !writer_push(writer))
+			return 0;
+	}
+	return 1;
+}
+
+int share_writer_finish(struct share_writer* writer, FILE* fp) {
+	int ret = 1;
+	size_t i;
+	if (writer->filled && !writer_push(writer))
+		ret = 0;
+	for (i = 0; ret && i < writer->chunks; i++) {
+		uint8_t entry[4];
+		put32(entry, writer->index[i]);
+		ret = fwrite(entry, 1, 4, fp) == 4;
+	}
+	free(writer->index);
+	return ret;
+}
+
+static uint64_t chunk_count(uint64_t length, uint32_t chunk_size) {
+	return (length + chunk_size - 1) / chunk_size;
+}
+
+enum share_open_result share_reader_open(struct share_reader* reader, FILE* fp) {
+	uint8_t header[SHARE_HEADER_SIZE];
+	off_t size;
+	uint64_t i;
+	memset(reader, 0, sizeof(struct share_reader));
+	if (fseeko(fp, 0, SEEK_END) != 0 || (size = ftello(fp)) < 0 || fseeko(fp, 0, SEEK_SET) != 0)
+		return SHARE_OPEN_ERROR;
+
+	const size_t header_read = size < SHARE_HEADER_SIZE ? (size_t)size : SHARE_HEADER_SIZE;
+	if (fread(header, 1, header_read, fp) != header_read)
+		return SHARE_OPEN_ERROR;
+	if (header_read < sizeof(magic) || memcmp(header, magic, sizeof(magic)) != 0) {
+		// Only a share without the magic is a legacy one, anything with it is held to its header
+		uint8_t x;
+		if (size < 1 || fseeko(fp, 0, SEEK_SET) != 0 || fread(&x, 1, 1, fp) != 1)
+			return size < 1 ? SHARE_OPEN_SHORT : SHARE_OPEN_ERROR;
+		reader->legacy = 1;
+		reader->header.field_bits = 8;
+		reader->header.mode = SHARE_MODE_SHAMIR;
+		reader->header.x = x;
+		reader->header.secret_length = reader->header.payload_length = size - 1;
+		reader->payload_offset = 1;
+		return SHARE_OPEN_OK;
+	}
+	if (header_read < SHARE_HEADER_SIZE)
+		return SHARE_OPEN_SHORT;
+	if (!share_header_is_valid(header))
+		return SHARE_OPEN_CORRUPT;
+	if (!share_header_decode(&reader->header, header))
+		return SHARE_OPEN_UNSUPPORTED;
+
+	if (reader->header.payload_length > (uint64_t)size)
+		return SHARE_OPEN_SHORT;
+	const uint64_t chunks = chunk_count(reader->header.payload_length, reader->header.chunk_size);
+	if ((uint64_t)size != SHARE_HEADER_SIZE + reader->header.payload_length + 4 * chunks)
+		return SHARE_OPEN_SHORT;
+	reader->index = malloc(chunks * sizeof(uint32_t) + 1);
+	if (!reader->index || fseeko(fp, SHARE_HEADER_SIZE + reader->header.payload_length, SEEK_SET) != 0)
+		return SHARE_OPEN_ERROR;
+	for (i = 0; i < chunks; i++) {
+		uint8_t entry[4];
+		if (fread(entry, 1, 4, fp) != 4)
+			return SHARE_OPEN_ERROR;
+		reader->index[i] = get32(entry);
+	}
+	reader->payload_offset = SHARE_HEADER_SIZE;
+	return fseeko(fp, SHARE_HEADER_SIZE, SEEK_SET) == 0 ? SHARE_OPEN_OK : SHARE_OPEN_ERROR;
+}
+
+int share_reader_update(struct share_reader* reader, const uint8_t data[], size_t length, uint64_t* bad_chunk) {
+	int ret = 1;
+	if (reader->legacy)
+		return 1;
+	while (length) {
+		const uint64_t chunk_start = reader->chunk * reader->header.chunk_size;
+		const size_t chunk_length = reader->header.payload_length - chunk_start < reader->header.chunk_size ?
+				reader->header.payload_length - chunk_start : reader->header.chunk_size;
+		size_t count = chunk_length - reader->filled < length ? chunk_length - reader->filled : length;
+		reader->crc = crc32c(reader->crc, data, count);
+		reader->filled += count;
+		data += count;
+		length -= count;
+		if (reader->filled == chunk_length) {
+			if (reader->crc != reader->index[reader->chunk] && ret) {
+				*bad_chunk = reader->chunk;
+				ret = 0;
+			}
+			reader->chunk++;
+			reader->crc = 0;
+			reader->filled = 0;
+		}
+	}
+	return ret;
+}
+
+int share_reader_seek(struct share_reader* reader, FILE* fp, uint64_t offset, uint64_t* start) {
+	if (reader->legacy) {
+		*start = offset;
+	} else {
+		reader->chunk = offset / reader->header.chunk_size;
+		reader->crc = 0;
+		reader->filled = 0;
+		*start = reader->chunk * reader->header.chunk_size;
+	}
+	return fseeko(fp, reader->payload_offset + *start, SEEK_SET) == 0;
+}
+
+void share_reader_free(struct share_reader* reader) {
+	free(reader->index);
+	memset(reader, 0, sizeof(struct share_reader));
+}
+
+static const uint8_t commitments_magic[4] = { 'A', 'S', 'S', 'C' };
+
+int share_commitments_write(FILE* fp, const uint8_t split_id[16], const uint8_t commitments[][SHARE_COMMITMENT_SIZE], uint8_t k) {
+	uint8_t header[SHARE_COMMITMENTS_HEADER_SIZE] = { 0 };
+	memcpy(header, commitments_magic, 4);
+	header[4] = SHARE_VERSION;
+	header[5] = k;
+	memcpy(&header[8], split_id, 16);
+	return fwrite(header, 1, SHARE_COMMITMENTS_HEADER_SIZE, fp) == SHARE_COMMITMENTS_HEADER_SIZE &&
+		fwrite(commitments, SHARE_COMMITMENT_SIZE, k, fp) == k;
+}
+
+int share_commitments_read(FILE* fp, uint8_t split_id[16], uint8_t commitments[][SHARE_COMMITMENT_SIZE], uint8_t* k) {
+	uint8_t header[SHARE_COMMITMENTS_HEADER_SIZE];
+	if (fread(header, 1, SHARE_COMMITMENTS_HEADER_SIZE, fp) != SHARE_COMMITMENTS_HEADER_SIZE ||
+			memcmp(header, commitments_magic, 4) != 0 || header[4] != SHARE_VERSION || header[5] == 0)
+		return 0;
+	*k = header[5];
+	memcpy(split_id, &header[8], 16);
+	return fread(commitments, SHARE_COMMITMENT_SIZE, *k, fp) == *k && fgetc(fp) == EOF;
+}
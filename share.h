@@ -0,0 +1,178 @@
+/*
+ * Share file format
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARE_H
+#define SHARE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * A share file is
+ *   header (SHARE_HEADER_SIZE bytes) | payload | chunk index
+ * The header is
+ *   0   "ASSS"
+ *   4   version (1)
+ *   5   field width in bits (8, 16 or 32)
+ *   6   mode (enum share_mode)
+ *   7   x (0 if the field is wider than 8 bits)
+ *   8   k (likewise)
+ *   9   n (likewise)
+ *   10  secrets per polynomial for SHARE_MODE_PACKED, otherwise 0
+ *   11  reserved (0)
+ *   12  chunk size (4 bytes)
+ *   16  split ID, random and the same in every share of a split (16 bytes)
+ *   32  secret length (8 bytes)
+ *   40  payload length (8 bytes)
+ *   48  mode-specific data, for SHARE_MODE_DISPERSED this share of the key then the tag (48 bytes)
+ *   96  x if the field is wider than 8 bits, otherwise 0 (4 bytes)
+ *   100 k (likewise)
+ *   104 n (likewise)
+ *   108 reserved (0)
+ *   124 CRC32C of bytes 0 to 123
+ * with every integer little endian. The chunk index holds the CRC32C of each
+ * chunk size bytes of the payload (the last chunk may be shorter) in order.
+ * Over a wider field the payload is little-endian field elements, so the secret
+ * is zero-padded up to a whole number of them. A packed payload is one row of each
+ * stripe of the secret (see main.c), so it is about 1/packing the secret's length.
+ *
+ * Legacy shares are just the x byte followed by the payload (always SHARE_MODE_SHAMIR).
+ */
+
+#define SHARE_HEADER_SIZE 128
+#define SHARE_VERSION 1
+#define SHARE_CHUNK_SIZE (64 * 1024)
+#define SHARE_MODE_DATA_SIZE 48
+
+enum share_mode {
+	SHARE_MODE_SHAMIR = 0,
+	SHARE_MODE_DISPERSED = 1,
+	SHARE_MODE_VERIFIABLE = 2,	// as dispersed, but the key is shared with Feldman VSS (the mode data holds a VSS share)
+	SHARE_MODE_PACKED = 3,		// several secret bytes per polynomial (packedEncoderCreate), only over GF(2^8)
+};
+
+struct share_header {
+	uint8_t version, field_bits, mode;
+	uint32_t x, k, n;
+	uint32_t chunk_size;
+	uint8_t split_id[16];
+	uint64_t secret_length, payload_length;
+	uint8_t mode_data[SHARE_MODE_DATA_SIZE];
+	uint8_t packing; // secrets per polynomial for SHARE_MODE_PACKED, otherwise 0
+};
+
+/**
+ * CRC32C (Castagnoli), continuing from crc, which is 0 to start
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t data[], size_t length);
+
+void share_header_encode(uint8_t out[SHARE_HEADER_SIZE], const struct share_header* header);
+
+/**
+ * Whether in has the magic and a matching CRC, ie is a header of some version
+ */
+int share_header_is_valid(const uint8_t in[SHARE_HEADER_SIZE]);
+
+/**
+ * Returns 0 if in is not a valid header of a version this code understands
+ */
+int share_header_decode(struct share_header* header, const uint8_t in[SHARE_HEADER_SIZE]);
+
+/**
+ * Tracks the chunk CRCs of a payload as it is written
+ */
+struct share_writer {
+	uint32_t crc;
+	size_t filled;
+	uint64_t length;
+	uint32_t* index;
+	size_t chunks, capacity;
+};
+
+void share_writer_init(struct share_writer* writer);
+// Accounts for the next length bytes of the payload, returns 0 if memory could not be allocated
+int share_writer_update(struct share_writer* writer, const uint8_t data[], size_t length);
+// Writes the chunk index to fp (at its current position) and frees the writer, returns 0 on failure
+int share_writer_finish(struct share_writer* writer, FILE* fp);
+
+/**
+ * Checks the chunk CRCs of a payload as it is read
+ */
+struct share_reader {
+	int legacy;
+	struct share_header header;
+	uint64_t payload_offset; // where the payload starts in the file
+	uint32_t crc;
+	size_t filled;
+	uint64_t chunk;
+	uint32_t* index;
+};
+
+enum share_open_result {
+	SHARE_OPEN_OK,
+	SHARE_OPEN_SHORT,	// too short to hold the header, payload and index it claims
+	SHARE_OPEN_CORRUPT,	// has the magic but its header fails the CRC
+	SHARE_OPEN_UNSUPPORTED,	// a header of a version (or chunk size of 0, or field width) this code does not understand
+	SHARE_OPEN_ERROR,	// reading failed or memory could not be allocated
+};
+
+/**
+ * Reads the header (or legacy x byte) and index of the share open as fp, leaving fp at the start of the payload
+ */
+enum share_open_result share_reader_open(struct share_reader* reader, FILE* fp);
+
+/**
+ * Checks the next length bytes of the payload against the index
+ * Returns 0 if a chunk does not match, in which case *bad_chunk is set to the first such chunk's number
+ * (checking carries on past it, so a caller which can live with bad chunks may keep going)
+ */
+int share_reader_update(struct share_reader* reader, const uint8_t data[], size_t length, uint64_t* bad_chunk);
+
+/**
+ * Moves fp and reader to the start of the chunk holding byte offset of the payload (which must not be past its end),
+ * so that checking can pick up from there, and sets *start to where that chunk starts in the payload
+ * Legacy shares have no chunks, so they are moved to offset itself
+ * Returns 0 if fp could not be moved
+ */
+int share_reader_seek(struct share_reader* reader, FILE* fp, uint64_t offset, uint64_t* start);
+
+void share_reader_free(struct share_reader* reader);
+
+/*
+ * A commitments file (published by a verifiable split) is
+ *   0   "ASSC"
+ *   4   version (1)
+ *   5   k
+ *   6   reserved (0)
+ *   8   split ID (16 bytes)
+ *   24  k commitments (SHARE_COMMITMENT_SIZE bytes each)
+ */
+#define SHARE_COMMITMENTS_HEADER_SIZE 24
+#define SHARE_COMMITMENT_SIZE 32
+
+// Returns 0 on failure
+int share_commitments_write(FILE* fp, const uint8_t split_id[16], const uint8_t commitments[][SHARE_COMMITMENT_SIZE], uint8_t k);
+// commitments must have room for 255 commitments, returns 0 if fp does not hold exactly a commitments file this code understands
+int share_commitments_read(FILE* fp, uint8_t split_id[16], uint8_t commitments[][SHARE_COMMITMENT_SIZE], uint8_t* k);
+
+#endif // SHARE_H
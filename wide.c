@@ -0,0 +1,428 @@
+/*
+ * Shamir's scheme over GF(2^16) and GF(2^32), for more than P - 1 shares
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "field.h"
+#include "erasure.h"
+#include "pool.h"
+
+#if defined(__x86_64__)
+#define WIDE_PCLMUL
+#include <immintrin.h>
+#endif
+
+#ifndef always_inline
+#define always_inline inline __attribute__((always_inline))
+#endif
+
+// The wide fields' table setup costs about as much as a few hundred elements, so chunks are never smaller than this
+#define WIDE_MIN_CHUNK_SIZE 4096
+
+static inline uint16_t load16(const uint8_t p[]) {
+	return p[0] | (p[1] << 8);
+}
+
+static inline void store16(uint8_t p[], uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline uint32_t load32(const uint8_t p[]) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32(uint8_t p[], uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/*
+ * GF(2^16) modulo x^16 + x^12 + x^3 + x + 1 (0x1100b), of which x is a generator.
+ * Single multiplies go through exp/log tables; buffers are multiplied by a constant c
+ * through two 256-entry tables of c * (low byte) and c * (high byte << 8), which are
+ * built from c alone by linearity. -DFIELD_CONSTANT_TIME avoids all the tables.
+ */
+static uint16_t exp16[2 * 65535], log16[65536];
+
+__attribute__((constructor))
+static void gf16_init(void) {
+	uint32_t a = 1, i;
+	for (i = 0; i < 65535; i++) {
+		exp16[i] = exp16[i + 65535] = a;
+		log16[a] = i;
+		a <<= 1;
+		if (a & 0x10000)
+			a ^= 0x1100b;
+	}
+}
+
+static inline uint16_t xtime16(uint16_t a) {
+	return (a << 1) ^ (0x100b & -(a >> 15));
+}
+
+static inline uint16_t gf_mul_ct16(uint16_t a, uint16_t b) {
+	uint16_t ret = 0;
+	uint8_t i;
+	for (i = 0; i < 16; i++) {
+		ret ^= a & -(b & 1);
+		a = xtime16(a);
+		b >>= 1;
+	}
+	return ret;
+}
+
+static inline uint16_t gf_mul16(uint16_t a, uint16_t b) {
+#ifndef FIELD_CONSTANT_TIME
+	if (a == 0 || b == 0)
+		return 0;
+	return exp16[log16[a] + log16[b]];
+#else
+	return gf_mul_ct16(a, b);
+#endif
+}
+
+static inline uint16_t gf_invert16(uint16_t a) {
+	CHECKSTATE(a != 0);
+#ifndef FIELD_CONSTANT_TIME
+	return exp16[65535 - log16[a]];
+#else
+	uint16_t ret = 1;
+	uint32_t e = 65534; // a^65535 == 1
+	for (; e; e >>= 1) {
+		if (e & 1)
+			ret = gf_mul_ct16(ret, a);
+		a = gf_mul_ct16(a, a);
+	}
+	return ret;
+#endif
+}
+
+#ifndef FIELD_CONSTANT_TIME
+static void gf_tables16(uint16_t lo[256], uint16_t hi[256], uint16_t c) {
+	uint16_t* table = lo;
+	unsigned bit, i;
+	lo[0] = hi[0] = 0;
+	for (bit = 0; bit < 16; bit++, c = xtime16(c)) {
+		const unsigned half = 1u << (bit & 7);
+		if (bit == 8)
+			table = hi;
+		for (i = 0; i < half; i++)
+			table[half + i] = table[i] ^ c;
+	}
+}
+#endif
+
+static void gf_dot16(uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length) {
+	size_t i;
+	uint32_t j;
+	memset(&dst[offset], 0, length);
+	for (j = 0; j < rows; j++) {
+#ifndef FIELD_CONSTANT_TIME
+		uint16_t lo[256], hi[256];
+		gf_tables16(lo, hi, c[j]);
+		for (i = offset; i < offset + length; i += 2) {
+			const uint16_t v = load16(&src[j][i]);
+			store16(&dst[i], load16(&dst[i]) ^ lo[v & 0xff] ^ hi[v >> 8]);
+		}
+#else
+		for (i = offset; i < offset + length; i += 2)
+			store16(&dst[i], load16(&dst[i]) ^ gf_mul_ct16(c[j], load16(&src[j][i])));
+#endif
+	}
+}
+
+/*
+ * GF(2^32) modulo x^32 + x^22 + x^2 + x + 1 (0x400007), multiplying by carry-less
+ * multiplication (PCLMULQDQ where the CPU has it) and then folding the top half back
+ * down. Neither way branches on or indexes memory with the data.
+ */
+static always_inline uint32_t gf_reduce32(uint64_t p) {
+	// Each fold leaves at most 10 fewer bits above x^31, so four always suffice
+	uint8_t i;
+	for (i = 0; i < 4; i++) {
+		const uint64_t hi = p >> 32;
+		p = (p & 0xffffffff) ^ (hi << 22) ^ (hi << 2) ^ (hi << 1) ^ hi;
+	}
+	return p;
+}
+
+static always_inline uint64_t clmul32_portable(uint32_t a, uint32_t b) {
+	uint64_t ret = 0;
+	uint8_t i;
+	for (i = 0; i < 32; i++)
+		ret ^= ((uint64_t)a << i) & -(uint64_t)((b >> i) & 1);
+	return ret;
+}
+
+static inline uint32_t gf_mul32(uint32_t a, uint32_t b) {
+	return gf_reduce32(clmul32_portable(a, b));
+}
+
+static inline uint32_t gf_invert32(uint32_t a) {
+	uint32_t ret = 1, e = 0xfffffffe; // a^(2^32 - 1) == 1
+	CHECKSTATE(a != 0);
+	for (; e; e >>= 1) {
+		if (e & 1)
+			ret = gf_mul32(ret, a);
+		a = gf_mul32(a, a);
+	}
+	return ret;
+}
+
+static always_inline void dot32(uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length,
+		uint64_t (*clmul)(uint32_t, uint32_t)) {
+	size_t i;
+	uint32_t j;
+	for (i = offset; i < offset + length; i += 4) {
+		// Carry-less products add up without carries too, so only the sum needs reducing
+		uint64_t sum = 0;
+		for (j = 0; j < rows; j++)
+			sum ^= clmul(c[j], load32(&src[j][i]));
+		store32(&dst[i], gf_reduce32(sum));
+	}
+}
+
+static void gf_dot32_portable(uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length) {
+	dot32(dst, src, c, rows, offset, length, clmul32_portable);
+}
+
+#ifdef WIDE_PCLMUL
+__attribute__((target("pclmul,sse2")))
+static always_inline uint64_t clmul32_pclmul(uint32_t a, uint32_t b) {
+	return _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b), 0));
+}
+
+__attribute__((target("pclmul,sse2")))
+static void gf_dot32_pclmul(uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length) {
+	dot32(dst, src, c, rows, offset, length, clmul32_pclmul);
+}
+#endif
+
+typedef void (*wide_dot_fn)(uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length);
+static wide_dot_fn gf_dot32 = gf_dot32_portable;
+
+#ifdef WIDE_PCLMUL
+__attribute__((constructor))
+static void gf32_init(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul"))
+		gf_dot32 = gf_dot32_pclmul;
+}
+#endif
+
+#define WIDE_BITS 16
+#include "wide_impl.h"
+#define WIDE_BITS 32
+#include "wide_impl.h"
+
+/*
+ * Whole buffers, over either width
+ */
+
+static uint32_t wide_mul(unsigned field_bits, uint32_t a, uint32_t b) {
+	return field_bits == 16 ? gf_mul16(a, b) : gf_mul32(a, b);
+}
+
+static uint32_t wide_invert(unsigned field_bits, uint32_t a) {
+	return field_bits == 16 ? gf_invert16(a) : gf_invert32(a);
+}
+
+// dst[offset + i] = sum over j < rows of c[j] * src[j][offset + i], for the elements in bytes [offset, offset + length)
+static void wide_dot(unsigned field_bits, uint8_t dst[], const uint8_t* const src[], const uint32_t c[], uint32_t rows, size_t offset, size_t length) {
+	if (field_bits == 16)
+		gf_dot16(dst, src, c, rows, offset, length);
+	else
+		gf_dot32(dst, src, c, rows, offset, length);
+}
+
+static size_t wide_chunk_size(unsigned rows) {
+	const size_t chunk = chunk_size(rows);
+	return chunk < WIDE_MIN_CHUNK_SIZE ? WIDE_MIN_CHUNK_SIZE : chunk;
+}
+
+static int compare_x(const void* a, const void* b) {
+	const uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Checks that the X coordinates are distinct, nonzero and fit in the field
+ * Returns 0 if not or memory could not be allocated
+ */
+int wideCheckX(unsigned field_bits, const uint32_t x[], uint32_t total_shares) {
+	uint32_t* sorted;
+	uint32_t i;
+	int ret = 1;
+	CHECKSTATE(field_bits == 16 || field_bits == 32);
+	for (i = 0; i < total_shares; i++)
+		if (x[i] == 0 || (field_bits == 16 && x[i] > 0xffff))
+			return 0;
+	// Every Lagrange weight is a product of x[j] / (x[j] - x), so none can be 0 in a field once the X coordinates are distinct
+	sorted = ALLOC(total_shares * sizeof(uint32_t) + 1);
+	if (!sorted)
+		return 0;
+	memcpy(sorted, x, total_shares * sizeof(uint32_t));
+	qsort(sorted, total_shares, sizeof(uint32_t), compare_x);
+	for (i = 1; i < total_shares; i++)
+		if (sorted[i] == sorted[i - 1])
+			ret = 0;
+	FREE(sorted);
+	return ret;
+}
+
+/*
+ * As struct encoder: row i of the matrix holds x[i]^0 .. x[i]^(k-1)
+ */
+struct wide_encoder {
+	unsigned field_bits;
+	uint32_t total_shares, shares_required;
+	uint32_t matrix[];
+};
+
+struct wide_encoder* wideEncoderCreate(unsigned field_bits, const uint32_t x[], uint32_t total_shares, uint32_t shares_required) {
+	struct wide_encoder* encoder;
+	uint32_t i, j;
+	CHECKSTATE(field_bits == 16 || field_bits == 32);
+	encoder = ALLOC(sizeof(struct wide_encoder) + (size_t)total_shares * shares_required * sizeof(uint32_t));
+	if (!encoder)
+		return encoder;
+	encoder->field_bits = field_bits;
+	encoder->total_shares = total_shares;
+	encoder->shares_required = shares_required;
+	for (i = 0; i < total_shares; i++) {
+		uint32_t x_pow = 1;
+		CHECKSTATE(x[i] != 0); // q(0) == secret
+		for (j = 0; j < shares_required; j++) {
+			encoder->matrix[(size_t)i * shares_required + j] = x_pow;
+			x_pow = wide_mul(field_bits, x_pow, x[i]);
+		}
+	}
+	return encoder;
+}
+
+static void wide_encoder_range(const struct wide_encoder* encoder, uint8_t* const shares[], const uint8_t* const in[], size_t offset, size_t count) {
+	uint32_t i;
+	for (i = 0; i < encoder->total_shares; i++)
+		wide_dot(encoder->field_bits, shares[i], in, &encoder->matrix[(size_t)i * encoder->shares_required], encoder->shares_required, offset, count);
+}
+
+static const uint8_t** wide_encoder_inputs(const struct wide_encoder* encoder, const uint8_t secret[], const uint8_t random[], size_t length) {
+	const uint8_t** in = ALLOC(encoder->shares_required * sizeof(uint8_t*));
+	uint32_t j;
+	CHECKSTATE(in);
+	CHECKSTATE(length % (encoder->field_bits / 8) == 0);
+	in[0] = secret;
+	for (j = 1; j < encoder->shares_required; j++)
+		in[j] = &random[(j - 1) * length];
+	return in;
+}
+
+void wideEncoderBuffer(const struct wide_encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length) {
+	const uint8_t** in = wide_encoder_inputs(encoder, secret, random, length);
+	size_t chunk = wide_chunk_size(encoder->total_shares + encoder->shares_required), offset;
+	for (offset = 0; offset < length; offset += chunk)
+		wide_encoder_range(encoder, shares, in, offset, length - offset < chunk ? length - offset : chunk);
+	FREE(in);
+}
+
+void wideEncoderFree(struct wide_encoder* encoder) {
+	FREE(encoder);
+}
+
+struct wide_combiner {
+	unsigned field_bits;
+	uint32_t shares_required;
+	uint32_t weights[];
+};
+
+struct wide_combiner* wideCombinerCreate(unsigned field_bits, const uint32_t x[], uint32_t shares_required) {
+	struct wide_combiner* combiner;
+	uint32_t i, j;
+	CHECKSTATE(field_bits == 16 || field_bits == 32);
+	combiner = ALLOC(sizeof(struct wide_combiner) + shares_required * sizeof(uint32_t));
+	if (!combiner)
+		return combiner;
+	combiner->field_bits = field_bits;
+	combiner->shares_required = shares_required;
+	for (i = 0; i < shares_required; i++) {
+		uint32_t numerator = 1, denominator = 1;
+		for (j = 0; j < shares_required; j++) {
+			if (i == j)
+				continue;
+			numerator = wide_mul(field_bits, numerator, x[j]);
+			denominator = wide_mul(field_bits, denominator, x[i] ^ x[j]);
+		}
+		combiner->weights[i] = wide_mul(field_bits, numerator, wide_invert(field_bits, denominator));
+	}
+	return combiner;
+}
+
+void wideCombinerBuffer(const struct wide_combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length) {
+	CHECKSTATE(length % (combiner->field_bits / 8) == 0);
+	wide_dot(combiner->field_bits, secret, shares, combiner->weights, combiner->shares_required, 0, length);
+}
+
+void wideCombinerFree(struct wide_combiner* combiner) {
+	FREE(combiner);
+}
+
+struct wide_encoder_job {
+	const struct wide_encoder* encoder;
+	uint8_t* const* shares;
+	const uint8_t* const* in;
+	size_t length, chunk;
+};
+
+static void wide_encoder_task(void* arg, size_t task) {
+	const struct wide_encoder_job* job = arg;
+	size_t offset = task * job->chunk;
+	size_t count = job->length - offset < job->chunk ? job->length - offset : job->chunk;
+	wide_encoder_range(job->encoder, job->shares, job->in, offset, count);
+}
+
+void wideEncoderBufferParallel(struct pool* pool, const struct wide_encoder* encoder, uint8_t* shares[], const uint8_t secret[], const uint8_t random[], size_t length) {
+	const uint8_t** in = wide_encoder_inputs(encoder, secret, random, length);
+	struct wide_encoder_job job = { encoder, shares, in, length, wide_chunk_size(encoder->total_shares + encoder->shares_required) };
+	pool_run(pool, wide_encoder_task, &job, (length + job.chunk - 1) / job.chunk);
+	FREE(in);
+}
+
+struct wide_combine_job {
+	const struct wide_combiner* combiner;
+	uint8_t* secret;
+	const uint8_t* const* shares;
+	size_t length, chunk;
+};
+
+static void wide_combine_task(void* arg, size_t task) {
+	const struct wide_combine_job* job = arg;
+	size_t offset = task * job->chunk;
+	size_t count = job->length - offset < job->chunk ? job->length - offset : job->chunk;
+	wide_dot(job->combiner->field_bits, job->secret, job->shares, job->combiner->weights, job->combiner->shares_required, offset, count);
+}
+
+void wideCombinerBufferParallel(struct pool* pool, const struct wide_combiner* combiner, uint8_t secret[], const uint8_t* const shares[], size_t length) {
+	CHECKSTATE(length % (combiner->field_bits / 8) == 0);
+	struct wide_combine_job job = { combiner, secret, shares, length, wide_chunk_size(combiner->shares_required + 1) };
+	pool_run(pool, wide_combine_task, &job, (length + job.chunk - 1) / job.chunk);
+}
@@ -0,0 +1,79 @@
+/*
+ * Shamir's scheme over GF(2^WIDE_BITS), the template wide.c instantiates once per width
+ *
+ * Copyright (C) 2013 Matt Corallo <git@bluematt.me>
+ *
+ * This file is part of ASSS (Audit-friendly Shamir's Secret Sharing)
+ *
+ * ASSS is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * ASSS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public
+ * License along with ASSS.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * No include guard: wide.c defines WIDE_BITS, along with gf_mul<WIDE_BITS> and
+ * gf_invert<WIDE_BITS>, before each inclusion. WIDE_BITS is undefined again at the end.
+ */
+
+#if WIDE_BITS == 16
+#define WIDE_T uint16_t
+#elif WIDE_BITS == 32
+#define WIDE_T uint32_t
+#else
+#error "WIDE_BITS must be 16 or 32"
+#endif
+#define WIDE_PASTE(name, bits) name##bits
+#define WIDE_NAME(name, bits) WIDE_PASTE(name, bits)
+#define WIDE(name) WIDE_NAME(name, WIDE_BITS)
+
+/**
+ * Calculates the Y coordinate that the point with the given X
+ * coefficients[0] == secret, the rest are random values
+ */
+WIDE_T WIDE(calculateQ)(const WIDE_T coefficients[], uint32_t shares_required, WIDE_T x) {
+	// Horner's rule, from the highest coefficient down
+	WIDE_T ret = 0;
+	uint32_t i;
+	CHECKSTATE(x != 0); // q(0) == secret, though so does a[0]
+	if (shares_required == 0)
+		return ret; // no coefficients at all
+	ret = coefficients[shares_required - 1];
+	for (i = shares_required - 1; i > 0; i--)
+		ret = WIDE(gf_mul)(ret, x) ^ coefficients[i - 1];
+	return ret;
+}
+
+/**
+ * Derives the secret given a set of shares_required points (x and q coordinates)
+ */
+WIDE_T WIDE(calculateSecret)(const WIDE_T x[], const WIDE_T q[], uint32_t shares_required) {
+	WIDE_T ret = 0;
+	uint32_t i, j;
+	for (i = 0; i < shares_required; i++) {
+		WIDE_T numerator = q[i], denominator = 1;
+		for (j = 0; j < shares_required; j++) {
+			if (i == j)
+				continue;
+			numerator = WIDE(gf_mul)(numerator, x[j]);
+			denominator = WIDE(gf_mul)(denominator, x[i] ^ x[j]);
+		}
+		ret ^= WIDE(gf_mul)(numerator, WIDE(gf_invert)(denominator));
+	}
+	return ret;
+}
+
+#undef WIDE
+#undef WIDE_NAME
+#undef WIDE_PASTE
+#undef WIDE_T
+#undef WIDE_BITS